@@ -0,0 +1,182 @@
+/**
+ * Copyright 2018-present Onchere Bironga
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef WHACK_ABI_HPP
+#define WHACK_ABI_HPP
+
+#include "aggregate.hpp"
+
+namespace whack::codegen::abi {
+
+// Aggregates that fit in two registers are passed and returned by value
+// (the backend classifies them into registers); larger ones are passed
+// in memory as byval arguments and returned through an sret slot.
+inline static bool isPassedIndirectly(const llvm::Module& module,
+                                      llvm::Type* const type) {
+  if (!type->isAggregateType() || !type->isSized()) {
+    return false;
+  }
+  const auto& layout = module.getDataLayout();
+  return layout.getTypeAllocSize(type) > 2 * layout.getPointerSize();
+}
+
+static llvm::FunctionType* lowerFunctionType(const llvm::Module& module,
+                                             llvm::FunctionType* const type) {
+  small_vector<llvm::Type*> params;
+  auto returnType = type->getReturnType();
+  if (isPassedIndirectly(module, returnType)) {
+    params.push_back(returnType->getPointerTo(0));
+    returnType = BasicTypes["void"];
+  }
+  for (const auto param : type->params()) {
+    params.push_back(isPassedIndirectly(module, param)
+                         ? param->getPointerTo(0)
+                         : param);
+  }
+  return llvm::FunctionType::get(returnType, params, type->isVarArg());
+}
+
+// the type @param func was declared with in source
+static llvm::FunctionType* getSourceType(const llvm::Function* const func) {
+  if (const auto md = func->getMetadata("abi")) {
+    const auto proto =
+        llvm::mdconst::extract<llvm::Constant>(md->getOperand(0));
+    return llvm::cast<llvm::FunctionType>(
+        proto->getType()->getPointerElementType());
+  }
+  return func->getFunctionType();
+}
+
+// the argument of @param func for source parameter @param idx
+inline static llvm::Argument* getArg(llvm::Function* const func,
+                                     const size_t idx) {
+  return &func->arg_begin()[idx + func->hasStructRetAttr()];
+}
+
+/// Creates a function declared in source with @param type, lowering its
+/// by-value aggregates according to the ABI
+static llvm::Function* createFunction(llvm::Module* const module,
+                                      llvm::FunctionType* const type,
+                                      const llvm::Twine& name) {
+  const auto lowered = lowerFunctionType(*module, type);
+  const auto func = llvm::Function::Create(
+      lowered, llvm::Function::ExternalLinkage, name, module);
+  if (lowered == type) {
+    return func;
+  }
+  auto& ctx = module->getContext();
+  func->setMetadata(
+      "abi", llvm::MDNode::get(ctx, llvm::ConstantAsMetadata::get(
+                                        llvm::Constant::getNullValue(
+                                            type->getPointerTo(0)))));
+  const auto hasSRet = lowered->getNumParams() != type->getNumParams();
+  if (hasSRet) {
+    func->addParamAttr(0, llvm::Attribute::StructRet);
+    func->addParamAttr(0, llvm::Attribute::NoAlias);
+  }
+  for (unsigned i = 0; i < type->getNumParams(); ++i) {
+    const auto param = type->getParamType(i);
+    if (isPassedIndirectly(*module, param)) {
+      const auto idx = i + hasSRet;
+      func->addParamAttr(idx, llvm::Attribute::ByVal);
+      func->addParamAttr(idx, llvm::Attribute::getWithAlignment(
+                                  ctx, getAlignment(module, param)));
+    }
+  }
+  return func;
+}
+
+/// Calls @param callee with source-level @param args; calls returning
+/// through an sret slot yield the slot (an lvalue)
+static llvm::Value* emitCall(llvm::IRBuilder<>& builder,
+                             llvm::Value* const callee,
+                             llvm::ArrayRef<llvm::Value*> args) {
+  const auto func = llvm::dyn_cast<llvm::Function>(callee);
+  if (!func || !func->getMetadata("abi")) {
+    return builder.CreateCall(callee, args);
+  }
+  const auto type = getSourceType(func);
+  small_vector<llvm::Value*> lowered;
+  llvm::AllocaInst* result = nullptr;
+  if (func->hasStructRetAttr()) {
+    result = createAlloca(builder, type->getReturnType());
+    lowered.push_back(result);
+  }
+  const auto module = func->getParent();
+  for (const auto arg : args) {
+    if (isPassedIndirectly(*module, arg->getType())) {
+      const auto tmp = createAlloca(builder, arg->getType());
+      aggregate::emitStore(builder, arg, tmp);
+      lowered.push_back(tmp);
+    } else {
+      lowered.push_back(arg);
+    }
+  }
+  const auto call = builder.CreateCall(func, lowered);
+  call->setAttributes(func->getAttributes());
+  if (result) {
+    return result;
+  }
+  return call;
+}
+
+/// Returns @param values from the current function
+static llvm::Error emitReturn(llvm::IRBuilder<>& builder,
+                              llvm::ArrayRef<llvm::Value*> values) {
+  const auto func = builder.GetInsertBlock()->getParent();
+  if (!func->hasStructRetAttr()) {
+    if (values.empty()) {
+      builder.CreateRetVoid();
+    } else if (values.size() == 1) {
+      builder.CreateRet(values[0]);
+    } else {
+      builder.CreateAggregateRet(values.data(),
+                                 static_cast<unsigned>(values.size()));
+    }
+    return llvm::Error::success();
+  }
+  const auto slot = &func->arg_begin()[0];
+  const auto type = slot->getType()->getPointerElementType();
+  const auto mismatch = [&] {
+    return error("function `{}` returns an invalid type",
+                 func->getName().str());
+  };
+  if (values.empty()) {
+    return mismatch();
+  }
+  if (values.size() == 1) {
+    if (values[0]->getType() != type) {
+      return mismatch();
+    }
+    aggregate::emitStore(builder, values[0], slot);
+  } else {
+    if (!type->isStructTy() || type->getStructNumElements() != values.size()) {
+      return mismatch();
+    }
+    for (size_t i = 0; i < values.size(); ++i) {
+      if (values[i]->getType() != type->getStructElementType(i)) {
+        return mismatch();
+      }
+      align(builder.CreateStore(values[i],
+                                builder.CreateStructGEP(type, slot, i)));
+    }
+  }
+  builder.CreateRetVoid();
+  return llvm::Error::success();
+}
+
+} // end namespace whack::codegen::abi
+
+#endif // WHACK_ABI_HPP
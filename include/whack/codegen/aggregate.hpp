@@ -0,0 +1,169 @@
+/**
+ * Copyright 2018-present Onchere Bironga
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef WHACK_AGGREGATE_HPP
+#define WHACK_AGGREGATE_HPP
+
+#include "scope.hpp"
+#include <llvm/Analysis/AliasAnalysis.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/IntrinsicInst.h>
+
+namespace whack::codegen::aggregate {
+
+// LLVM scalarizes first-class loads and stores of aggregates into an
+// instruction per element, so aggregates larger than two registers (see
+// abi::isPassedIndirectly) are moved with llvm.memcpy between addresses.
+inline static bool isCopiedInMemory(const llvm::Module& module,
+                                    llvm::Type* const type) {
+  if (!type->isAggregateType() || !type->isSized()) {
+    return false;
+  }
+  const auto& layout = module.getDataLayout();
+  return layout.getTypeAllocSize(type) > 2 * layout.getPointerSize();
+}
+
+// whether @param dest and @param src lie in distinct stack slots or
+// globals, and so cannot overlap
+static bool areDisjoint(const llvm::Value* const dest,
+                        const llvm::Value* const src,
+                        const llvm::DataLayout& layout) {
+  const auto destObject = llvm::GetUnderlyingObject(dest, layout);
+  const auto srcObject = llvm::GetUnderlyingObject(src, layout);
+  const auto isSlotOrGlobal = [](const llvm::Value* const object) {
+    return llvm::isa<llvm::AllocaInst>(object) ||
+           llvm::isa<llvm::GlobalVariable>(object);
+  };
+  return destObject != srcObject && isSlotOrGlobal(destObject) &&
+         isSlotOrGlobal(srcObject);
+}
+
+// copies the aggregate of @param type at @param src to @param dest; the
+// two may overlap (e.g. `a = *p` where p points into a) unless they are
+// known to be distinct objects, in which case memcpy does
+static void emitCopy(llvm::IRBuilder<>& builder, llvm::Value* const dest,
+                     llvm::Value* const src, llvm::Type* const type) {
+  if (dest == src) {
+    return;
+  }
+  const auto module = builder.GetInsertBlock()->getModule();
+  const auto& layout = module->getDataLayout();
+  const auto size = layout.getTypeAllocSize(type);
+  const auto alignment = isPackedField(dest) || isPackedField(src)
+                             ? 1
+                             : getAlignment(module, type);
+  if (areDisjoint(dest, src, layout)) {
+    builder.CreateMemCpy(dest, src, size, alignment);
+  } else {
+    builder.CreateMemMove(dest, src, size, alignment);
+  }
+}
+
+// whether @param inst may write to the memory @param ptr points to
+static bool mayClobber(const llvm::Instruction& inst,
+                       const llvm::Value* const ptr) {
+  if (!inst.mayWriteToMemory()) {
+    return false;
+  }
+  const llvm::Value* dest = nullptr;
+  if (const auto store = llvm::dyn_cast<llvm::StoreInst>(&inst)) {
+    dest = store->getPointerOperand();
+  } else if (const auto mem = llvm::dyn_cast<llvm::MemIntrinsic>(&inst)) {
+    dest = mem->getRawDest();
+  } else if (const auto intrinsic = llvm::dyn_cast<llvm::IntrinsicInst>(&inst);
+             intrinsic &&
+             (intrinsic->getIntrinsicID() == llvm::Intrinsic::lifetime_start ||
+              intrinsic->getIntrinsicID() == llvm::Intrinsic::lifetime_end)) {
+    dest = intrinsic->getArgOperand(1);
+  } else {
+    return true; // e.g. calls
+  }
+  const auto& layout = inst.getModule()->getDataLayout();
+  const auto destObject = llvm::GetUnderlyingObject(dest, layout);
+  const auto object = llvm::GetUnderlyingObject(ptr, layout);
+  // distinct stack slots and globals never overlap
+  return destObject == object || !llvm::isIdentifiedObject(destObject) ||
+         !llvm::isIdentifiedObject(object);
+}
+
+// the address @param value was loaded from, if the memory there still
+// holds it at the insertion point of @param builder
+static llvm::Value* getSource(const llvm::IRBuilder<>& builder,
+                              llvm::Value* const value) {
+  const auto load = llvm::dyn_cast<llvm::LoadInst>(value);
+  if (!load || load->isVolatile() ||
+      load->getParent() != builder.GetInsertBlock()) {
+    return nullptr;
+  }
+  const auto ptr = load->getPointerOperand();
+  for (auto inst = std::next(load->getIterator());
+       inst != builder.GetInsertPoint(); ++inst) {
+    if (mayClobber(*inst, ptr)) {
+      return nullptr;
+    }
+  }
+  return ptr;
+}
+
+/// Stores @param value to @param dest; large aggregates loaded from memory
+/// are copied from there instead (the load is left for DCE)
+static void emitStore(llvm::IRBuilder<>& builder, llvm::Value* const value,
+                      llvm::Value* const dest) {
+  const auto module = builder.GetInsertBlock()->getModule();
+  const auto type = value->getType();
+  const auto src = isCopiedInMemory(*module, type)
+                       ? getSource(builder, value)
+                       : nullptr;
+  if (!src) {
+    align(builder.CreateStore(value, dest));
+    return;
+  }
+  emitCopy(builder, dest, src, type);
+}
+
+/// Element @param idx of aggregate @param value, loaded through a GEP
+/// when @param value is a large aggregate still in memory
+static llvm::Value* getElement(llvm::IRBuilder<>& builder,
+                               llvm::Value* const value, const unsigned idx) {
+  const auto module = builder.GetInsertBlock()->getModule();
+  const auto type = value->getType();
+  const auto src = isCopiedInMemory(*module, type)
+                       ? getSource(builder, value)
+                       : nullptr;
+  if (!src) {
+    return type->isVectorTy() ? builder.CreateExtractElement(value, idx)
+                              : builder.CreateExtractValue(value, idx);
+  }
+  const auto ptr =
+      type->isStructTy()
+          ? builder.CreateStructGEP(type, src, idx)
+          : builder.CreateConstInBoundsGEP2_32(type, src, 0, idx);
+  return align(builder.CreateLoad(ptr));
+}
+
+/// The aggregate built in stack slot @param slot: large aggregates are
+/// returned as the slot itself (an lvalue) rather than loaded
+static llvm::Value* getResult(llvm::IRBuilder<>& builder,
+                              llvm::AllocaInst* const slot) {
+  const auto module = builder.GetInsertBlock()->getModule();
+  if (isCopiedInMemory(*module, slot->getAllocatedType())) {
+    return slot;
+  }
+  return align(builder.CreateLoad(slot));
+}
+
+} // end namespace whack::codegen::aggregate
+
+#endif // WHACK_AGGREGATE_HPP
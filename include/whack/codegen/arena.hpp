@@ -0,0 +1,199 @@
+/**
+ * Copyright 2018-present Onchere Bironga
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef WHACK_ARENA_HPP
+#define WHACK_ARENA_HPP
+
+#include "fwd.hpp"
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/MDBuilder.h>
+
+namespace whack::codegen {
+
+/// The builtin `arena` type: a bump allocator over chunks which the runtime
+/// grows (and keeps for reuse across resets). `new(a) T` and `new(a) [n]T`
+/// bump the arena's top inline, calling into the runtime only when the
+/// current chunk is full; `a.reset()` recycles every chunk in O(1) and
+/// `a.release()` frees them. Deleting memory we know is an arena's does
+/// nothing; `delete` frees anything else as heap memory.
+/// The layout matches `Arena` in runtime.c.
+class Arena {
+public:
+  static llvm::StructType* getType(const llvm::Module* const module) {
+    if (const auto type = module->getTypeByName("arena")) {
+      return type;
+    }
+    const auto charPtrTy = BasicTypes["char"]->getPointerTo(0);
+    // top, end, current chunk, first chunk
+    return llvm::StructType::create(
+        module->getContext(), {charPtrTy, charPtrTy, charPtrTy, charPtrTy},
+        "arena");
+  }
+
+  static bool isa(const llvm::Value* const value) {
+    auto type = value->getType();
+    while (type->isPointerTy()) {
+      type = type->getPointerElementType();
+    }
+    const auto structure = llvm::dyn_cast<llvm::StructType>(type);
+    return structure && structure->hasName() &&
+           structure->getName() == "arena";
+  }
+
+  // the address of the arena @param value designates (an arena variable,
+  // or a pointer to one), or nullptr
+  static llvm::Value* getAddress(llvm::IRBuilder<>& builder,
+                                 llvm::Value* const value) {
+    if (!isa(value) || !value->getType()->isPointerTy()) {
+      return nullptr;
+    }
+    const auto module = builder.GetInsertBlock()->getModule();
+    const auto arenaPtrTy = getType(module)->getPointerTo(0);
+    if (value->getType() == arenaPtrTy) {
+      return value;
+    }
+    if (value->getType() == arenaPtrTy->getPointerTo(0)) {
+      return align(builder.CreateLoad(value));
+    }
+    return nullptr;
+  }
+
+  /// Allocates @param size bytes aligned to @param alignment in @param arena
+  /// (at least a byte, so that an empty arena gives no null pointers)
+  static llvm::Value* allocate(llvm::IRBuilder<>& builder,
+                               llvm::Value* const arena, llvm::Value* size,
+                               const unsigned alignment) {
+    const auto func = builder.GetInsertBlock()->getParent();
+    const auto module = func->getParent();
+    auto& ctx = module->getContext();
+    const auto type = getType(module);
+    const auto int64Ty = BasicTypes["int64"];
+    const auto charPtrTy = BasicTypes["char"]->getPointerTo(0);
+    if (const auto c = llvm::dyn_cast<llvm::ConstantInt>(size)) {
+      size = c->isZero() ? builder.getInt64(1) : size;
+    } else {
+      size = builder.CreateSelect(
+          builder.CreateICmpEQ(size, builder.getInt64(0)), builder.getInt64(1),
+          size);
+    }
+    const auto topPtr = builder.CreateStructGEP(type, arena, 0);
+    const auto endPtr = builder.CreateStructGEP(type, arena, 1);
+    auto top = builder.CreatePtrToInt(align(builder.CreateLoad(topPtr)),
+                                      int64Ty);
+    if (alignment > 1) {
+      top = builder.CreateAnd(builder.CreateAdd(top, builder.getInt64(
+                                                         alignment - 1)),
+                              builder.getInt64(~uint64_t{alignment - 1}));
+    }
+    // (huge sizes, e.g. of overflowing element counts, wrap around)
+    const auto sum = builder.CreateCall(
+        llvm::Intrinsic::getDeclaration(
+            module, llvm::Intrinsic::uadd_with_overflow, int64Ty),
+        {top, size});
+    const auto next = builder.CreateExtractValue(sum, 0);
+    const auto end = builder.CreatePtrToInt(align(builder.CreateLoad(endPtr)),
+                                            int64Ty);
+    const auto fits =
+        builder.CreateAnd(builder.CreateNot(builder.CreateExtractValue(sum, 1)),
+                          builder.CreateICmpULE(next, end));
+    const auto bump = llvm::BasicBlock::Create(ctx, "arena.bump", func);
+    const auto grow = llvm::BasicBlock::Create(ctx, "arena.grow", func);
+    const auto cont = llvm::BasicBlock::Create(ctx, "arena.cont", func);
+    builder.CreateCondBr(fits, bump, grow,
+                         llvm::MDBuilder{ctx}.createBranchWeights(2000, 1));
+
+    builder.SetInsertPoint(bump);
+    align(builder.CreateStore(builder.CreateIntToPtr(next, charPtrTy),
+                              topPtr));
+    const auto bumped = builder.CreateIntToPtr(top, charPtrTy);
+    builder.CreateBr(cont);
+
+    builder.SetInsertPoint(grow);
+    const auto grown = builder.CreateCall(
+        module->getOrInsertFunction("__builtin_arena_alloc", charPtrTy,
+                                    type->getPointerTo(0), int64Ty, int64Ty),
+        {arena, size, builder.getInt64(alignment)});
+    builder.CreateBr(cont);
+
+    builder.SetInsertPoint(cont);
+    const auto mem = builder.CreatePHI(charPtrTy, 2);
+    mem->addIncoming(bumped, bump);
+    mem->addIncoming(grown, grow);
+    mem->setMetadata("arena", llvm::MDNode::get(ctx, {}));
+    return mem;
+  }
+
+  // whether @param ptr is known to point into an arena, including
+  // through variables only ever assigned arena memory
+  static bool isArenaMemory(const llvm::Value* ptr,
+                            const unsigned depth = 0) {
+    ptr = ptr->stripPointerCasts();
+    if (const auto inst = llvm::dyn_cast<llvm::Instruction>(ptr)) {
+      if (inst->getMetadata("arena")) {
+        return true;
+      }
+    }
+    const auto load = llvm::dyn_cast<llvm::LoadInst>(ptr);
+    if (!load || depth > 4) {
+      return false;
+    }
+    const auto variable =
+        llvm::dyn_cast<llvm::AllocaInst>(load->getPointerOperand());
+    if (!variable) {
+      return false;
+    }
+    auto assigned = false;
+    for (const auto user : variable->users()) {
+      if (const auto store = llvm::dyn_cast<llvm::StoreInst>(user)) {
+        if (store->getValueOperand() == variable ||
+            !isArenaMemory(store->getValueOperand(), depth + 1)) {
+          return false;
+        }
+        assigned = true;
+      }
+    }
+    return assigned;
+  }
+
+  /// `a.reset()` and `a.release()`
+  static llvm::Expected<llvm::Value*>
+  call(llvm::IRBuilder<>& builder, llvm::Value* const value,
+       const mpc_ast_t* const memberName, llvm::ArrayRef<llvm::Value*> args) {
+    const llvm::StringRef member{memberName->contents};
+    const auto line = memberName->state.row + 1;
+    const auto arena = getAddress(builder, value);
+    if (!arena) {
+      return error("invalid arena at line {}", line);
+    }
+    if (member != "reset" && member != "release") {
+      return error("arenas have no member `{}` at line {}", member.str(),
+                   line);
+    }
+    if (!args.empty()) {
+      return error("arena `{}` takes no arguments at line {}", member.str(),
+                   line);
+    }
+    const auto module = builder.GetInsertBlock()->getModule();
+    return builder.CreateCall(
+        module->getOrInsertFunction(format("__builtin_arena_{}", member.str()),
+                                    BasicTypes["void"],
+                                    getType(module)->getPointerTo(0)),
+        arena);
+  }
+};
+
+} // end namespace whack::codegen
+
+#endif // WHACK_ARENA_HPP
@@ -0,0 +1,318 @@
+/**
+ * Copyright 2018-present Onchere Bironga
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef WHACK_BUILD_HPP
+#define WHACK_BUILD_HPP
+
+#include "module.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <llvm/Support/ThreadPool.h>
+
+namespace whack::codegen {
+
+/// A project build (`whack build`). The modules a root source file uses,
+/// directly or not, are found by scanning module declarations and uses
+/// (parsing, without codegen) into a dependency DAG. Each module is then
+/// compiled once, in parallel in topological order, into an object file
+/// and an interface summary (see ModuleSummary), which its importers link
+/// in rather than compiling the module again. The objects are linked at
+/// the end.
+class Build {
+public:
+  explicit Build(const std::string& root,
+                 const std::string& directory = ".whack")
+      : root_{getAbsolutePath(root)}, directory_{getAbsolutePath(directory)} {}
+
+  llvm::Error run(const unsigned jobs, const std::string& executable) {
+    const auto start = std::chrono::steady_clock::now();
+    if (auto err = this->scan()) {
+      return err;
+    }
+    if (const auto ec = llvm::sys::fs::create_directories(directory_)) {
+      return error("cannot create build directory `{}`: {}", directory_,
+                   ec.message());
+    }
+    for (size_t i = 0; i < units_.size(); ++i) {
+      auto& unit = units_[i];
+      const auto stem = format("{}/{}.{}", directory_, i, unit.name);
+      unit.object = stem + ".o";
+      unit.summary = stem + ".wi";
+      for (const auto use : unit.uses) {
+        units_[use].users.push_back(i);
+      }
+    }
+
+    // a module compiles once the modules it uses have
+    std::vector<std::atomic<size_t>> pending(units_.size());
+    for (size_t i = 0; i < units_.size(); ++i) {
+      pending[i] = units_[i].uses.size();
+    }
+    std::mutex mutex;
+    llvm::Error errors = llvm::Error::success();
+    // (hardware_concurrency may not know, and say 0)
+    llvm::ThreadPool pool{
+        std::max(1u, jobs ? jobs : std::thread::hardware_concurrency())};
+    // the jobs compile with our options, and report where we do
+    const auto options = Options::get();
+    std::function<void(size_t)> submit = [&](const size_t i) {
+      pool.async([&, i] {
+        options.use();
+        ModuleSummaries::current() = &summaries_;
+        if (auto err = this->compile(units_[i])) {
+          std::lock_guard<std::mutex> lock{mutex};
+          errors = llvm::joinErrors(std::move(errors), std::move(err));
+          return; // its users never compile
+        }
+        for (const auto user : units_[i].users) {
+          if (--pending[user] == 0) {
+            submit(user);
+          }
+        }
+      });
+    };
+    for (size_t i = 0; i < units_.size(); ++i) {
+      if (units_[i].uses.empty()) {
+        submit(i);
+      }
+    }
+    pool.wait();
+    if (errors) {
+      return errors;
+    }
+
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    this->reportCriticalPath(elapsed.count());
+    std::vector<std::string> objects;
+    for (const auto& unit : units_) {
+      objects.push_back(unit.object);
+    }
+    const auto executableFilename =
+        executable.size() ? executable
+                          : getAbsolutePath(units_.back().name + ".exe");
+    return Module::link(objects, executableFilename);
+  }
+
+private:
+  struct Unit {
+    std::string name;
+    // module paths in the sources are relative to this (the working
+    // directory for the root)
+    std::string directory;
+    std::vector<std::string> sources;
+    std::vector<size_t> uses;
+    std::vector<size_t> users{};
+    std::string object{};
+    std::string summary{};
+    double seconds{0};
+  };
+
+  const std::string root_;
+  const std::string directory_;
+  ModuleSummaries summaries_;
+  // in topological order: modules come after those they use, the root last
+  std::vector<Unit> units_;
+  // the units of module directories, and those being scanned (-1)
+  std::unordered_map<std::string, size_t> indices_;
+  // the modules being scanned, innermost last
+  std::vector<std::string> stack_;
+
+  constexpr static auto Scanning = static_cast<size_t>(-1);
+
+  using uses_t = std::vector<std::pair<std::string, std::string>>;
+
+  // the module @param source declares, and the paths and names of the
+  // modules it uses
+  static llvm::Expected<std::pair<std::string, uses_t>>
+  scanSource(const std::string& source) {
+    mpc_result_t res;
+    if (!mpc_parse_contents(source.c_str(), MainParser->get(), &res)) {
+      const auto message = mpc_err_string(res.error);
+      mpc_err_delete(res.error);
+      auto err = error("{}", message);
+      free(message);
+      return err;
+    }
+    const auto ast = reinterpret_cast<mpc_ast_t*>(res.output);
+    SCOPE_EXIT { mpc_ast_delete(ast); };
+    std::string name;
+    uses_t uses;
+    for (auto i = 0; i < ast->children_num; ++i) {
+      const auto child = ast->children[i];
+      const auto tag = getOutermostAstTag(child);
+      if (tag == "moduledecl") {
+        name = child->children[1]->contents;
+      } else if (tag == "moduleuse") {
+        uses.push_back(elements::ModuleUse{child}.getModulePath());
+      }
+    }
+    return std::pair{std::move(name), std::move(uses)};
+  }
+
+  // scans the root and (first) the modules it uses
+  llvm::Error scan() {
+    auto unit = this->scanUnit("", {root_}, "");
+    if (!unit) {
+      return unit.takeError();
+    }
+    return llvm::Error::success();
+  }
+
+  /// Scans the module @param name built from @param sources after the
+  /// modules it uses; returns its index
+  llvm::Expected<size_t> scanUnit(const std::string& directory,
+                                  std::vector<std::string> sources,
+                                  const std::string& name) {
+    Unit unit{name, directory, std::move(sources), {}};
+    stack_.push_back(name);
+    SCOPE_EXIT { stack_.pop_back(); };
+    for (const auto& source : unit.sources) {
+      auto scanned = scanSource(source);
+      if (!scanned) {
+        return scanned.takeError();
+      }
+      auto& [declared, uses] = *scanned;
+      if (unit.name.empty()) { // the root
+        unit.name = stack_.back() = declared;
+      } else if (declared != unit.name) {
+        return error("invalid module name in file at path `{}` "
+                     "(expected `{}`, got `{}`)",
+                     source, unit.name, declared);
+      }
+      for (const auto& [modulePath, moduleName] : uses) {
+        auto use = this->scanUse(directory, modulePath, moduleName);
+        if (!use) {
+          return use.takeError();
+        }
+        if (llvm::find(unit.uses, *use) == unit.uses.end()) {
+          unit.uses.push_back(*use);
+        }
+      }
+    }
+    units_.push_back(std::move(unit));
+    return units_.size() - 1;
+  }
+
+  llvm::Expected<size_t> scanUse(const std::string& from,
+                                 const std::string& modulePath,
+                                 const std::string& moduleName) {
+    auto directory = resolveModulePath(from, modulePath);
+    if (!directory) {
+      return directory.takeError();
+    }
+    const auto [index, inserted] = indices_.insert({*directory, Scanning});
+    if (!inserted) {
+      if (index->second == Scanning) {
+        std::string cycle;
+        for (const auto& name : stack_) {
+          cycle += name + " -> ";
+        }
+        return error("module `{}` uses itself ({}{})", moduleName, cycle,
+                     moduleName);
+      }
+      return index->second;
+    }
+    auto sources = getModuleSources(*directory);
+    if (!sources) {
+      return sources.takeError();
+    }
+    if (sources->empty()) {
+      return error("module `{}` (at `{}`) has no source files", moduleName,
+                   *directory);
+    }
+    auto unit = this->scanUnit(*directory, std::move(*sources), moduleName);
+    if (!unit) {
+      return unit.takeError();
+    }
+    indices_[*directory] = *unit;
+    return *unit;
+  }
+
+  // compiles the sources of @param unit into its object file and summary
+  llvm::Error compile(Unit& unit) const {
+    const auto start = std::chrono::steady_clock::now();
+    llvm::LLVMContext ctx;
+    const auto outerDirectory =
+        std::exchange(getImportDirectory(), unit.directory);
+    SCOPE_EXIT { getImportDirectory() = outerDirectory; };
+    std::unique_ptr<llvm::Module> module;
+    for (const auto& source : unit.sources) {
+      auto mod = Module{source, &ctx}.codegen();
+      if (!mod) {
+        return mod.takeError();
+      }
+      if (!module) {
+        module = std::move(*mod);
+      } else if (llvm::Linker::linkModules(*module, std::move(*mod))) {
+        return error("cannot link `{}` into module `{}`", source, unit.name);
+      }
+    }
+    ConstantPool::merge(*module);
+    // (Module::codegen optimizes the root's sources as a whole program)
+    if (module->getModuleIdentifier() != "Main") {
+      pass::Manager::get(reinterpret_cast<llvm::TargetMachine*>(
+                             MainTarget->getMachine()),
+                         false)
+          .run(*module);
+    }
+    if (auto err = Module::emitObjectFile(module.get(), unit.object)) {
+      return err;
+    }
+    if (!unit.directory.empty()) { // the root has no importers
+      if (auto err = ModuleSummary::write(*module, unit.summary)) {
+        return err;
+      }
+      ModuleSummaries::current()->add(unit.directory, unit.summary);
+    }
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    unit.seconds = elapsed.count();
+    return llvm::Error::success();
+  }
+
+  // logs the chain of modules (each waiting on the one before) which
+  // bounds the build time however many jobs we run
+  void reportCriticalPath(const double elapsed) const {
+    std::vector<double> finish(units_.size());
+    std::vector<size_t> via(units_.size(), Scanning);
+    size_t last = 0;
+    for (size_t i = 0; i < units_.size(); ++i) {
+      finish[i] = units_[i].seconds;
+      for (const auto use : units_[i].uses) {
+        if (finish[use] + units_[i].seconds > finish[i]) {
+          finish[i] = finish[use] + units_[i].seconds;
+          via[i] = use;
+        }
+      }
+      if (finish[i] > finish[last]) {
+        last = i;
+      }
+    }
+    std::string path;
+    for (auto i = last; i != Scanning; i = via[i]) {
+      path = format("{} ({:.2f}s){}{}", units_[i].name, units_[i].seconds,
+                    path.empty() ? "" : " -> ", path);
+    }
+    getLog().info(
+        "built {} modules in {:.2f}s; critical path ({:.2f}s): {}",
+        units_.size(), elapsed, finish[last], path);
+  }
+};
+
+} // end namespace whack::codegen
+
+#endif // WHACK_BUILD_HPP
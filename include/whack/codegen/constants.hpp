@@ -0,0 +1,187 @@
+/**
+ * Copyright 2018-present Onchere Bironga
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef WHACK_CONSTANTS_HPP
+#define WHACK_CONSTANTS_HPP
+
+#include "aggregate.hpp"
+#include <llvm/ADT/Hashing.h>
+
+namespace whack::codegen {
+
+/// The constant pool of a module: constant data (string literals, constant
+/// initializer lists) lives in private unnamed_addr globals named after a
+/// hash of their contents (`.const.<hash>`), so that equal data is emitted
+/// once per module. Imported modules bring their own pool, which merge
+/// folds into the importer's once linked.
+class ConstantPool {
+public:
+  /// Constant aggregates materialized while this lives (e.g. the value of
+  /// an immutable `let` binding) are used in place, as read-only lvalues
+  /// of their pooled globals
+  class InPlace {
+  public:
+    explicit InPlace(const bool enable = true)
+        : enclosing_{std::exchange(inPlace(), enable)} {}
+    ~InPlace() { inPlace() = enclosing_; }
+
+    InPlace(const InPlace&) = delete;
+    InPlace& operator=(const InPlace&) = delete;
+
+  private:
+    const bool enclosing_;
+  };
+
+  // the pooled global holding @param value in @param module
+  static llvm::GlobalVariable* get(llvm::Module* const module,
+                                   llvm::Constant* const value) {
+    const auto base =
+        format(".const.{:x}", static_cast<size_t>(hash(value)));
+    for (unsigned n = 0;; ++n) {
+      const auto name = n ? format("{}.{}", base, n) : base;
+      const auto global = module->getNamedGlobal(name);
+      if (!global) {
+        const auto pooled = new llvm::GlobalVariable{
+            *module, value->getType(), true,
+            llvm::GlobalValue::PrivateLinkage, value, name};
+        pooled->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+        pooled->setAlignment(getAlignment(module, value->getType()));
+        return pooled;
+      }
+      if (isPooled(*global) && global->getInitializer() == value) {
+        return global;
+      }
+    }
+  }
+
+  // a pointer to the (nul-terminated) string literal @param str
+  static llvm::Constant* getString(llvm::Module* const module,
+                                   const llvm::StringRef str) {
+    const auto data =
+        llvm::ConstantDataArray::getString(module->getContext(), str);
+    const auto global = get(module, data);
+    const auto zero = llvm::ConstantInt::get(BasicTypes["int"], 0);
+    return llvm::ConstantExpr::getInBoundsGetElementPtr(
+        global->getValueType(), global,
+        llvm::ArrayRef<llvm::Constant*>{zero, zero});
+  }
+
+  /// Materializes constant aggregate @param value: aggregates that fit in
+  /// two registers are used in place as immediates, larger ones (e.g. lookup
+  /// tables) are copied from the pool with llvm.memcpy into a stack slot,
+  /// which is returned as an lvalue (or used in place, see InPlace)
+  static llvm::Value* materialize(llvm::IRBuilder<>& builder,
+                                  llvm::Constant* const value) {
+    const auto module = builder.GetInsertBlock()->getModule();
+    const auto type = value->getType();
+    if (!aggregate::isCopiedInMemory(*module, type)) {
+      return value;
+    }
+    if (inPlace()) {
+      const auto global = get(module, value);
+      // an instruction, so that it can be named and tagged as an lvalue
+      const auto lvalue =
+          builder.Insert(new llvm::BitCastInst(global, global->getType()));
+      setIsLValue(lvalue);
+      return lvalue;
+    }
+    const auto slot = createAlloca(builder, type);
+    aggregate::emitCopy(builder, slot, get(module, value), type);
+    return slot;
+  }
+
+  // whether @param value is a pooled global used in place by materialize
+  static bool isInPlace(const llvm::Value* const value) {
+    const auto cast = llvm::dyn_cast<llvm::BitCastInst>(value);
+    if (!cast) {
+      return false;
+    }
+    const auto global =
+        llvm::dyn_cast<llvm::GlobalVariable>(cast->getOperand(0));
+    return global && isPooled(*global);
+  }
+
+  // whether @param ptr points into the pool (which is read-only)
+  static bool isInPool(const llvm::Value* const ptr,
+                       const llvm::DataLayout& layout) {
+    const auto global = llvm::dyn_cast<llvm::GlobalVariable>(
+        llvm::GetUnderlyingObject(ptr, layout, 0));
+    return global && isPooled(*global);
+  }
+
+  // folds the duplicate pool entries @param module has after linking
+  static void merge(llvm::Module& module) {
+    llvm::DenseMap<llvm::Constant*, llvm::GlobalVariable*> pool;
+    small_vector<llvm::GlobalVariable*> duplicates;
+    for (auto& global : module.globals()) {
+      if (!isPooled(global)) {
+        continue;
+      }
+      const auto entry = pool.insert({global.getInitializer(), &global});
+      if (!entry.second) {
+        duplicates.push_back(&global);
+      }
+    }
+    for (const auto duplicate : duplicates) {
+      const auto kept = pool[duplicate->getInitializer()];
+      kept->setAlignment(
+          std::max(kept->getAlignment(), duplicate->getAlignment()));
+      duplicate->replaceAllUsesWith(kept);
+      duplicate->eraseFromParent();
+    }
+  }
+
+private:
+  static bool& inPlace() {
+    thread_local bool inPlace = false;
+    return inPlace;
+  }
+
+  static bool isPooled(const llvm::GlobalVariable& global) {
+    return global.getName().startswith(".const.") && global.isConstant() &&
+           global.hasPrivateLinkage() && global.hasGlobalUnnamedAddr() &&
+           global.hasInitializer();
+  }
+
+  // a hash of the contents of @param value, stable across runs so that
+  // pool names are deterministic; collisions are told apart by name suffix
+  static llvm::hash_code hash(const llvm::Constant* const value) {
+    if (const auto data =
+            llvm::dyn_cast<llvm::ConstantDataSequential>(value)) {
+      return llvm::hash_combine(value->getValueID(),
+                                data->getRawDataValues());
+    }
+    if (const auto integral = llvm::dyn_cast<llvm::ConstantInt>(value)) {
+      return llvm::hash_value(integral->getValue());
+    }
+    if (const auto floatingPt = llvm::dyn_cast<llvm::ConstantFP>(value)) {
+      return llvm::hash_value(floatingPt->getValueAPF());
+    }
+    if (llvm::isa<llvm::ConstantAggregate>(value)) {
+      auto code = llvm::hash_combine(value->getValueID(),
+                                     value->getNumOperands());
+      for (const auto& operand : value->operands()) {
+        code = llvm::hash_combine(
+            code, hash(llvm::cast<llvm::Constant>(operand.get())));
+      }
+      return code;
+    }
+    return llvm::hash_value(value->getValueID());
+  }
+};
+
+} // end namespace whack::codegen
+
+#endif // WHACK_CONSTANTS_HPP
@@ -0,0 +1,292 @@
+/**
+ * Copyright 2018-present Onchere Bironga
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef WHACK_COROUTINE_HPP
+#define WHACK_COROUTINE_HPP
+
+#include "scope.hpp"
+#include <llvm/IR/Intrinsics.h>
+
+namespace whack::codegen {
+
+/// A generator function while it is built. Generators return the handle of
+/// their coroutine: a single coro.id/coro.begin in the entry block, a promise
+/// slot holding the values of the last `yield`, one suspend point per yield,
+/// and a final suspend after which llvm.coro.done holds. The coroutine
+/// passes split it into resume/destroy functions, and elide the frame
+/// allocation when a caller iterating it locally inlines it.
+class Coroutine {
+public:
+  explicit Coroutine(llvm::IRBuilder<>& builder, llvm::Type* const promiseType)
+      : function_{builder.GetInsertBlock()->getParent()}, parent_{current()},
+        promiseType_{promiseType} {
+    const auto module = function_->getParent();
+    auto& ctx = module->getContext();
+    const auto charPtrTy = BasicTypes["char"]->getPointerTo(0);
+    const auto null = llvm::ConstantPointerNull::get(charPtrTy);
+    llvm::Value* promise = null;
+    unsigned alignment = 0;
+    if (promiseType_) {
+      promise_ = createAlloca(builder, promiseType_, "coro.promise");
+      alignment = promise_->getAlignment();
+      promise = builder.CreateBitCast(promise_, charPtrTy);
+    }
+    id_ = builder.CreateCall(
+        intrinsic(module, llvm::Intrinsic::coro_id),
+        {builder.getInt32(alignment), promise, null, null}, "coro.id");
+    const auto needsAlloc = builder.CreateCall(
+        intrinsic(module, llvm::Intrinsic::coro_alloc), id_);
+    const auto entry = builder.GetInsertBlock();
+    const auto alloc = llvm::BasicBlock::Create(ctx, "coro.alloc", function_);
+    const auto begin = llvm::BasicBlock::Create(ctx, "coro.begin", function_);
+    builder.CreateCondBr(needsAlloc, alloc, begin);
+
+    builder.SetInsertPoint(alloc);
+    const auto size = builder.CreateCall(
+        intrinsic(module, llvm::Intrinsic::coro_size, BasicTypes["int64"]));
+    const auto malloc = module->getOrInsertFunction(
+        "malloc", charPtrTy, BasicTypes["int64"]);
+    const auto mem = builder.CreateCall(malloc, size);
+    builder.CreateBr(begin);
+
+    builder.SetInsertPoint(begin);
+    const auto frame = builder.CreatePHI(charPtrTy, 2);
+    frame->addIncoming(null, entry);
+    frame->addIncoming(mem, alloc);
+    handle_ = builder.CreateCall(intrinsic(module, llvm::Intrinsic::coro_begin),
+                                 {id_, frame}, "coro.handle");
+
+    // we share the blocks that free the frame and return to the caller
+    cleanup_ = llvm::BasicBlock::Create(ctx, "coro.cleanup", function_);
+    suspend_ = llvm::BasicBlock::Create(ctx, "coro.suspend", function_);
+    const llvm::IRBuilder<>::InsertPointGuard guard{builder};
+    builder.SetInsertPoint(cleanup_);
+    const auto freeMem = builder.CreateCall(
+        intrinsic(module, llvm::Intrinsic::coro_free), {id_, handle_});
+    const auto free = module->getOrInsertFunction(
+        "free", BasicTypes["void"], charPtrTy);
+    builder.CreateCall(free, freeMem);
+    builder.CreateBr(suspend_);
+
+    builder.SetInsertPoint(suspend_);
+    builder.CreateCall(intrinsic(module, llvm::Intrinsic::coro_end),
+                       {handle_, builder.getFalse()});
+    builder.CreateRet(handle_);
+    current() = this;
+  }
+
+  ~Coroutine() { current() = parent_; }
+
+  Coroutine(const Coroutine&) = delete;
+  Coroutine& operator=(const Coroutine&) = delete;
+
+  // the generator being built at the insertion point of @param builder
+  static Coroutine* get(const llvm::IRBuilder<>& builder) {
+    const auto coroutine = current();
+    if (coroutine &&
+        coroutine->function_ == builder.GetInsertBlock()->getParent()) {
+      return coroutine;
+    }
+    return nullptr;
+  }
+
+  // stores @param values in the promise and suspends; code emitted next
+  // runs when the generator is resumed
+  llvm::Error yield(llvm::IRBuilder<>& builder,
+                    llvm::ArrayRef<llvm::Value*> values) {
+    if (auto err = storePromise(builder, values)) {
+      return err;
+    }
+    const auto resume = llvm::BasicBlock::Create(builder.getContext(),
+                                                 "coro.resume", function_);
+    suspend(builder, false, resume);
+    builder.SetInsertPoint(resume);
+    return llvm::Error::success();
+  }
+
+  // suspends for the last time, e.g. on `return` or at the end of the body
+  void finish(llvm::IRBuilder<>& builder) {
+    auto& ctx = builder.getContext();
+    const auto trap = llvm::BasicBlock::Create(ctx, "coro.done", function_);
+    suspend(builder, true, trap);
+    builder.SetInsertPoint(trap);
+    builder.CreateUnreachable(); // a finished coroutine cannot be resumed
+  }
+
+  // keeps the shared blocks last (buildFunction expects the last block
+  // to return)
+  void complete() {
+    cleanup_->moveAfter(&function_->back());
+    suspend_->moveAfter(cleanup_);
+  }
+
+  /// The type of the values a generator yields: std::nullopt if
+  /// @param func is not a generator, nullptr if it yields no values
+  static std::optional<llvm::Type*>
+  getPromiseType(const llvm::Function* const func) {
+    const auto md = func->getMetadata("generator");
+    if (!md) {
+      return std::nullopt;
+    }
+    if (!md->getNumOperands()) {
+      return nullptr;
+    }
+    const auto proto =
+        llvm::mdconst::extract<llvm::Constant>(md->getOperand(0));
+    return proto->getType()->getPointerElementType();
+  }
+
+  static void setPromiseType(llvm::Function* const func,
+                             llvm::Type* const promiseType) {
+    auto& ctx = func->getContext();
+    if (!promiseType) {
+      func->setMetadata("generator", llvm::MDNode::get(ctx, llvm::None));
+      return;
+    }
+    func->setMetadata(
+        "generator",
+        llvm::MDNode::get(ctx, llvm::ConstantAsMetadata::get(
+                                   llvm::Constant::getNullValue(
+                                       promiseType->getPointerTo(0)))));
+  }
+
+  // the generator a call yielding @param handle was made to, if any
+  static llvm::Function* getGenerator(const llvm::Value* const handle) {
+    if (const auto call = llvm::dyn_cast<llvm::CallInst>(handle)) {
+      if (const auto func = call->getCalledFunction();
+          func && getPromiseType(func)) {
+        return func;
+      }
+    }
+    return nullptr;
+  }
+
+  /// Accessors for a generator's @param handle (e.g. in for-in loops)
+  static llvm::Value* done(llvm::IRBuilder<>& builder,
+                           llvm::Value* const handle) {
+    const auto module = builder.GetInsertBlock()->getModule();
+    return builder.CreateCall(intrinsic(module, llvm::Intrinsic::coro_done),
+                              handle);
+  }
+
+  static void resume(llvm::IRBuilder<>& builder, llvm::Value* const handle) {
+    const auto module = builder.GetInsertBlock()->getModule();
+    builder.CreateCall(intrinsic(module, llvm::Intrinsic::coro_resume),
+                       handle);
+  }
+
+  static void destroy(llvm::IRBuilder<>& builder, llvm::Value* const handle) {
+    const auto module = builder.GetInsertBlock()->getModule();
+    builder.CreateCall(intrinsic(module, llvm::Intrinsic::coro_destroy),
+                       handle);
+  }
+
+  // the address of the values last yielded through @param handle
+  static llvm::Value* promise(llvm::IRBuilder<>& builder,
+                              llvm::Value* const handle,
+                              llvm::Type* const promiseType) {
+    const auto module = builder.GetInsertBlock()->getModule();
+    const auto address = builder.CreateCall(
+        intrinsic(module, llvm::Intrinsic::coro_promise),
+        {handle, builder.getInt32(getAlignment(module, promiseType)),
+         builder.getFalse()});
+    return builder.CreateBitCast(address, promiseType->getPointerTo(0));
+  }
+
+private:
+  llvm::Function* const function_;
+  Coroutine* const parent_;
+  llvm::Type* const promiseType_;
+  llvm::AllocaInst* promise_{nullptr};
+  llvm::Value* id_;
+  llvm::Value* handle_;
+  llvm::BasicBlock* cleanup_;
+  llvm::BasicBlock* suspend_;
+
+  static Coroutine*& current() {
+    thread_local Coroutine* coroutine{nullptr};
+    return coroutine;
+  }
+
+  inline static llvm::Function*
+  intrinsic(llvm::Module* const module, const llvm::Intrinsic::ID id,
+            llvm::ArrayRef<llvm::Type*> types = llvm::None) {
+    return llvm::Intrinsic::getDeclaration(module, id, types);
+  }
+
+  llvm::Error storePromise(llvm::IRBuilder<>& builder,
+                           llvm::ArrayRef<llvm::Value*> values) {
+    const auto mismatch = [&] {
+      return error("values yielded do not match the type generator `{}` "
+                   "yields",
+                   function_->getName().str());
+    };
+    if (!promiseType_) {
+      return values.empty() ? llvm::Error::success() : mismatch();
+    }
+    if (values.size() == 1) {
+      if (values[0]->getType() != promiseType_) {
+        return mismatch();
+      }
+      align(builder.CreateStore(values[0], promise_));
+      return llvm::Error::success();
+    }
+    if (!promiseType_->isStructTy() ||
+        promiseType_->getStructNumElements() != values.size()) {
+      return mismatch();
+    }
+    for (size_t i = 0; i < values.size(); ++i) {
+      if (values[i]->getType() != promiseType_->getStructElementType(i)) {
+        return mismatch();
+      }
+      align(builder.CreateStore(
+          values[i], builder.CreateStructGEP(promiseType_, promise_, i)));
+    }
+    return llvm::Error::success();
+  }
+
+  void suspend(llvm::IRBuilder<>& builder, const bool final,
+               llvm::BasicBlock* const resume) {
+    const auto module = function_->getParent();
+    const auto suspended = builder.CreateCall(
+        intrinsic(module, llvm::Intrinsic::coro_suspend),
+        {llvm::ConstantTokenNone::get(module->getContext()),
+         builder.getInt1(final)});
+    const auto switcher = builder.CreateSwitch(suspended, suspend_, 2);
+    switcher->addCase(builder.getInt8(0), resume);
+    switcher->addCase(builder.getInt8(1), cleanup_);
+  }
+};
+
+// whether the function with @param body yields (closures aside)
+static bool isGenerator(const mpc_ast_t* const body) {
+  const llvm::StringRef tag{body->tag};
+  if (tag.contains("yieldstmt")) {
+    return true;
+  }
+  if (tag.contains("closure")) {
+    return false;
+  }
+  for (auto i = 0; i < body->children_num; ++i) {
+    if (isGenerator(body->children[i])) {
+      return true;
+    }
+  }
+  return false;
+}
+
+} // end namespace whack::codegen
+
+#endif // WHACK_COROUTINE_HPP
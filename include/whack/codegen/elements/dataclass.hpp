@@ -18,6 +18,7 @@
 
 #pragma once
 
+#include "../aggregate.hpp"
 #include "../expressions/factors/character.hpp"
 #include "../expressions/factors/ident.hpp"
 #include "../expressions/factors/scoperes.hpp"
@@ -109,57 +110,64 @@ public:
     return module->getTypeByName(dataClass) != nullptr;
   }
 
-  /// @brief constructs a value by selecting a data class ctor
-  /// Assumes we have a data class in @param ast
+  /// @brief constructs a value by selecting the data class ctor in @param ctor
+  /// passing it the (optional) exprlist in @param args.
+  /// Assumes we have a data class in @param ctor
   /// It's up to the caller to ensure we really do
-  static llvm::Expected<llvm::Value*> construct(const mpc_ast_t* const ast,
-                                                llvm::IRBuilder<>& builder) {
-    const auto [className, ctorName] = getDataClassInfo(ast);
+  static llvm::Expected<llvm::Value*> construct(llvm::IRBuilder<>& builder,
+                                                const mpc_ast_t* const ctor,
+                                                const mpc_ast_t* const args) {
+    const auto [className, ctorName] = getDataClassInfo(ctor);
     const auto dataClass = format("class::{}", className);
     const auto module = builder.GetInsertBlock()->getModule();
     const auto dataClassType = module->getTypeByName(dataClass);
 
     const auto alloc =
-        builder.CreateAlloca(dataClassType, 0, nullptr, ctorName);
+        createAlloca(builder, dataClassType, ctorName);
     const auto idx = DataClass::getIndex(module, className, ctorName);
     if (!idx) {
       return error("could not find constructor `{}` for data "
                    "class `{}` at line {}",
-                   ctorName, className, ast->state.row + 1);
+                   ctorName, className, ctor->state.row + 1);
     }
     using namespace expressions::factors;
     const auto tag = Character::get(idx.value());
     builder.CreateStore(
         tag, builder.CreateStructGEP(dataClassType, alloc, 0, "tag"));
 
-    if (getOutermostAstTag(ast->children[2]) == "exprlist") {
-      const auto exprList = expressions::getExprList(ast->children[2]);
-      const auto variantType =
-          module->getTypeByName(format("class::{}::{}", className, ctorName));
-      if (exprList.size() != variantType->getStructNumElements() - 1) {
-        return error("invalid number of elements for constructor "
-                     "`{}` of data class `{}` at line {}",
-                     ctorName, className, ast->state.row + 1);
+    const auto variantType =
+        module->getTypeByName(format("class::{}::{}", className, ctorName));
+    const auto numFields = variantType->getStructNumElements() - 1;
+    small_vector<llvm::Value*> values;
+    if (args != nullptr) {
+      auto vals = expressions::getExprValues(builder,
+                                             expressions::getExprList(args));
+      if (!vals) {
+        return vals.takeError();
       }
+      values = std::move(*vals);
+    }
+    if (values.size() != numFields) {
+      return error("invalid number of elements for constructor "
+                   "`{}` of data class `{}` at line {}",
+                   ctorName, className, ctor->state.row + 1);
+    }
+    if (numFields) {
       const auto variant =
           builder.CreateBitCast(alloc, variantType->getPointerTo(0));
-      for (size_t i = 0; i < exprList.size(); ++i) {
-        auto val = exprList[i]->codegen(builder);
-        if (!val) {
-          return val.takeError();
-        }
-        const auto value = *val;
+      for (size_t i = 0; i < values.size(); ++i) {
+        const auto value = values[i];
         const auto ptr =
             builder.CreateStructGEP(variantType, variant, i + 1, "");
         if (value->getType() != ptr->getType()->getPointerElementType()) {
           return error("type mismatch at index {} of constructor "
                        "`{}` of data class `{}` at line {}",
-                       i, ctorName, className, ast->state.row + 1);
+                       i, ctorName, className, ctor->state.row + 1);
         }
-        builder.CreateStore(value, ptr);
+        aggregate::emitStore(builder, value, ptr);
       }
     }
-    return builder.CreateLoad(alloc);
+    return aggregate::getResult(builder, alloc);
   }
 
   inline static std::optional<unsigned>
@@ -168,12 +176,6 @@ public:
     return getMetadataPartIndex(*module, "classes", className, ctorName);
   }
 
-private:
-  friend class DataClassStmt;
-  const mpc_state_t state_;
-  const std::string class_;
-  std::vector<std::pair<std::string, std::optional<types::TypeList>>> variants_;
-
   static std::pair<std::string, std::string>
   getDataClassInfo(const mpc_ast_t* const ast) {
     auto parts = expressions::factors::ScopeRes{ast}.parts();
@@ -190,6 +192,12 @@ private:
     os.flush();
     return {std::move(className), std::move(ctorName)};
   }
+
+private:
+  friend class DataClassStmt;
+  const mpc_state_t state_;
+  const std::string class_;
+  std::vector<std::pair<std::string, std::optional<types::TypeList>>> variants_;
 };
 
 class DataClassStmt final : public stmts::Stmt {
@@ -232,4 +240,19 @@ private:
 
 } // namespace whack::codegen::elements
 
+namespace whack::codegen {
+
+static bool isDataClassCtor(const llvm::Module* const module,
+                            const mpc_ast_t* const ast) {
+  return elements::DataClass::isa(ast, module);
+}
+
+static llvm::Expected<llvm::Value*>
+constructDataClass(llvm::IRBuilder<>& builder, const mpc_ast_t* const ctor,
+                   const mpc_ast_t* const args) {
+  return elements::DataClass::construct(builder, ctor, args);
+}
+
+} // end namespace whack::codegen
+
 #endif // WHACK_DATACLASS_HPP
@@ -62,17 +62,19 @@ public:
                    "size to hold the enum values at line {}",
                    name_, state_.row + 1);
     }
+    // options are immediate constants; we only emit globals for them
+    // if the enum is exported (see emitExported)
+    small_vector<llvm::Constant*> values;
     for (size_t i = 0; i < options_.size(); ++i) {
       const auto option = format("{}::{}", name_, options_[i].data());
-      if (module->getNamedGlobal(option)) {
+      if (getEnumOption(*module, option) ||
+          std::count(options_.begin(), options_.begin() + i, options_[i])) {
         return error("enum option `{}` already exists at line {}", option,
                      state_.row + 1);
       }
-      const auto value = Integral::get<llvm::Constant>(i, type);
-      constexpr static auto linkage = llvm::GlobalVariable::ExternalLinkage;
-      module->getGlobalList().push_back(
-          new llvm::GlobalVariable{type, true, linkage, value, option});
+      values.push_back(Integral::get<llvm::Constant>(i, type));
     }
+    addEnumMetadata(module, name_, options_, values);
     // using EnumName = UnderlyingType;
     if (auto err = Alias::add(module, name_, type)) {
       return err;
@@ -82,6 +84,31 @@ public:
 
   inline const auto& name() const { return name_; }
 
+  /// Emits the options of the exported enums of @param module as external
+  /// constants (`Enum::Option`) for code outside Whack
+  static void emitExported(llvm::Module* const module) {
+    const auto exported = getMetadataParts<1>(*module, "exports");
+    for (const auto& name : getMetadataParts<1>(*module, "enums")) {
+      if (std::find(exported.begin(), exported.end(), name) ==
+          exported.end()) {
+        continue;
+      }
+      for (const auto& option : getMetadataParts(*module, "enums", name)) {
+        const auto optionName = format("{}::{}", name.data(), option.data());
+        if (module->getNamedGlobal(optionName)) {
+          continue;
+        }
+        const auto value = getEnumOption(*module, optionName);
+        new llvm::GlobalVariable{*module,
+                                 value->getType(),
+                                 true,
+                                 llvm::GlobalVariable::ExternalLinkage,
+                                 value,
+                                 optionName};
+      }
+    }
+  }
+
 private:
   friend class EnumerationStmt;
   const mpc_state_t state_;
@@ -105,12 +132,8 @@ public:
 
   llvm::Error runScopeExit(llvm::IRBuilder<>& builder) const final {
     const auto module = builder.GetInsertBlock()->getModule();
-    for (const auto& option : impl_.options_) {
-      const auto opt = format("{}::{}", impl_.name_, option.data());
-      if (const auto GV = module->getNamedGlobal(opt)) {
-        GV->setName(".tmp." + GV->getName().str());
-      }
-    }
+    renameMetadataOperand(*module, "enums", impl_.name_,
+                          format(".tmp.{}", impl_.name_));
     Alias::remove(module, impl_.name_);
     return llvm::Error::success();
   }
@@ -18,7 +18,10 @@
 
 #pragma once
 
+#include "../abi.hpp"
+#include "../coroutine.hpp"
 #include "../stmts/stmt.hpp"
+#include "../types/inference.hpp"
 #include "args.hpp"
 #include <folly/ScopeGuard.h>
 #include <llvm/IR/ValueSymbolTable.h>
@@ -68,6 +71,7 @@ static llvm::Function* changeFuncReturnType(llvm::Function* const func,
   newFunc->copyAttributesFrom(func);
   newFunc->getBasicBlockList().splice(newFunc->begin(),
                                       func->getBasicBlockList());
+  types::TypeCache::forget(func);
   func->eraseFromParent();
   return newFunc;
 }
@@ -104,7 +108,7 @@ bindFirstFuncArgument(llvm::IRBuilder<>& builder, llvm::Function* const func,
   if (!firstArgument->getType()->isPointerTy()) {
     // we require a "pointer" type for firstArgument
     const auto alloc =
-        builder.CreateAlloca(firstArgument->getType(), 0, nullptr, "");
+        createAlloca(builder, firstArgument->getType());
     builder.CreateStore(firstArgument, alloc);
     firstArgument = alloc;
   }
@@ -144,12 +148,26 @@ buildFunction(llvm::Function* func, const stmts::Body* const body) {
   const auto entry =
       llvm::BasicBlock::Create(func->getContext(), "entry", func);
   llvm::IRBuilder<> builder{entry};
+  if (auto err = body->handleFunctionTags(builder, func)) {
+    return err;
+  }
+  std::optional<Coroutine> coroutine;
+  if (const auto promiseType = Coroutine::getPromiseType(func)) {
+    coroutine.emplace(builder, promiseType.value());
+  }
   if (auto err = body->codegen(builder)) {
     return err;
   }
   if (auto err = body->runScopeExit(builder)) {
     return err;
   }
+  if (coroutine) {
+    const auto block = builder.GetInsertBlock();
+    if (block->empty() || !block->back().isTerminator()) {
+      coroutine->finish(builder);
+    }
+    coroutine->complete();
+  }
 
   auto deduced = deduceFuncReturnType(func);
   if (!deduced) {
@@ -172,8 +190,7 @@ buildFunction(llvm::Function* func, const stmts::Body* const body) {
     return error("function `{}` returns an invalid type", name);
   }
 
-  if (func->back().empty() ||
-      !llvm::isa<llvm::ReturnInst>(func->back().back())) {
+  if (!func->back().getTerminator()) {
     builder.SetInsertPoint(&func->back());
     if (const auto retTy = func->getReturnType(); retTy != BasicTypes["void"]) {
       warning(noReturnValueErr());
@@ -208,6 +225,7 @@ public:
     }
 
     body_ = std::make_unique<stmts::Body>(ast->children[endIdx]);
+    isGenerator_ = isGenerator(ast->children[endIdx]);
   }
 
   llvm::Error codegen(llvm::Module* const module) const {
@@ -218,16 +236,35 @@ public:
     if (!type) {
       return type.takeError();
     }
-    auto func = llvm::Function::Create(*type, llvm::Function::ExternalLinkage,
-                                       name_, module);
+    llvm::Type* promiseType = nullptr;
+    if (isGenerator_) {
+      // generators return the handle of their coroutine; their return
+      // types are the types they yield
+      promiseType = (*type)->getReturnType();
+      if (promiseType == BasicTypes["auto"]) {
+        return error("generator `{}` must declare the types it yields "
+                     "at line {}",
+                     name_, state_.row + 1);
+      }
+      if (promiseType == BasicTypes["void"]) {
+        promiseType = nullptr;
+      }
+      *type = llvm::FunctionType::get(BasicTypes["char"]->getPointerTo(0),
+                                      (*type)->params(), (*type)->isVarArg());
+    }
+    const auto func = abi::createFunction(module, *type, name_);
+    if (isGenerator_) {
+      Coroutine::setPromiseType(func, promiseType);
+    }
     if (args_) {
       const auto names = args_->names();
       for (size_t i = 0; i < names.size(); ++i) {
-        func->arg_begin()[i].setName(names[i]);
+        abi::getArg(func, i)->setName(names[i]);
       }
-      for (size_t i = 0; i < func->arg_size(); ++i) {
+      for (size_t i = 0; i < (*type)->getNumParams(); ++i) {
         if (!args_->arg(i).mut) {
-          func->addParamAttr(i, llvm::Attribute::ReadOnly);
+          func->addParamAttr(abi::getArg(func, i)->getArgNo(),
+                             llvm::Attribute::ReadOnly);
         }
       }
     }
@@ -245,6 +282,7 @@ private:
   std::unique_ptr<Args> args_;
   std::unique_ptr<types::TypeList> returnTypeList_;
   std::unique_ptr<stmts::Body> body_;
+  bool isGenerator_;
 };
 
 } // end namespace elements
@@ -190,7 +190,7 @@ public:
       return impl.takeError();
     }
     const auto& funcsImpl = *impl;
-    auto interfaceImpl = builder.CreateAlloca(interfaceType, 0, nullptr, "");
+    auto interfaceImpl = createAlloca(builder, interfaceType);
     for (size_t i = 0; i < funcsImpl.size(); ++i) {
       const auto ptr =
           builder.CreateStructGEP(interfaceType, interfaceImpl, i, "");
@@ -60,7 +60,9 @@ public:
     }
   }
 
-  llvm::Error codegen(llvm::Module* const module) const {
+  // the path of the module used (e.g. `a/b/C` for `use a::b::C`), and its
+  // name (`C`)
+  std::pair<std::string, std::string> getModulePath() const {
     using namespace expressions::factors;
     std::string modulePath, moduleName;
     switch (identifier_.index()) {
@@ -89,6 +91,11 @@ public:
     default:
       llvm_unreachable("invalid identifier kind for module use!");
     }
+    return {std::move(modulePath), std::move(moduleName)};
+  }
+
+  llvm::Error codegen(llvm::Module* const module) const {
+    const auto [modulePath, moduleName] = this->getModulePath();
     // Let's help the (yet to be created, qualified) typename resolver
     if (as_) {
       const auto MD = module->getOrInsertNamedMetadata("qualifiers");
@@ -31,7 +31,12 @@ public:
   explicit Structure(const mpc_ast_t* const ast)
       : state_{ast->state}, name_{ast->children[0]->contents} {
     const auto def = ast->children[1];
-    for (auto i = 2; i < def->children_num - 1; ++i) {
+    auto i = 2;
+    if (getInnermostAstTag(def->children[1]) == "tags") {
+      tags_.emplace(def->children[1]);
+      ++i;
+    }
+    for (; i < def->children_num - 1; ++i) {
       const auto ref = def->children[i];
       if (std::string_view(ref->contents) == ";") {
         continue;
@@ -52,9 +57,38 @@ public:
     }
     auto& ctx = module->getContext();
     auto structure = llvm::StructType::create(ctx, name_);
-    small_vector<llvm::Type*> fields;
-    small_vector<llvm::StringRef> fieldNames;
     llvm::IRBuilder<> builder{ctx};
+
+    // struct tags: @align(N), @packed and @reorder
+    uint64_t structAlign = 0;
+    bool packed = false, reorder = false;
+    if (tags_) {
+      for (const auto& tag : tags_->get()) {
+        auto layoutTag = getLayoutTag(builder, tag);
+        if (!layoutTag) {
+          return layoutTag.takeError();
+        }
+        const auto& [name, value] = *layoutTag;
+        if (name == "align" && value) {
+          structAlign = value.value();
+        } else if (name == "packed" && !value) {
+          packed = true;
+        } else if (name == "reorder" && !value) {
+          reorder = true;
+        } else {
+          return error("invalid tag `{}` for struct `{}` at line {}",
+                       name.data(), name_, state_.row + 1);
+        }
+      }
+    }
+
+    struct Field {
+      llvm::StringRef Name;
+      llvm::Type* Type;
+      uint64_t Align; // from @align(N), 0 if natural
+    };
+    small_vector<Field> fields;
+    small_vector<llvm::StringRef> declOrder;
     for (const auto& [tags, decl] : members_) {
       if (!decl.initializers().empty()) {
         warning("member initializers ignored in struct "
@@ -62,18 +96,86 @@ public:
                 "instead to assign values to fields)",
                 name_, state_.row + 1);
       }
-      // @todo Use tags
+      uint64_t fieldAlign = 0;
+      if (tags) {
+        for (const auto& tag : tags->get()) {
+          auto layoutTag = getLayoutTag(builder, tag);
+          if (!layoutTag) {
+            return layoutTag.takeError();
+          }
+          const auto& [name, value] = *layoutTag;
+          if (name != "align" || !value) {
+            return error("invalid tag `{}` for field of struct `{}` "
+                         "at line {}",
+                         name.data(), name_, state_.row + 1);
+          }
+          fieldAlign = value.value();
+        }
+      }
       auto type = decl.type(builder);
       if (!type) {
         return type.takeError();
       }
       for (const auto& var : decl.variables()) {
-        fieldNames.push_back(var);
-        fields.push_back(*type);
+        fields.push_back({var, *type, fieldAlign});
+        declOrder.push_back(var);
+      }
+    }
+
+    const auto alignOf = [&](const Field& field) -> uint64_t {
+      if (packed) { // fields are only as aligned as @align asks
+        return std::max<uint64_t>(field.Align, 1);
+      }
+      return std::max<uint64_t>(getAlignment(module, field.Type), field.Align);
+    };
+    if (reorder) {
+      // we sort by decreasing alignment, leaving no padding between fields
+      std::stable_sort(fields.begin(), fields.end(),
+                       [&](const Field& lhs, const Field& rhs) {
+                         return alignOf(lhs) > alignOf(rhs);
+                       });
+    }
+
+    // we lay out fields, padding explicitly where we over-align
+    const auto& layout = module->getDataLayout();
+    const auto padding = [&](const uint64_t size) {
+      return llvm::ArrayType::get(BasicTypes["char"], size);
+    };
+    small_vector<llvm::Type*> elements;
+    small_vector<llvm::StringRef> elementNames;
+    uint64_t offset = 0, naturalAlign = 1, maxAlign = 1;
+    for (const auto& field : fields) {
+      const uint64_t typeAlign =
+          packed ? 1 : layout.getABITypeAlignment(field.Type);
+      const auto fieldAlign = std::max(alignOf(field), typeAlign);
+      const auto aligned = llvm::alignTo(offset, fieldAlign);
+      if (aligned != llvm::alignTo(offset, typeAlign)) {
+        elements.push_back(padding(aligned - offset));
+        elementNames.push_back(".pad");
       }
+      elements.push_back(field.Type);
+      elementNames.push_back(field.Name);
+      offset = aligned + layout.getTypeAllocSize(field.Type);
+      naturalAlign = std::max(naturalAlign, typeAlign);
+      maxAlign = std::max(maxAlign, fieldAlign);
+    }
+    structAlign = std::max(structAlign, maxAlign);
+    if (structAlign > naturalAlign) {
+      // the size of over-aligned structs is a multiple of their alignment,
+      // e.g. so that array elements do not share cache lines
+      const auto size = llvm::alignTo(offset, structAlign);
+      if (size != llvm::alignTo(offset, naturalAlign)) {
+        elements.push_back(padding(size - offset));
+        elementNames.push_back(".pad");
+      }
+    }
+    addStructTypeMetadata(module, "structures", name_, elementNames);
+    structure->setBody(elements, packed);
+    if (tags_ || elementNames != declOrder) {
+      addStructLayoutMetadata(module, name_,
+                              structAlign > naturalAlign ? structAlign : 0,
+                              declOrder);
     }
-    addStructTypeMetadata(module, "structures", name_, fieldNames);
-    structure->setBody(fields);
     return llvm::Error::success();
   }
 
@@ -83,7 +185,42 @@ private:
   friend class StructureStmt;
   const mpc_state_t state_;
   const std::string name_;
+  std::optional<Tags> tags_;
   std::vector<member_t> members_;
+
+  using layout_tag_t = std::pair<llvm::StringRef, std::optional<uint64_t>>;
+
+  // a layout tag, e.g. @packed or @align(64)
+  llvm::Expected<layout_tag_t> getLayoutTag(llvm::IRBuilder<>& builder,
+                                            const Tags::tag_t& tag) const {
+    const auto& [tagName, args] = tag;
+    if (tagName.index() != 1) {
+      return error("invalid tag for struct `{}` at line {}", name_,
+                   state_.row + 1);
+    }
+    const auto name =
+        std::get<expressions::factors::Ident>(tagName).name();
+    if (!args) {
+      return layout_tag_t{name, std::nullopt};
+    }
+    const auto invalidArgs = [&] {
+      return error("tag `{}` expects a power of 2 for struct `{}` "
+                   "at line {}",
+                   name.data(), name_, state_.row + 1);
+    };
+    if (args->size() != 1) {
+      return invalidArgs();
+    }
+    auto arg = args->front()->codegen(builder);
+    if (!arg) {
+      return arg.takeError();
+    }
+    const auto value = llvm::dyn_cast<llvm::ConstantInt>(*arg);
+    if (!value || !llvm::isPowerOf2_64(value->getZExtValue())) {
+      return invalidArgs();
+    }
+    return layout_tag_t{name, value->getZExtValue()};
+  }
 };
 
 class StructureStmt final : public stmts::Stmt {
@@ -106,6 +243,8 @@ public:
     structure->setName(".tmp." + impl_.name_);
     renameMetadataOperand(*module, "structures", impl_.name_,
                           structure->getName());
+    renameMetadataOperand(*module, "layouts", impl_.name_,
+                          structure->getName());
     return llvm::Error::success();
   }
 
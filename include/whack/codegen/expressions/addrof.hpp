@@ -18,12 +18,15 @@
 
 #pragma once
 
+#include "../types/typecache.hpp"
+
 namespace whack::codegen::expressions {
 
 class AddressOf final : public Expression {
 public:
   explicit AddressOf(const mpc_ast_t* const ast)
-      : state_{ast->state}, variable_{factors::getFactor(ast->children[1])} {}
+      : ast_{ast}, state_{ast->state},
+        variable_{factors::getFactor(ast->children[1])} {}
 
   llvm::Expected<llvm::Value*> codegen(llvm::IRBuilder<>& builder) const final {
     auto var = variable_->codegen(builder);
@@ -31,12 +34,14 @@ public:
       return var.takeError();
     }
     const auto val = *var;
-    const auto ret = builder.CreateAlloca(val->getType(), 0, nullptr, "");
+    const auto ret = createAlloca(builder, val->getType());
     builder.CreateStore(val, ret);
+    types::TypeCache::record(builder, ast_, ret);
     return ret;
   }
 
 private:
+  const mpc_ast_t* const ast_;
   const mpc_state_t state_;
   const std::unique_ptr<factors::Factor> variable_;
 };
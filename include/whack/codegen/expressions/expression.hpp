@@ -58,7 +58,7 @@ static llvm::Expected<llvm::Value*> getLoadedValue(llvm::IRBuilder<>& builder,
   if (hasMetadata(ret, MetadataID)) {
     ret = align(builder.CreateLoad(ret));
   }
-  if (llvm::isa<llvm::AllocaInst>(ret)) {
+  if (isLValue(ret)) {
     ret = align(builder.CreateLoad(ret));
   } else if (llvm::isa<llvm::LoadInst>(ret)) {
     if (hasMetadata(llvm::cast<llvm::LoadInst>(ret)->getPointerOperand(),
@@ -69,6 +69,40 @@ static llvm::Expected<llvm::Value*> getLoadedValue(llvm::IRBuilder<>& builder,
   return ret;
 }
 
+static llvm::Type* getLoadedType(llvm::Value* const value) {
+  if (llvm::isa<factors::Expansion>(value)) {
+    return nullptr;
+  }
+  static constexpr auto MetadataID = llvm::LLVMContext::MD_dereferenceable;
+  auto type = value->getType();
+  if (hasMetadata(value, MetadataID)) {
+    // (a reference: both it and the pointer it holds are loaded)
+    return type->getPointerElementType()->getPointerElementType();
+  }
+  if (isLValue(value)) {
+    return type->getPointerElementType();
+  }
+  if (const auto load = llvm::dyn_cast<llvm::LoadInst>(value)) {
+    if (hasMetadata(load->getPointerOperand(), MetadataID)) {
+      return type->getPointerElementType();
+    }
+  }
+  return type;
+}
+
+static llvm::Value* getAddress(llvm::IRBuilder<>& builder,
+                               llvm::Value* const value) {
+  if (hasMetadata(value, llvm::LLVMContext::MD_dereferenceable)) {
+    const auto address = align(builder.CreateLoad(value));
+    if (!address->getType()->isPointerTy()) {
+      return nullptr;
+    }
+    setIsLValue(address);
+    return address;
+  }
+  return isLValue(value) ? value : nullptr;
+}
+
 static llvm::Expected<small_vector<llvm::Value*>>
 getExprValues(llvm::IRBuilder<>& builder, const small_vector<expr_t>& exprList,
               const bool allowExpansion) {
@@ -30,6 +30,10 @@ public:
     return builder.getInt1(boolean_);
   }
 
+  inline llvm::Type* type(llvm::IRBuilder<>& builder) const final {
+    return builder.getInt1Ty();
+  }
+
   inline static bool classof(const Factor* const factor) {
     return factor->getKind() == kBoolean;
   }
@@ -37,6 +37,10 @@ public:
     return get(character_);
   }
 
+  inline llvm::Type* type(llvm::IRBuilder<>&) const final {
+    return BasicTypes["char"];
+  }
+
   inline static bool classof(const Factor* const factor) {
     return factor->getKind() == kCharacter;
   }
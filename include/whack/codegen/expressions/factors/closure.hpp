@@ -20,6 +20,7 @@
 
 #include "../../elements/args.hpp"
 #include "reference.hpp"
+#include <llvm/ADT/StringSet.h>
 #include <llvm/IR/ValueSymbolTable.h>
 
 namespace whack::codegen::expressions::factors {
@@ -72,6 +73,7 @@ public:
       ++idx;
     }
     body_ = std::make_unique<stmts::Body>(ast->children[idx]);
+    collectNames(ast->children[idx], used_);
   }
 
   llvm::Expected<llvm::Value*> codegen(llvm::IRBuilder<>& builder) const final {
@@ -95,7 +97,19 @@ public:
     small_vector<llvm::Value*> scopedValues;
     small_vector<llvm::StringRef> scopedNames;
 
-    // we inherit any captured variables if enclosing function is a closure
+    // parameters shadow the variables around the closure
+    llvm::StringSet<> params;
+    if (args_) {
+      for (const auto name : args_->names()) {
+        params.insert(name);
+      }
+    }
+    const auto isFree = [&](const llvm::StringRef name) {
+      return used_.count(name) && !params.count(name);
+    };
+
+    // we inherit the captured variables the body uses if the enclosing
+    // function is a closure
     if (enclosingFn->getName().startswith("::closure")) {
       if (!enclosingFn->arg_empty()) {
         const auto enclosingEnv =
@@ -104,28 +118,43 @@ public:
         if (enclosingEnv->getName() == ".env") {
           const auto enclosingEnvType =
               enclosingEnv->getType()->getPointerElementType();
-          scopedNames = getMetadataParts(*module, "structures",
-                                         enclosingEnvType->getStructName());
-          for (size_t i = 0; i < scopedNames.size(); ++i) {
+          const auto names = getMetadataParts(
+              *module, "structures", enclosingEnvType->getStructName());
+          for (size_t i = 0; i < names.size(); ++i) {
+            if (!isFree(names[i])) {
+              continue;
+            }
             const auto ptr =
                 builder.CreateStructGEP(enclosingEnvType, enclosingEnv, i, "");
             const auto val = builder.CreateLoad(ptr);
             scopedValues.push_back(val);
             scopedTypes.push_back(val->getType());
+            scopedNames.push_back(names[i]);
           }
         }
       }
     }
 
+    // default captures are of the variables the body uses
     if (defaultCaptureMode_ != None) {
       const auto byRef = defaultCaptureMode_ == AllByReference;
+      const auto& dataLayout = module->getDataLayout();
       for (const auto& symbol : *enclosingFn->getValueSymbolTable()) {
         const auto val = symbol.getValue();
+        const auto name = val->getName();
         if (!val->getType()->isSized() ||
-            val->getName().find('.') != llvm::StringRef::npos) {
+            name.find('.') != llvm::StringRef::npos || !isFree(name) ||
+            explicitCaptures_.count(name)) {
           continue;
         }
-        const auto value = byRef ? Reference::get(builder, val) : val;
+        // values which are not stack slots cannot change, so we copy them
+        // rather than refer to a copy when they are no bigger than a pointer
+        const auto readOnly =
+            !llvm::isa<llvm::AllocaInst>(val) &&
+            dataLayout.getTypeAllocSize(val->getType()) <=
+                dataLayout.getPointerSize();
+        const auto value =
+            byRef && !readOnly ? Reference::get(builder, val) : val;
         scopedValues.push_back(value);
         scopedTypes.push_back(value->getType());
         scopedNames.push_back(val->getName());
@@ -213,7 +242,7 @@ public:
     }
 
     const auto env = argTypes.front()->getPointerElementType();
-    const auto scopeVars = builder.CreateAlloca(env, 0, nullptr, "");
+    const auto scopeVars = createAlloca(builder, env);
     for (size_t i = 0; i < scopedValues.size(); ++i) {
       const auto ptr = builder.CreateStructGEP(env, scopeVars, i, "");
       builder.CreateStore(scopedValues[i], ptr);
@@ -235,6 +264,21 @@ private:
   DefaultCaptureMode defaultCaptureMode_{None};
   std::unique_ptr<types::TypeList> returns_;
   std::unique_ptr<stmts::Body> body_;
+  // the identifiers the body mentions (a superset of its free variables)
+  llvm::StringSet<> used_;
+
+  static void collectNames(const mpc_ast_t* const ast,
+                           llvm::StringSet<>& names) {
+    if (!ast->children_num) {
+      if (getInnermostAstTag(ast) == "ident") {
+        names.insert(ast->contents);
+      }
+      return;
+    }
+    for (auto i = 0; i < ast->children_num; ++i) {
+      collectNames(ast->children[i], names);
+    }
+  }
 };
 
 } // end namespace whack::codegen::expressions::factors
@@ -21,36 +21,58 @@
 #include "element.hpp"
 #include "expandop.hpp"
 #include "funccall.hpp"
+#include "ident.hpp"
 #include "postop.hpp"
 #include "structmember.hpp"
+#include "vectormember.hpp"
 
 namespace whack::codegen::expressions::factors {
 
 class CompositeFactor : public Factor {
 public:
   explicit CompositeFactor(const mpc_ast_t* const ast)
-      : Factor(kComposite), base_{getFactor(ast->children[0])},
-        composite_{ast->children[1]} {}
+      : Factor(kComposite), baseAst_{ast->children[0]},
+        base_{getFactor(ast->children[0])}, composite_{ast->children[1]} {}
 
   llvm::Expected<llvm::Value*> codegen(llvm::IRBuilder<>& builder) const final {
     using ret_t = llvm::Expected<llvm::Value*>;
+    using args_t = std::pair<small_vector<llvm::Value*>, const mpc_ast_t*>;
+    // the arguments of call @param composite and what follows the call
+    const auto callArguments =
+        [&builder](const mpc_ast_t* const composite) -> llvm::Expected<args_t> {
+      small_vector<llvm::Value*> arguments;
+      const mpc_ast_t* next = nullptr;
+      if (composite->children_num > 2 &&
+          getOutermostAstTag(composite->children[1]) == "exprlist") {
+        const auto exprList = getExprList(composite->children[1]);
+        auto args = getExprValues(builder, exprList, true);
+        if (!args) {
+          return args.takeError();
+        }
+        arguments = std::move(*args);
+        if (composite->children_num > 3) {
+          next = composite->children[3];
+        }
+      } else {
+        if (composite->children_num > 2) {
+          next = composite->children[2];
+        }
+      }
+      return args_t{std::move(arguments), next};
+    };
     std::function<ret_t(llvm::Value* const, const mpc_ast_t* const)>
         aggregateMember;
-    aggregateMember = [&builder, &aggregateMember](
+    aggregateMember = [&builder, &aggregateMember, &callArguments](
                           llvm::Value* base,
                           const mpc_ast_t* const composite) -> ret_t {
       if (!composite->children_num) {
         const std::string_view hint{composite->contents};
         if (hint == "..") {
-          // @todo Range iteration
-          return error("range iteration not implemented");
+          return error("open ranges can only be iterated over "
+                       "in for-in loops");
         }
         if (hint == "++" || hint == "--") {
-          auto var = getLoadedValue(builder, base, false);
-          if (!var) {
-            return var.takeError();
-          }
-          return PostOp::get(builder, *var, composite->contents);
+          return PostOp::get(builder, base, composite->contents);
         }
         if (hint == "&") {
           return Reference::get(builder, base);
@@ -60,45 +82,85 @@ public:
       }
       const std::string_view hint{composite->children[0]->contents};
       if (hint == "..") {
-        // @todo Range
-        return error("ranges not implemented");
+        return error("ranges can only be iterated over in for-in loops "
+                     "or matched against");
       }
       if (hasMetadata(base, llvm::LLVMContext::MD_dereferenceable)) {
-        base = builder.CreateLoad(base);
+        if (const auto address = getAddress(builder, base)) {
+          base = address;
+        }
       }
       if (hint == "(") {
-        if (llvm::isa<llvm::AllocaInst>(base)) {
-          base = builder.CreateLoad(base);
+        if (isLValue(base)) {
+          base = align(builder.CreateLoad(base));
         }
         const small_vector<llvm::Value*> funcs{base};
-        small_vector<llvm::Value*> arguments;
-        const mpc_ast_t* next = nullptr;
-        if (composite->children_num > 2 &&
-            getOutermostAstTag(composite->children[1]) == "exprlist") {
-          const auto exprList = getExprList(composite->children[1]);
-          auto args = getExprValues(builder, exprList, true);
+        auto args = callArguments(composite);
+        if (!args) {
+          return args.takeError();
+        }
+        const auto& [arguments, next] = *args;
+        auto call = FuncCall::get(builder, funcs, arguments);
+        if (!call) {
+          return call.takeError();
+        }
+        if (next != nullptr) {
+          // we continue on the returned rvalue
+          return aggregateMember(*call, next);
+        }
+        return *call;
+      }
+      if (hint == "." && Arena::isa(base)) {
+        const auto next =
+            composite->children_num > 2 ? composite->children[2] : nullptr;
+        if (!next || !next->children_num ||
+            std::string_view(next->children[0]->contents) != "(") {
+          return error("arenas have no fields at line {}",
+                       composite->children[1]->state.row + 1);
+        }
+        auto args = callArguments(next);
+        if (!args) {
+          return args.takeError();
+        }
+        const auto& [arguments, rest] = *args;
+        auto call = Arena::call(builder, base, composite->children[1],
+                                arguments);
+        if (!call) {
+          return call.takeError();
+        }
+        if (rest != nullptr) {
+          return aggregateMember(*call, rest);
+        }
+        return *call;
+      }
+      if (hint == "." && VectorMember::isa(base)) {
+        const auto member = composite->children[1];
+        const auto next =
+            composite->children_num > 2 ? composite->children[2] : nullptr;
+        if (next && next->children_num &&
+            std::string_view(next->children[0]->contents) == "(") {
+          auto args = callArguments(next);
           if (!args) {
             return args.takeError();
           }
-          arguments = std::move(*args);
-          if (composite->children_num > 3) {
-            next = composite->children[3];
+          const auto& [arguments, rest] = *args;
+          auto call = VectorMember::call(builder, base, member, arguments);
+          if (!call) {
+            return call.takeError();
           }
-        } else {
-          if (composite->children_num > 2) {
-            next = composite->children[2];
+          if (rest != nullptr) {
+            return aggregateMember(*call, rest);
           }
+          return *call;
         }
-        auto call = FuncCall::get(builder, funcs, arguments);
-        if (!call) {
-          return call.takeError();
+        auto lanes = VectorMember::get(builder, base, member);
+        if (!lanes) {
+          return lanes.takeError();
         }
         if (next != nullptr) {
-          auto cont = builder.CreateAlloca((*call)->getType(), 0, nullptr, "");
-          builder.CreateStore(*call, cont);
-          return aggregateMember(cont, next);
+          return aggregateMember(*lanes, next);
         }
-        return *call;
+        return *lanes;
       }
       if (hint == ".") {
         auto mem = StructMember::get(builder, base, composite->children[1]);
@@ -119,11 +181,7 @@ public:
       if (!index) {
         return index.takeError();
       }
-      auto cont = getLoadedValue(builder, base, false);
-      if (!cont) {
-        return cont.takeError();
-      }
-      auto elt = Element::get(builder, *cont, *index);
+      auto elt = Element::get(builder, base, *index);
       if (!elt) {
         return elt.takeError();
       }
@@ -132,6 +190,14 @@ public:
       }
       return *elt;
     };
+    if (isDataClassConstruction(builder)) {
+      const auto args = composite_->children_num > 2 &&
+                                getOutermostAstTag(composite_->children[1]) ==
+                                    "exprlist"
+                            ? composite_->children[1]
+                            : nullptr;
+      return constructDataClass(builder, baseAst_, args);
+    }
     auto base = base_->codegen(builder);
     if (!base) {
       return base.takeError();
@@ -139,11 +205,93 @@ public:
     return aggregateMember(*base, composite_);
   }
 
+  // the types of fields and of the results of calls (unless partially
+  // applied) follow from the type of what they are on
+  llvm::Type* type(llvm::IRBuilder<>& builder) const final {
+    const auto block = builder.GetInsertBlock();
+    if (!block || isDataClassConstruction(builder)) {
+      return nullptr;
+    }
+    const auto module = block->getModule();
+    auto type = base_->type(builder);
+    // functions called directly return through their ABI (see emitCall)
+    llvm::Function* callee = nullptr;
+    if (const auto ident = llvm::dyn_cast<Ident>(base_.get())) {
+      callee = ident->function(builder);
+    }
+    for (auto composite = composite_; type && composite;) {
+      if (!composite->children_num) {
+        return nullptr; // postfix operators
+      }
+      const std::string_view hint{composite->children[0]->contents};
+      if (hint == "(") {
+        const auto hasArgs =
+            composite->children_num > 2 &&
+            getOutermostAstTag(composite->children[1]) == "exprlist";
+        if (hasArgs) {
+          const auto args = composite->children[1];
+          const auto last = args->children_num
+                                ? args->children[args->children_num - 1]
+                                : args;
+          if (getInnermostAstTag(last) == "string" &&
+              std::string_view(last->contents) == "...") {
+            return nullptr;
+          }
+        }
+        if (callee) {
+          type = callee->getMetadata("abi") && callee->hasStructRetAttr()
+                     ? abi::getSourceType(callee)->getReturnType()
+                     : callee->getReturnType();
+        } else if (type->isPointerTy() &&
+                   type->getPointerElementType()->isFunctionTy()) {
+          type = llvm::cast<llvm::FunctionType>(type->getPointerElementType())
+                     ->getReturnType();
+        } else {
+          return nullptr;
+        }
+        callee = nullptr;
+        const auto next = hasArgs ? 3 : 2;
+        composite = composite->children_num > next ? composite->children[next]
+                                                   : nullptr;
+        continue;
+      }
+      const auto member = composite->children[1];
+      if (hint != "." || getInnermostAstTag(member) == "structopname") {
+        return nullptr; // elements, ranges and struct operators
+      }
+      const auto structure = llvm::dyn_cast<llvm::StructType>(
+          type->isPointerTy() ? type->getPointerElementType() : type);
+      if (!structure || !structure->hasName() ||
+          structure->getName() == "arena") {
+        return nullptr;
+      }
+      const auto idx = StructMember::getIndex(*module, structure->getName(),
+                                              member->contents);
+      if (!idx) {
+        return nullptr; // member functions
+      }
+      type = structure->getElementType(idx.value());
+      composite =
+          composite->children_num > 2 ? composite->children[2] : nullptr;
+    }
+    return type;
+  }
+
   inline static constexpr bool classof(const Factor* const factor) {
     return factor->getKind() == kComposite;
   }
 
 private:
+  bool isDataClassConstruction(const llvm::IRBuilder<>& builder) const {
+    if (getInnermostAstTag(baseAst_) != "scoperes" ||
+        !composite_->children_num ||
+        std::string_view(composite_->children[0]->contents) != "(") {
+      return false;
+    }
+    return isDataClassCtor(builder.GetInsertBlock()->getModule(), baseAst_);
+  }
+
+  const mpc_ast_t* const baseAst_;
   const std::unique_ptr<Factor> base_;
   const mpc_ast_t* const composite_;
 };
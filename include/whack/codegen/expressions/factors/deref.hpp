@@ -30,17 +30,29 @@ public:
     if (!ptr) {
       return ptr.takeError();
     }
-    auto ret = *ptr;
-    const auto type = ret->getType();
-    if (!type->isPointerTy()) {
+    auto pointer = getLoadedValue(builder, *ptr);
+    if (!pointer) {
+      return pointer.takeError();
+    }
+    const auto ret = *pointer;
+    if (!ret->getType()->isPointerTy()) {
       return error("type error: cannot dereference a "
                    "non-pointer type at line {}",
                    state_.row + 1);
     }
-    if (llvm::isa<llvm::AllocaInst>(ret)) {
-      ret = builder.CreateLoad(ret);
+    // the pointee is an lvalue; users load it only where they need its value
+    if (const auto inst = llvm::dyn_cast<llvm::Instruction>(ret);
+        inst && !isLValue(inst) && inst->use_empty()) {
+      setIsLValue(inst);
+      return ret;
     }
-    return builder.CreateLoad(ret);
+    const auto lvalue =
+        builder.Insert(llvm::GetElementPtrInst::CreateInBounds(
+                           ret->getType()->getPointerElementType(), ret,
+                           {builder.getInt32(0)}),
+                       "");
+    setIsLValue(lvalue);
+    return lvalue;
   }
 
   inline static bool classof(const Factor* const factor) {
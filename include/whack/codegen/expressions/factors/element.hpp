@@ -24,30 +24,47 @@ class Element {
 public:
   static llvm::Expected<llvm::Value*>
   get(llvm::IRBuilder<>& builder, llvm::Value* cont, llvm::Value* const idx) {
-    const auto type = cont->getType();
-    // @todo
-    if (const auto load = llvm::dyn_cast<llvm::LoadInst>(cont)) {
-      if (const auto alloc =
-              llvm::dyn_cast<llvm::AllocaInst>(load->getPointerOperand())) {
-        if (alloc->getType()->getPointerElementType()->isArrayTy()) {
-          cont = alloc;
-        }
+    if (const auto address = getAddress(builder, cont)) {
+      const auto type = address->getType()->getPointerElementType();
+      if (type->isArrayTy() || type->isVectorTy()) {
+        // we index aggregates in place
+        return getElementPtr(builder, type, address, {Integral::get(0), idx});
       }
+      cont = align(builder.CreateLoad(address));
+    }
+    const auto type = cont->getType();
+    if (type->isPointerTy()) {
+      return getElementPtr(builder, type->getPointerElementType(), cont, {idx});
     }
-    if (!(type->isAggregateType() || type->isPointerTy())) {
-      return error("expected an aggregate type to extract element");
+    if (type->isVectorTy()) {
+      return builder.CreateExtractElement(cont, idx);
     }
-    llvm::Value* elt;
     if (type->isArrayTy()) {
-      elt = builder.CreateInBoundsGEP(cont, {Integral::get(0), idx});
-    } else {
-      elt = builder.CreateGEP(cont, idx);
+      if (const auto index = llvm::dyn_cast<llvm::ConstantInt>(idx)) {
+        return builder.CreateExtractValue(cont, index->getZExtValue());
+      }
+      // dynamic indices need the array in memory
+      const auto tmp = createAlloca(builder, type);
+      align(builder.CreateStore(cont, tmp));
+      return getElementPtr(builder, type, tmp, {Integral::get(0), idx});
+    }
+    return error("expected an aggregate type to extract element");
+  }
+
+private:
+  static llvm::Value* getElementPtr(llvm::IRBuilder<>& builder,
+                                    llvm::Type* const type,
+                                    llvm::Value* const ptr,
+                                    llvm::ArrayRef<llvm::Value*> indices) {
+    // we insert the GEP as is (never constant-folded) so that it
+    // can carry the lvalue tag
+    const auto gep = builder.Insert(
+        llvm::GetElementPtrInst::Create(type, ptr, indices), "");
+    if (type->isArrayTy() || type->isVectorTy()) {
+      llvm::cast<llvm::GetElementPtrInst>(gep)->setIsInBounds(true);
     }
-    const auto ret =
-        align(builder.CreateAlloca(elt->getType(), 0, nullptr, ""));
-    align(builder.CreateStore(elt, ret));
-    setIsDereferenceable(builder.getContext(), ret);
-    return ret;
+    setIsLValue(gep);
+    return gep;
   }
 };
 
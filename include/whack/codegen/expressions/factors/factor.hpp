@@ -62,6 +62,10 @@ public:
     return factor_->codegen(builder);
   }
 
+  inline llvm::Type* type(llvm::IRBuilder<>& builder) const final {
+    return factor_->type(builder);
+  }
+
   inline static bool classof(const Factor* const factor) {
     return factor->getKind() == kExpression;
   }
@@ -29,6 +29,10 @@ public:
     return llvm::ConstantFP::get(BasicTypes["double"], floatingpt_);
   }
 
+  inline llvm::Type* type(llvm::IRBuilder<>&) const final {
+    return BasicTypes["double"];
+  }
+
   inline static bool classof(const Factor* const factor) {
     return factor->getKind() == kFloatingPt;
   }
@@ -19,6 +19,7 @@
 #pragma once
 
 #include "../../elements/dataclass.hpp"
+#include "../../abi.hpp"
 #include "../../elements/interface.hpp"
 #include "expansion.hpp"
 #include <llvm/IR/ValueSymbolTable.h>
@@ -48,14 +49,18 @@ public:
             return apply.takeError();
           }
         } else {
-          value = builder.CreateCall(func, arguments);
+          value = abi::emitCall(builder, func, arguments);
         }
       } else {
-        arguments = {value};
+        auto arg = getLoadedValue(builder, value);
+        if (!arg) {
+          return arg.takeError();
+        }
+        arguments = {*arg};
         if (auto err = checkTransformArgs(builder, func, arguments)) {
           return err;
         }
-        value = builder.CreateCall(func, arguments);
+        value = abi::emitCall(builder, func, arguments);
       }
     }
     return value;
@@ -66,8 +71,11 @@ private:
                                         llvm::Value* const value,
                                         small_vector<llvm::Value*>& args) {
     const auto valueName = value->getName().data();
-    auto type = value->getType();
-    if (type->isPointerTy() && type->getPointerElementType()->isFunctionTy()) {
+    llvm::Type* type = value->getType();
+    if (const auto func = llvm::dyn_cast<llvm::Function>(value)) {
+      type = abi::getSourceType(func);
+    } else if (type->isPointerTy() &&
+               type->getPointerElementType()->isFunctionTy()) {
       type = type->getPointerElementType();
     } else {
       return error("expected `{}` to be callable", valueName);
@@ -151,10 +159,11 @@ private:
     const auto numElems = type->getNumElements();
     const auto func = llvm::cast<llvm::Function>(fun);
     const auto funcName = func->getName().data();
-    if (numElems != func->arg_size()) {
+    const auto numParams = abi::getSourceType(func)->getNumParams();
+    if (numElems != numParams) {
       return error("invalid number of named arguments for function `{}` "
                    "(expected {}, got {})",
-                   funcName, func->arg_size(), numElems);
+                   funcName, numParams, numElems);
     }
     const auto& module = *builder.GetInsertBlock()->getModule();
     const auto members =
@@ -164,8 +173,8 @@ private:
         llvm::cast<llvm::LoadInst>(arguments[0])->getPointerOperand();
     for (size_t i = 0; i < numElems; ++i) {
       bool found = false;
-      for (size_t j = 0; j < func->arg_size(); ++j) {
-        if (members[i] == func->arg_begin()[j].getName()) {
+      for (size_t j = 0; j < numParams; ++j) {
+        if (members[i] == abi::getArg(func, j)->getName()) {
           const auto ptr = builder.CreateStructGEP(type, obj, i, "");
           reorderedArgs[j] = builder.CreateLoad(ptr);
           found = true;
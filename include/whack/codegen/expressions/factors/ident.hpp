@@ -20,6 +20,7 @@
 
 #include "../../fwd.hpp"
 #include "../../metadata.hpp"
+#include "../../scope.hpp"
 #include "structmember.hpp"
 #include <llvm/IR/ValueSymbolTable.h>
 #include <llvm/Support/Error.h>
@@ -73,6 +74,37 @@ public:
                  name_.data(), state_.row + 1);
   }
 
+  llvm::Type* type(llvm::IRBuilder<>& builder) const final {
+    const auto block = builder.GetInsertBlock();
+    if (!block) {
+      return nullptr;
+    }
+    const auto func = block->getParent();
+    if (const auto var = func->getValueSymbolTable()->lookup(name_)) {
+      return getLoadedType(var);
+    }
+    if (const auto captured = getCapturedType(func)) {
+      return captured;
+    }
+    if (const auto callee = func->getParent()->getFunction(name_)) {
+      return callee->getType();
+    }
+    return nullptr;
+  }
+
+  // the free function the identifier names, unless a variable hides it
+  llvm::Function* function(const llvm::IRBuilder<>& builder) const {
+    const auto block = builder.GetInsertBlock();
+    if (!block) {
+      return nullptr;
+    }
+    const auto func = block->getParent();
+    if (func->getValueSymbolTable()->lookup(name_) || getCapturedType(func)) {
+      return nullptr;
+    }
+    return func->getParent()->getFunction(name_);
+  }
+
   inline const auto& name() const { return name_; }
 
   static llvm::Error isUnique(const llvm::Module* const module,
@@ -126,6 +158,18 @@ public:
   }
 
 private:
+  // the type of the variable closure @param func captured by our name
+  llvm::Type* getCapturedType(const llvm::Function* const func) const {
+    if (!func->getName().startswith("::closure")) {
+      return nullptr;
+    }
+    const auto env = func->getValueSymbolTable()->lookup(".env");
+    const auto structure = env->getType()->getPointerElementType();
+    const auto idx = StructMember::getIndex(
+        *func->getParent(), structure->getStructName(), name_);
+    return idx ? structure->getStructElementType(idx.value()) : nullptr;
+  }
+
   const mpc_state_t state_;
   const std::string name_;
 };
@@ -18,6 +18,9 @@
 
 #pragma once
 
+#include "../../aggregate.hpp"
+#include "../../constants.hpp"
+
 namespace whack::codegen::expressions::factors {
 
 class InitList final : public Factor {
@@ -69,21 +72,48 @@ public:
     }
 
     // Member-wise struct init
-    if (!homogenous) {
+    if (!homogenous || (type->isStructTy() && (list.size() > 1 ||
+                                                list[0]->getType() != type))) {
       if (!type->isStructTy()) {
         return error("expected a struct type at line {}", state_.row + 1);
       }
-      auto ptr = builder.CreateAlloca(type, 0, nullptr, "");
+      // positions follow declaration order (see struct layout tags)
+      auto indices = getFieldIndices(builder, type);
+      if (!indices) {
+        return indices.takeError();
+      }
+      if (list.size() > indices->size()) {
+        return error("too many values in initializer list at line {}",
+                     state_.row + 1);
+      }
       for (size_t i = 0; i < list.size(); ++i) {
-        if (type->getStructElementType(i) != list[i]->getType()) {
+        if (type->getStructElementType((*indices)[i]) != list[i]->getType()) {
           return error("element {} in initializer list does "
                        "not match corresponding struct element type "
                        "at line {}",
                        i, state_.row + 1);
         }
-        builder.CreateStore(list[i], builder.CreateStructGEP(type, ptr, i, ""));
       }
-      return builder.CreateLoad(ptr);
+      if (isConstant(list)) { // fields left out are zeroed
+        small_vector<llvm::Constant*> fields;
+        for (const auto field : type->subtypes()) {
+          fields.push_back(llvm::Constant::getNullValue(field));
+        }
+        for (size_t i = 0; i < list.size(); ++i) {
+          fields[(*indices)[i]] = llvm::cast<llvm::Constant>(list[i]);
+        }
+        return ConstantPool::materialize(
+            builder,
+            llvm::ConstantStruct::get(llvm::cast<llvm::StructType>(type),
+                                      fields));
+      }
+      const auto ptr = createAlloca(builder, type);
+      for (size_t i = 0; i < list.size(); ++i) {
+        aggregate::emitStore(
+            builder, list[i],
+            builder.CreateStructGEP(type, ptr, (*indices)[i], ""));
+      }
+      return aggregate::getResult(builder, ptr);
     }
 
     // Fixed-length array
@@ -101,13 +131,56 @@ public:
                      "got {} at line {}",
                      len, numElem, state_.row + 1);
       }
-      const auto ptr = builder.CreateAlloca(type, 0, nullptr, "");
+      if (isConstant(list)) {
+        small_vector<llvm::Constant*> elements;
+        for (const auto value : list) {
+          elements.push_back(llvm::cast<llvm::Constant>(value));
+        }
+        return ConstantPool::materialize(
+            builder,
+            llvm::ConstantArray::get(llvm::cast<llvm::ArrayType>(type),
+                                     elements));
+      }
+      const auto ptr = createAlloca(builder, type);
       for (size_t i = 0; i < list.size(); ++i) {
         const auto idxPtr = builder.CreateInBoundsGEP(
             ptr, {Integral::get(0), Integral::get(i)});
-        builder.CreateStore(list[i], idxPtr);
+        aggregate::emitStore(builder, list[i], idxPtr);
+      }
+      return aggregate::getResult(builder, ptr);
+    }
+
+    // SIMD vector; a single value is broadcast to every lane
+    if (type->isVectorTy()) {
+      const auto numLanes = type->getVectorNumElements();
+      if (list.size() != 1 && list.size() != numLanes) {
+        return error("type mismatch: expected {} vector lanes, "
+                     "got {} at line {}",
+                     numLanes, list.size(), state_.row + 1);
+      }
+      small_vector<llvm::Value*> lanes;
+      for (const auto value : list) {
+        auto v = getLoadedValue(builder, value);
+        if (!v) {
+          return v.takeError();
+        }
+        const auto lane = types::VectorType::getLane(
+            builder, *v, type->getVectorElementType());
+        if (!lane) {
+          return error("type mismatch: cannot initialize vector lane "
+                       "with the given value at line {}",
+                       state_.row + 1);
+        }
+        lanes.push_back(lane);
       }
-      return builder.CreateLoad(ptr);
+      if (lanes.size() == 1) {
+        return builder.CreateVectorSplat(numLanes, lanes[0]);
+      }
+      llvm::Value* vector = llvm::UndefValue::get(type);
+      for (unsigned i = 0; i < numLanes; ++i) {
+        vector = builder.CreateInsertElement(vector, lanes[i], i);
+      }
+      return vector;
     }
 
     // Scalar init
@@ -133,6 +206,40 @@ private:
   const mpc_state_t state_;
   small_vector<expr_t> values_;
 
+  // the element index of each field of @param type in declaration order
+  static llvm::Expected<small_vector<unsigned>>
+  getFieldIndices(llvm::IRBuilder<>& builder, llvm::Type* const type) {
+    small_vector<unsigned> indices;
+    const auto structType = llvm::cast<llvm::StructType>(type);
+    const auto& module = *builder.GetInsertBlock()->getModule();
+    const auto decls = structType->hasName()
+                           ? getStructDeclOrder(module, structType->getName())
+                           : small_vector<llvm::StringRef>{};
+    if (decls.empty()) {
+      for (unsigned i = 0; i < structType->getNumElements(); ++i) {
+        indices.push_back(i);
+      }
+      return indices;
+    }
+    for (const auto& decl : decls) {
+      const auto idx = StructMember::getIndex(module, type->getStructName(),
+                                              decl);
+      if (!idx) {
+        return error("field `{}` does not exist for struct `{}`",
+                     decl.data(), type->getStructName().data());
+      }
+      indices.push_back(idx.value());
+    }
+    return indices;
+  }
+
+  // whether every value in @param list is known at compile time
+  static bool isConstant(llvm::ArrayRef<llvm::Value*> list) {
+    return llvm::all_of(list, [](const auto value) {
+      return llvm::isa<llvm::Constant>(value);
+    });
+  }
+
   using list_t = std::pair<small_vector<llvm::Value*>, bool>;
   llvm::Expected<list_t> getList(llvm::IRBuilder<>& builder) const {
     small_vector<llvm::Value*> values;
@@ -144,7 +251,11 @@ private:
       if (!val) {
         return val.takeError();
       }
-      const auto value = *val;
+      auto v = getLoadedValue(builder, *val);
+      if (!v) {
+        return v.takeError();
+      }
+      const auto value = *v;
       if (i == 0) {
         referenceType = value->getType();
       } else if (value->getType() != referenceType) {
@@ -36,6 +36,10 @@ public:
     return get(integral_);
   }
 
+  inline llvm::Type* type(llvm::IRBuilder<>&) const final {
+    return BasicTypes["int"];
+  }
+
   inline const auto value() const noexcept { return integral_; }
 
   inline static bool classof(const Factor* const factor) {
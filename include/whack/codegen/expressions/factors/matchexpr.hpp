@@ -18,16 +18,7 @@
 
 #pragma once
 
-namespace whack::codegen::expressions {
-
-namespace operators {
-static llvm::Expected<llvm::Value*> getEquality(llvm::IRBuilder<>&,
-                                                llvm::Value* const,
-                                                const llvm::StringRef,
-                                                llvm::Value* const);
-} // end namespace operators
-
-namespace factors {
+namespace whack::codegen::expressions::factors {
 
 class MatchExpr final : public Factor {
 public:
@@ -40,54 +31,73 @@ public:
       return info.takeError();
     }
     const auto& matchInfo = *info;
-    const auto equals =
-        [&](const auto& options) -> llvm::Expected<llvm::Value*> {
-      llvm::Value* ret = builder.getFalse();
-      for (size_t i = 0; i < options.size(); ++i) {
-        auto cmp = operators::getEquality(builder, matchInfo.Subject,
-                                          "==", options[i]);
-        if (!cmp) {
-          return cmp.takeError();
-        }
-        ret = builder.CreateOr(ret, *cmp);
+    const auto func = builder.GetInsertBlock()->getParent();
+    auto& ctx = func->getContext();
+    small_vector<llvm::BasicBlock*> arms;
+    for (size_t i = 0; i < matchInfo.Options.size(); ++i) {
+      arms.push_back(llvm::BasicBlock::Create(ctx, "case", func));
+    }
+    const auto defaultBlock = llvm::BasicBlock::Create(ctx, "default", func);
+    const auto contBlock = llvm::BasicBlock::Create(ctx, "cont", func);
+    if (auto err = emitMatchDispatch(builder, matchInfo, arms, defaultBlock)) {
+      return err;
+    }
+
+    small_vector<std::pair<llvm::Value*, llvm::BasicBlock*>> incoming;
+    const auto emitArm = [&](const auto& expr) -> llvm::Error {
+      auto val = std::get<1>(expr)->codegen(builder);
+      if (!val) {
+        return val.takeError();
+      }
+      auto value = getLoadedValue(builder, *val);
+      if (!value) {
+        return value.takeError();
       }
-      return ret;
+      if (!incoming.empty() &&
+          incoming.front().first->getType() != (*value)->getType()) {
+        return error("type mismatch: match expression options must "
+                     "have the same type at line {}",
+                     ast_->state.row + 1);
+      }
+      incoming.emplace_back(*value, builder.GetInsertBlock());
+      builder.CreateBr(contBlock);
+      return llvm::Error::success();
     };
 
-    const auto& last = matchInfo.Options.back();
-    auto lastCond = equals(last.first);
-    if (!lastCond) {
-      return lastCond.takeError();
+    for (size_t i = 0; i < arms.size(); ++i) {
+      const auto& [patterns, expr] = matchInfo.Options[i];
+      builder.SetInsertPoint(arms[i]);
+      auto bindings = bindMatchPayload(builder, matchInfo, patterns);
+      if (!bindings) {
+        return bindings.takeError();
+      }
+      if (auto err = emitArm(expr)) {
+        return err;
+      }
+      unbindMatchPayload(*bindings);
     }
-    llvm::Value* defaultVal;
+
+    defaultBlock->moveAfter(builder.GetInsertBlock());
+    builder.SetInsertPoint(defaultBlock);
     if (matchInfo.Default) {
-      auto val = std::get<1>(matchInfo.Default.value())->codegen(builder);
-      if (!val) {
-        return val.takeError();
+      if (auto err = emitArm(matchInfo.Default.value())) {
+        return err;
       }
-      defaultVal = *val;
     } else {
-      defaultVal = llvm::Constant::getNullValue(matchInfo.Subject->getType());
-    }
-    auto lastVal = std::get<1>(last.second)->codegen(builder);
-    if (!lastVal) {
-      return lastVal.takeError();
+      const auto type = incoming.empty() ? matchInfo.Subject->getType()
+                                         : incoming.front().first->getType();
+      incoming.emplace_back(llvm::Constant::getNullValue(type), defaultBlock);
+      builder.CreateBr(contBlock);
     }
 
-    auto select = builder.CreateSelect(*lastCond, *lastVal, defaultVal);
-    for (size_t i = matchInfo.Options.size() - 1; i >= 1; --i) {
-      const auto& opt = matchInfo.Options[i - 1];
-      auto cmp = equals(opt.first);
-      if (!cmp) {
-        return cmp.takeError();
-      }
-      auto val = std::get<1>(opt.second)->codegen(builder);
-      if (!val) {
-        return val.takeError();
-      }
-      select = builder.CreateSelect(*cmp, *val, select);
+    contBlock->moveAfter(builder.GetInsertBlock());
+    builder.SetInsertPoint(contBlock);
+    const auto phi = builder.CreatePHI(incoming.front().first->getType(),
+                                       incoming.size());
+    for (const auto& [value, block] : incoming) {
+      phi->addIncoming(value, block);
     }
-    return select;
+    return phi;
   }
 
   inline static bool classof(const Factor* const factor) {
@@ -98,7 +108,6 @@ private:
   const mpc_ast_t* const ast_;
 };
 
-} // end namespace factors
-} // namespace whack::codegen::expressions
+} // end namespace whack::codegen::expressions::factors
 
 #endif // WHACK_MATCHEXPR_HPP
@@ -59,7 +59,7 @@ public:
     }
     const auto type = llvm::StructType::create(builder.getContext(), types,
                                                "::memberinitlist", true);
-    const auto ret = builder.CreateAlloca(type, 0, nullptr, type->getName());
+    const auto ret = createAlloca(builder, type, type->getName());
     for (size_t i = 0; i < values.size(); ++i) {
       const auto ptr = builder.CreateStructGEP(type, ret, i, "");
       builder.CreateStore(values[i], ptr);
@@ -78,7 +78,7 @@ public:
     }
     const auto module = builder.GetInsertBlock()->getParent()->getParent();
     const auto structName = type->getStructName().str();
-    const auto obj = builder.CreateAlloca(type, 0, nullptr, structName);
+    const auto obj = createAlloca(builder, type, structName);
     for (const auto& [member, value] : values_) {
       const auto idx = StructMember::getIndex(*module, structName, member);
       if (!idx) {
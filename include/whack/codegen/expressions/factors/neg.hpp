@@ -26,15 +26,19 @@ public:
       : Factor(kNeg), state_{ast->state}, factor_{getFactor(ast)} {}
 
   llvm::Expected<llvm::Value*> codegen(llvm::IRBuilder<>& builder) const final {
-    auto factor = factor_->codegen(builder);
+    auto f = factor_->codegen(builder);
+    if (!f) {
+      return f.takeError();
+    }
+    auto factor = getLoadedValue(builder, *f);
     if (!factor) {
       return factor.takeError();
     }
     const auto type = (*factor)->getType();
-    if (type->isIntegerTy()) {
+    if (type->isIntOrIntVectorTy()) {
       return builder.CreateNeg(*factor);
     }
-    if (type->isFloatingPointTy()) {
+    if (type->isFPOrFPVectorTy()) {
       return builder.CreateFNeg(*factor);
     }
     return error("negation operator not implemented for type at line {}",
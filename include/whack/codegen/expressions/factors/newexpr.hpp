@@ -43,6 +43,15 @@ public:
 
     const auto allocate = [&](llvm::Type* const type,
                               llvm::Value* const allocSize) -> llvm::Value* {
+      if (isOverAligned(module, type)) { // e.g. @align(64) structs
+        const auto charPtrTy = BasicTypes["char"]->getPointerTo(0);
+        const auto mem = builder.CreateCall(
+            module->getOrInsertFunction("__builtin_aligned_alloc", charPtrTy,
+                                        BasicTypes["int64"],
+                                        BasicTypes["int64"]),
+            {allocSize, builder.getInt64(getAlignment(module, type))});
+        return builder.CreateBitCast(mem, type->getPointerTo(0));
+      }
       const auto call = llvm::CallInst::CreateMalloc(
           block, BasicTypes["int64"], type, allocSize, nullptr, nullptr, "");
       builder.Insert(call);
@@ -57,6 +66,9 @@ public:
       if (!expr) {
         return expr.takeError();
       }
+      if (const auto arena = Arena::getAddress(builder, *expr)) {
+        return allocateInArena(builder, arena);
+      }
       if (llvm::isa<llvm::AllocaInst>(*expr)) {
         mem = builder.CreateLoad(*expr);
       } else {
@@ -100,10 +112,7 @@ public:
         }
       }
     }
-    const auto newed = builder.CreateAlloca(mem->getType(), 0, nullptr, "");
-    setIsDereferenceable(builder.getContext(), newed);
-    builder.CreateStore(mem, newed);
-    return newed;
+    return mem;
   }
 
   inline static bool classof(const Factor* const factor) {
@@ -112,6 +121,64 @@ public:
 
 private:
   const mpc_ast_t* const ast_;
+
+  // new(arena) T or new(arena) [n]T (yielding a T*)
+  llvm::Expected<llvm::Value*>
+  allocateInArena(llvm::IRBuilder<>& builder, llvm::Value* const arena) const {
+    const auto module = builder.GetInsertBlock()->getModule();
+    const auto typeAst = ast_->children[4];
+    llvm::Type* type;
+    llvm::Value* count = nullptr;
+    if (getInnermostAstTag(typeAst) == "arraytype") {
+      auto tp = types::Type{typeAst->children[3]}.codegen(builder);
+      if (!tp) {
+        return tp.takeError();
+      }
+      type = *tp;
+      auto n = getExpressionValue(typeAst->children[1])->codegen(builder);
+      if (!n) {
+        return n.takeError();
+      }
+      auto len = getLoadedValue(builder, *n);
+      if (!len) {
+        return len.takeError();
+      }
+      if (!(*len)->getType()->isIntegerTy()) {
+        return error("expected an integral element count at line {}",
+                     typeAst->state.row + 1);
+      }
+      count = builder.CreateIntCast(*len, BasicTypes["int64"], false);
+    } else {
+      auto tp = types::Type{typeAst}.codegen(builder);
+      if (!tp) {
+        return tp.takeError();
+      }
+      type = *tp;
+    }
+    llvm::Value* size =
+        builder.getInt64(module->getDataLayout().getTypeAllocSize(type));
+    if (count) {
+      // an overflowing size saturates, which no arena can hold
+      const auto product = builder.CreateCall(
+          llvm::Intrinsic::getDeclaration(
+              module, llvm::Intrinsic::umul_with_overflow, BasicTypes["int64"]),
+          {size, count});
+      size = builder.CreateSelect(builder.CreateExtractValue(product, 1),
+                                  builder.getInt64(UINT64_MAX),
+                                  builder.CreateExtractValue(product, 0));
+    }
+    const auto mem = Arena::allocate(builder, arena, size,
+                                     getAlignment(module, type));
+    const auto ptr = builder.CreateBitCast(mem, type->getPointerTo(0));
+    if (ast_->children_num > 5) {
+      auto init = Initializer{ast_->children[5]}.codegen(builder, type);
+      if (!init) {
+        return init.takeError();
+      }
+      align(builder.CreateStore(*init, ptr));
+    }
+    return ptr;
+  }
 };
 
 } // end namespace whack::codegen::expressions::factors
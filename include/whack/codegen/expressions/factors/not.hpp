@@ -26,11 +26,16 @@ public:
       : Factor(kNot), state_{ast->state}, factor_{getFactor(ast)} {}
 
   llvm::Expected<llvm::Value*> codegen(llvm::IRBuilder<>& builder) const final {
-    auto factor = factor_->codegen(builder);
+    auto f = factor_->codegen(builder);
+    if (!f) {
+      return f.takeError();
+    }
+    auto factor = getLoadedValue(builder, *f);
     if (!factor) {
       return factor.takeError();
     }
-    if (!(*factor)->getType()->isIntegerTy(1)) {
+    // booleans and vector masks
+    if (!(*factor)->getType()->isIntOrIntVectorTy(1)) {
       return error("not operator not implemented for type at line {}",
                    state_.row + 1);
     }
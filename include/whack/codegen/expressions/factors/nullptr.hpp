@@ -34,6 +34,10 @@ public:
     return get();
   }
 
+  inline llvm::Type* type(llvm::IRBuilder<>&) const final {
+    return BasicTypes["char"]->getPointerTo(0);
+  }
+
   inline static bool classof(const Factor* const factor) {
     return factor->getKind() == kNullPtr;
   }
@@ -30,6 +30,10 @@ public:
     return Integral::get(num_);
   }
 
+  inline llvm::Type* type(llvm::IRBuilder<>&) const final {
+    return BasicTypes["int"];
+  }
+
   inline static bool classof(const Factor* const factor) {
     return factor->getKind() == kOctal;
   }
@@ -37,14 +37,13 @@ namespace factors {
 class PostOp {
 public:
   static llvm::Expected<llvm::Value*>
-  get(llvm::IRBuilder<>& builder, llvm::Value* val, const llvm::StringRef op) {
-    llvm::Value* value;
-    if (llvm::isa<llvm::LoadInst>(val)) {
-      value = val;
-      val = llvm::cast<llvm::LoadInst>(val)->getPointerOperand();
-    } else {
-      value = builder.CreateLoad(val);
+  get(llvm::IRBuilder<>& builder, llvm::Value* const var,
+      const llvm::StringRef op) {
+    const auto val = getAddress(builder, var);
+    if (!val) {
+      return error("operator{} expects an lvalue", op.data());
     }
+    const auto value = align(builder.CreateLoad(val));
     const auto type = value->getType();
     if (type->isIntegerTy() || type->isFloatingPointTy()) {
       const auto incr = type->isIntegerTy() ? llvm::ConstantInt::get(type, 1)
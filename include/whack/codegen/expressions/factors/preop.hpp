@@ -45,13 +45,16 @@ public:
     if (!v) {
       return v.takeError();
     }
-    const auto val = *v;
-    const auto value = builder.CreateLoad(val);
+    const auto val = getAddress(builder, *v);
+    if (!val) {
+      return error("operator{} expects an lvalue at line {}", op_.data(),
+                   state_.row + 1);
+    }
+    const auto value = align(builder.CreateLoad(val));
     const auto type = value->getType();
     if (type->isIntegerTy() || type->isFloatingPointTy()) {
-      static const auto incr = type->isIntegerTy()
-                                   ? llvm::ConstantInt::get(type, 1)
-                                   : llvm::ConstantFP::get(type, 1.0);
+      const auto incr = type->isIntegerTy() ? llvm::ConstantInt::get(type, 1)
+                                            : llvm::ConstantFP::get(type, 1.0);
       auto apply =
           operators::getAdditive(builder, value, op_.drop_front(), incr);
       if (apply) {
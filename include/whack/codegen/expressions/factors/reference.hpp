@@ -28,7 +28,7 @@ public:
         hasMetadata(variable, llvm::LLVMContext::MD_dereferenceable)) {
       return variable;
     }
-    const auto ref = builder.CreateAlloca(variable->getType(), 0, nullptr, "");
+    const auto ref = createAlloca(builder, variable->getType());
     setIsDereferenceable(builder.getContext(), ref);
     builder.CreateStore(variable, ref);
     return ref;
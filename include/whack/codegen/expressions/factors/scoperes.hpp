@@ -25,7 +25,7 @@ namespace whack::codegen::expressions::factors {
 class ScopeRes final : public Factor {
 public:
   explicit ScopeRes(const mpc_ast_t* const ast)
-      : Factor(kScopeRes), state_{ast->state} {
+      : Factor(kScopeRes), ast_{ast}, state_{ast->state} {
     llvm::raw_string_ostream os{name_};
     for (auto i = 0; i < ast->children_num; ++i) {
       const auto str = ast->children[i]->contents;
@@ -39,6 +39,9 @@ public:
 
   llvm::Expected<llvm::Value*> codegen(llvm::IRBuilder<>& builder) const final {
     const auto module = builder.GetInsertBlock()->getModule();
+    if (const auto option = getEnumOption(*module, name_)) {
+      return option;
+    }
     if (const auto GV = module->getNamedGlobal(name_)) {
       assert(GV->hasInitializer());
       return llvm::cast<llvm::Value>(GV->getInitializer());
@@ -48,6 +51,10 @@ public:
         return &func;
       }
     }
+    // nullary data class constructor
+    if (isDataClassCtor(module, ast_)) {
+      return constructDataClass(builder, ast_, nullptr);
+    }
     return error("could not find symbol with the name "
                  "`{}` at line {}",
                  name_, state_.row + 1);
@@ -62,6 +69,7 @@ public:
   }
 
 private:
+  const mpc_ast_t* const ast_;
   const mpc_state_t state_;
   std::string name_;
   small_vector<llvm::StringRef> parts_;
@@ -18,6 +18,8 @@
 
 #pragma once
 
+#include "../../constants.hpp"
+
 namespace whack::codegen::expressions::factors {
 
 // @todo
@@ -31,7 +33,13 @@ public:
 
   inline llvm::Expected<llvm::Value*>
   codegen(llvm::IRBuilder<>& builder) const final {
-    return builder.CreateGlobalStringPtr(string_);
+    // equal literals share one pooled global
+    return ConstantPool::getString(builder.GetInsertBlock()->getModule(),
+                                   string_);
+  }
+
+  inline llvm::Type* type(llvm::IRBuilder<>&) const final {
+    return BasicTypes["char"]->getPointerTo(0);
   }
 
   inline static bool classof(const Factor* const factor) {
@@ -38,41 +38,58 @@ public:
     } else {
       member = memberName->contents;
     }
-    auto type = container->getType();
     const auto typeError = [&] {
       return error("expected `{}` to be a struct type at line {}",
                    container->getName().data(), memberName->state.row + 1);
     };
-    if (!type->isPointerTy()) {
-      return typeError();
-    } else {
+    // we access fields in place through addresses (lvalues) and
+    // extract them from struct values (rvalues)
+    llvm::Value* address = container;
+    auto type = address->getType();
+    if (type->isPointerTy() && type->getPointerElementType()->isPointerTy()) {
+      // we auto-dereference pointers to structs, e.g. in variables
+      address = align(builder.CreateLoad(address));
+      type = address->getType();
+    }
+    if (type->isStructTy()) {
+      address = nullptr;
+    } else if (type->isPointerTy() &&
+               type->getPointerElementType()->isStructTy()) {
       type = type->getPointerElementType();
-      if (!type->isStructTy()) {
-        return typeError();
-      }
+    } else {
+      return typeError();
     }
     const auto structName = type->getStructName();
     const auto module = builder.GetInsertBlock()->getModule();
-    llvm::Value* mem;
     if (const auto idx = getIndex(*module, structName, member)) {
-      mem = builder.CreateStructGEP(type, container, idx.value(), member);
-      if (structName.startswith("interface::")) { // @todo Necessary??
-        mem = align(builder.CreateLoad(mem));
+      const auto isInterface = structName.startswith("interface::");
+      if (!address) {
+        return builder.CreateExtractValue(container, idx.value(), member);
       }
-    } else {
-      const auto memFun = module->getFunction(
-          format("struct::{}::{}", structName.data(), member));
-      if (!memFun) {
-        return error("`{}` is not a field or member function "
-                     "for struct `{}` at line {}",
-                     member, structName.data(), memberName->state.row + 1);
+      const auto mem = builder.Insert(
+          llvm::GetElementPtrInst::CreateInBounds(
+              type, address,
+              {builder.getInt32(0), builder.getInt32(idx.value())}),
+          member);
+      if (isInterface) { // @todo Necessary??
+        return align(builder.CreateLoad(mem));
       }
-      mem = bindThis(builder, memFun, container);
+      setIsLValue(mem);
+      return mem;
+    }
+    const auto memFun = module->getFunction(
+        format("struct::{}::{}", structName.data(), member));
+    if (!memFun) {
+      return error("`{}` is not a field or member function "
+                   "for struct `{}` at line {}",
+                   member, structName.data(), memberName->state.row + 1);
+    }
+    if (!address) {
+      // member functions bind to an address
+      address = createAlloca(builder, type);
+      align(builder.CreateStore(container, address));
     }
-    const auto ret = align(builder.CreateAlloca(mem->getType(), 0, nullptr, ""));
-    align(builder.CreateStore(mem, ret));
-    setIsDereferenceable(builder.getContext(), ret);
-    return ret;
+    return bindThis(builder, memFun, address);
   }
 
   inline static llvm::Function* bindThis(llvm::IRBuilder<>& builder,
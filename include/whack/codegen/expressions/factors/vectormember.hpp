@@ -0,0 +1,240 @@
+/**
+ * Copyright 2018-present Onchere Bironga
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef WHACK_VECTORMEMBER_HPP
+#define WHACK_VECTORMEMBER_HPP
+
+#include "../../types/type.hpp"
+
+namespace whack::codegen::expressions::factors {
+
+/// Lanes and horizontal operations of SIMD vectors: swizzles such as
+/// `v.x` or `v.wzyx`, reductions (`v.sum()`, `v.product()`,
+/// `v.min()`, `v.max()`, `mask.all()`, `mask.any()`),
+/// `mask.select(a, b)`, `v.insert(lane, x)` and
+/// `a.shuffle(b?, lanes...)`
+class VectorMember {
+public:
+  // whether @param container is a vector or the address of one
+  static bool isa(const llvm::Value* const container) {
+    auto type = container->getType();
+    while (type->isPointerTy()) {
+      type = type->getPointerElementType();
+    }
+    return type->isVectorTy();
+  }
+
+  static llvm::Expected<llvm::Value*> get(llvm::IRBuilder<>& builder,
+                                          llvm::Value* const container,
+                                          const mpc_ast_t* const memberName) {
+    const llvm::StringRef member{memberName->contents};
+    auto [address, vector] = resolve(builder, container);
+    const auto type = vector ? vector->getType()
+                             : address->getType()->getPointerElementType();
+    const auto numLanes = type->getVectorNumElements();
+    small_vector<uint32_t> lanes;
+    for (const auto c : member) {
+      auto lane = llvm::StringRef{"xyzw"}.find(c);
+      if (lane == llvm::StringRef::npos) {
+        lane = llvm::StringRef{"rgba"}.find(c);
+      }
+      if (lane == llvm::StringRef::npos || lane >= numLanes) {
+        return error("invalid swizzle `{}` for a vector of {} lanes "
+                     "at line {}",
+                     member.str(), numLanes, memberName->state.row + 1);
+      }
+      lanes.push_back(static_cast<uint32_t>(lane));
+    }
+    if (lanes.size() == 1) {
+      if (address) { // we access the lane in place, e.g. `v.x = 1.0`
+        const auto lane = builder.Insert(
+            llvm::GetElementPtrInst::CreateInBounds(
+                type, address,
+                {builder.getInt32(0), builder.getInt32(lanes[0])}),
+            member);
+        setIsLValue(lane);
+        return lane;
+      }
+      return builder.CreateExtractElement(vector, lanes[0], member);
+    }
+    if (!vector) {
+      vector = align(builder.CreateLoad(address));
+    }
+    return builder.CreateShuffleVector(vector, llvm::UndefValue::get(type),
+                                       lanes, member);
+  }
+
+  static llvm::Expected<llvm::Value*>
+  call(llvm::IRBuilder<>& builder, llvm::Value* const container,
+       const mpc_ast_t* const memberName,
+       llvm::ArrayRef<llvm::Value*> arguments) {
+    const llvm::StringRef op{memberName->contents};
+    const auto line = memberName->state.row + 1;
+    auto [address, vector] = resolve(builder, container);
+    if (!vector) {
+      vector = align(builder.CreateLoad(address));
+    }
+    const auto type = vector->getType();
+    const auto elementType = type->getVectorElementType();
+    small_vector<llvm::Value*> args;
+    for (const auto arg : arguments) {
+      auto loaded = getLoadedValue(builder, arg);
+      if (!loaded) {
+        return loaded.takeError();
+      }
+      args.push_back(*loaded);
+    }
+    const auto invalidArgs = [&] {
+      return error("invalid arguments to vector operation `{}` at line {}",
+                   op.str(), line);
+    };
+
+    const auto isFP = elementType->isFloatingPointTy();
+    using op_t = std::function<llvm::Value*(llvm::Value*, llvm::Value*)>;
+    op_t reduction;
+    if (op == "sum") {
+      reduction = [&](llvm::Value* l, llvm::Value* r) {
+        return isFP ? builder.CreateFAdd(l, r) : builder.CreateAdd(l, r);
+      };
+    } else if (op == "product") {
+      reduction = [&](llvm::Value* l, llvm::Value* r) {
+        return isFP ? builder.CreateFMul(l, r) : builder.CreateMul(l, r);
+      };
+    } else if (op == "min" || op == "max") {
+      const auto isMin = op == "min";
+      reduction = [&, isMin](llvm::Value* l, llvm::Value* r) {
+        const auto cmp = isFP ? (isMin ? builder.CreateFCmpOLT(l, r)
+                                       : builder.CreateFCmpOGT(l, r))
+                              : (isMin ? builder.CreateICmpSLT(l, r)
+                                       : builder.CreateICmpSGT(l, r));
+        return builder.CreateSelect(cmp, l, r);
+      };
+    } else if (op == "all" || op == "any") {
+      if (!elementType->isIntegerTy(1)) {
+        return error("vector operation `{}` expects a mask at line {}",
+                     op.str(), line);
+      }
+      const auto isAll = op == "all";
+      reduction = [&, isAll](llvm::Value* l, llvm::Value* r) {
+        return isAll ? builder.CreateAnd(l, r) : builder.CreateOr(l, r);
+      };
+    }
+    if (reduction) {
+      if (!args.empty()) {
+        return invalidArgs();
+      }
+      return reduce(builder, vector, reduction);
+    }
+
+    if (op == "select") { // mask.select(ifTrue, ifFalse)
+      if (!elementType->isIntegerTy(1) || args.size() != 2) {
+        return invalidArgs();
+      }
+      types::splatScalarOperand(builder, args[0], args[1]);
+      const auto valueType = args[0]->getType();
+      if (valueType != args[1]->getType() || !valueType->isVectorTy() ||
+          valueType->getVectorNumElements() != type->getVectorNumElements()) {
+        return invalidArgs();
+      }
+      return builder.CreateSelect(vector, args[0], args[1]);
+    }
+
+    if (op == "insert") { // v.insert(lane, x)
+      if (args.size() != 2 || !args[0]->getType()->isIntegerTy()) {
+        return invalidArgs();
+      }
+      const auto lane = types::VectorType::getLane(builder, args[1],
+                                                   elementType);
+      if (!lane) {
+        return invalidArgs();
+      }
+      return builder.CreateInsertElement(vector, lane, args[0]);
+    }
+
+    if (op == "shuffle") { // a.shuffle(b?, lanes...)
+      llvm::Value* other = llvm::UndefValue::get(type);
+      llvm::ArrayRef<llvm::Value*> indices{args};
+      if (!indices.empty() && indices[0]->getType() == type) {
+        other = indices[0];
+        indices = indices.drop_front();
+      }
+      const auto numLanes = 2 * type->getVectorNumElements();
+      small_vector<uint32_t> mask;
+      for (const auto index : indices) {
+        const auto lane = llvm::dyn_cast<llvm::ConstantInt>(index);
+        if (!lane || lane->getZExtValue() >= numLanes) {
+          return error("expected constant shuffle lanes below {} "
+                       "at line {}",
+                       numLanes, line);
+        }
+        mask.push_back(static_cast<uint32_t>(lane->getZExtValue()));
+      }
+      if (mask.empty()) {
+        return invalidArgs();
+      }
+      return builder.CreateShuffleVector(vector, other, mask);
+    }
+
+    return error("`{}` is not a vector operation at line {}", op.str(),
+                 line);
+  }
+
+private:
+  using resolved_t = std::pair<llvm::Value*, llvm::Value*>;
+
+  // the address of the vector in @param container (if it is an lvalue),
+  // otherwise its value
+  static resolved_t resolve(llvm::IRBuilder<>& builder,
+                            llvm::Value* const container) {
+    llvm::Value* address = container;
+    if (address->getType()->isVectorTy()) {
+      return {nullptr, container};
+    }
+    while (address->getType()->getPointerElementType()->isPointerTy()) {
+      // we auto-dereference pointers to vectors, e.g. in variables
+      address = align(builder.CreateLoad(address));
+    }
+    return {address, nullptr};
+  }
+
+  // reduces the lanes of @param vector with @param op pairwise (in
+  // log2(lanes) shuffles) when the number of lanes is a power of 2
+  static llvm::Value*
+  reduce(llvm::IRBuilder<>& builder, llvm::Value* vector,
+         const std::function<llvm::Value*(llvm::Value*, llvm::Value*)>& op) {
+    const auto numLanes = vector->getType()->getVectorNumElements();
+    if (!llvm::isPowerOf2_32(numLanes)) {
+      auto result = builder.CreateExtractElement(vector, uint64_t{0});
+      for (unsigned i = 1; i < numLanes; ++i) {
+        result = op(result, builder.CreateExtractElement(vector, i));
+      }
+      return result;
+    }
+    const auto undef = llvm::UndefValue::get(vector->getType());
+    for (auto width = numLanes / 2; width > 0; width /= 2) {
+      small_vector<uint32_t> mask;
+      for (unsigned i = 0; i < numLanes; ++i) {
+        // only the lower lanes are significant
+        mask.push_back(i < width ? i + width : i);
+      }
+      vector = op(vector, builder.CreateShuffleVector(vector, undef, mask));
+    }
+    return builder.CreateExtractElement(vector, uint64_t{0});
+  }
+};
+
+} // end namespace whack::codegen::expressions::factors
+
+#endif // WHACK_VECTORMEMBER_HPP
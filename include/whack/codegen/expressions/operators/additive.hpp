@@ -66,6 +66,10 @@ public:
     return ret;
   }
 
+  llvm::Type* type(llvm::IRBuilder<>& builder) const {
+    return others_.empty() ? initial_->type(builder) : nullptr;
+  }
+
 private:
   const mpc_state_t state_;
   multiplicative_t initial_;
@@ -73,9 +77,10 @@ private:
 };
 
 static llvm::Expected<llvm::Value*> getAdditive(llvm::IRBuilder<>& builder,
-                                                llvm::Value* const lhs,
+                                                llvm::Value* lhs,
                                                 const llvm::StringRef op,
-                                                llvm::Value* const rhs) {
+                                                llvm::Value* rhs) {
+  types::splatScalarOperand(builder, lhs, rhs);
   const auto lhsType = lhs->getType();
   if (lhsType->isStructTy()) {
     if (auto apply = applyStructOperator(builder, lhs, op, rhs)) {
@@ -87,13 +92,13 @@ static llvm::Expected<llvm::Value*> getAdditive(llvm::IRBuilder<>& builder,
   }
   // @todo Signed/Unsigned operations
   // For now, we assume all integers are signed
-  if (lhsType->isIntegerTy()) {
+  if (lhsType->isIntOrIntVectorTy()) {
     if (op == "+") {
       return builder.CreateAdd(lhs, rhs);
     }
     return builder.CreateSub(lhs, rhs);
   }
-  if (lhsType->isFloatingPointTy()) {
+  if (lhsType->isFPOrFPVectorTy()) {
     if (op == "+") {
       return builder.CreateFAdd(lhs, rhs);
     }
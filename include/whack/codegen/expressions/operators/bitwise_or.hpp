@@ -66,13 +66,14 @@ public:
   }
 
   static llvm::Expected<llvm::Value*> get(llvm::IRBuilder<>& builder,
-                                          llvm::Value* const lhs,
-                                          llvm::Value* const rhs) {
+                                          llvm::Value* lhs,
+                                          llvm::Value* rhs) {
+    types::splatScalarOperand(builder, lhs, rhs);
     const auto lhsType = lhs->getType();
     if (lhsType != rhs->getType()) {
       return error("type mismatch in operator|");
     }
-    if (lhsType->isIntegerTy()) {
+    if (lhsType->isIntOrIntVectorTy()) {
       return builder.CreateOr(lhs, rhs);
     }
     if (lhsType->isStructTy()) {
@@ -83,6 +84,10 @@ public:
     return error("operator| not implemented for type");
   }
 
+  llvm::Type* type(llvm::IRBuilder<>& builder) const {
+    return others_.empty() ? initial_->type(builder) : nullptr;
+  }
+
 private:
   const mpc_state_t state_;
   xor_t initial_;
@@ -91,6 +91,10 @@ public:
     return Relational::get(builder, lhs, op, rhs);
   }
 
+  llvm::Type* type(llvm::IRBuilder<>& builder) const {
+    return others_.empty() ? initial_->type(builder) : nullptr;
+  }
+
 private:
   const mpc_state_t state_;
   relational_t initial_;
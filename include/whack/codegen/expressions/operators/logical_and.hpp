@@ -72,6 +72,10 @@ public:
     return ret;
   }
 
+  llvm::Type* type(llvm::IRBuilder<>& builder) const {
+    return others_.empty() ? initial_->type(builder) : builder.getInt1Ty();
+  }
+
 private:
   const mpc_state_t state_;
   bitwise_or_t initial_;
@@ -18,6 +18,7 @@
 
 #pragma once
 
+#include "../../types/typecache.hpp"
 #include "logical_and.hpp"
 
 namespace whack::codegen::expressions::operators {
@@ -26,7 +27,8 @@ class LogicalOr final : public Expression {
   using logical_and_t = std::unique_ptr<LogicalAnd>;
 
 public:
-  explicit LogicalOr(const mpc_ast_t* const ast) : state_{ast->state} {
+  explicit LogicalOr(const mpc_ast_t* const ast)
+      : ast_{ast}, state_{ast->state} {
     if (getInnermostAstTag(ast) == "logicalor") {
       initial_ = std::make_unique<LogicalAnd>(ast->children[0]);
       for (auto i = 1; i < ast->children_num; i += 2) {
@@ -45,6 +47,7 @@ public:
     }
     auto ret = *init;
     if (others_.empty()) {
+      types::TypeCache::record(builder, ast_, ret);
       return ret;
     }
     if (!ret->getType()->isIntegerTy(1)) {
@@ -70,10 +73,16 @@ public:
       }
       ret = builder.CreateOr(*l, *r);
     }
+    types::TypeCache::record(builder, ast_, ret);
     return ret;
   }
 
+  llvm::Type* type(llvm::IRBuilder<>& builder) const final {
+    return others_.empty() ? initial_->type(builder) : builder.getInt1Ty();
+  }
+
 private:
+  const mpc_ast_t* const ast_;
   const mpc_state_t state_;
   logical_and_t initial_;
   small_vector<logical_and_t> others_;
@@ -80,9 +80,10 @@ public:
   }
 
   static llvm::Expected<llvm::Value*> get(llvm::IRBuilder<>& builder,
-                                          llvm::Value* const lhs,
+                                          llvm::Value* lhs,
                                           const llvm::StringRef op,
-                                          llvm::Value* const rhs) {
+                                          llvm::Value* rhs) {
+    types::splatScalarOperand(builder, lhs, rhs);
     const auto lhsType = lhs->getType();
     if (lhsType->isStructTy()) {
       if (auto apply = applyStructOperator(builder, lhs, op, rhs)) {
@@ -94,7 +95,7 @@ public:
     }
     // @todo Signed/Unsigned operations
     // For now, we assume all integers are signed
-    if (lhsType->isIntegerTy()) {
+    if (lhsType->isIntOrIntVectorTy()) {
       if (op == "/") {
         return builder.CreateSDiv(lhs, rhs);
       }
@@ -103,7 +104,7 @@ public:
       }
       return builder.CreateSRem(lhs, rhs);
     }
-    if (lhsType->isFloatingPointTy()) {
+    if (lhsType->isFPOrFPVectorTy()) {
       if (op == "/") {
         return builder.CreateFDiv(lhs, rhs);
       }
@@ -115,6 +116,11 @@ public:
     return error("operator{} not implemented for type", op.data());
   }
 
+  // (the operators may be overloaded, so only a lone operand's is known)
+  llvm::Type* type(llvm::IRBuilder<>& builder) const {
+    return others_.empty() ? initial_->type(builder) : nullptr;
+  }
+
 private:
   const mpc_state_t state_;
   using factor_t = std::unique_ptr<factors::Factor>;
@@ -67,14 +67,15 @@ public:
   }
 
   static llvm::Expected<llvm::Value*> get(llvm::IRBuilder<>& builder,
-                                          llvm::Value* const lhs,
+                                          llvm::Value* lhs,
                                           const llvm::StringRef op,
-                                          llvm::Value* const rhs) {
+                                          llvm::Value* rhs) {
+    types::splatScalarOperand(builder, lhs, rhs);
     const auto lhsType = lhs->getType();
     if (lhsType != rhs->getType()) {
       return error("type mismatch in operator{}", op.data());
     }
-    if (lhsType->isIntegerTy()) {
+    if (lhsType->isIntOrIntVectorTy()) {
       if (op == "<<") {
         return builder.CreateShl(lhs, rhs);
       }
@@ -88,6 +89,10 @@ public:
     return error("operator{} not implemented for type", op.data());
   }
 
+  llvm::Type* type(llvm::IRBuilder<>& builder) const {
+    return others_.empty() ? initial_->type(builder) : nullptr;
+  }
+
 private:
   const mpc_state_t state_;
   additive_t initial_;
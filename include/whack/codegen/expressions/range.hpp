@@ -16,51 +16,103 @@
 #ifndef WHACK_RANGE_HPP
 #define WHACK_RANGE_HPP
 
-#include "ast.hpp"
+#pragma once
 
-namespace whack::ast {
+namespace whack::codegen::expressions {
 
+/// A range factor; one of `begin..`, `begin..end`, `begin..=end`,
+/// `begin..step..end` or `begin..step..=end`
 class Range final : public AST {
 public:
   explicit Range(const mpc_ast_t* const ast)
-      : begin_{getFactor(ast->children[0])} {
-    if (ast->children_num > 4) {
-      if (getOutermostAstTag(ast->children[2]) == "rangeable") {
-        next_ = getFactor(ast->children[2]);
+      : state_{ast->state}, begin_{factors::getFactor(ast->children[0])} {
+    const auto range = ast->children[1];
+    small_vector<const mpc_ast_t*> parts;
+    bool stepped = false;
+    for (auto i = 1; i < range->children_num; ++i) {
+      const auto ref = range->children[i];
+      const std::string_view view{ref->contents};
+      if (view == "..") {
+        stepped = true;
+      } else if (view == "=") {
+        endInclusive_ = true;
+      } else {
+        parts.push_back(ref);
       }
     }
-    const auto idx = ast->children_num - 1;
-    if (getOutermostAstTag(ast->children[idx]) == "rangeable") {
-      end_ = getFactor(ast->children[idx]);
-    }
-    if (std::string_view(ast->children[idx - 1]->contents) == "=") {
-      endInclusive_ = true;
+    if (stepped) {
+      step_ = factors::getFactor(parts[0]);
+      if (parts.size() > 1) {
+        end_ = factors::getFactor(parts[1]);
+      }
+    } else if (!parts.empty()) {
+      end_ = factors::getFactor(parts[0]);
     }
   }
 
   inline auto begin(llvm::IRBuilder<>& builder) const {
-    return begin_->codegen(builder);
+    return getBound(builder, begin_);
   }
 
-  inline const bool hasNext() const { return next_ != nullptr; }
+  inline bool hasStep() const { return step_ != nullptr; }
 
-  inline auto next(llvm::IRBuilder<>& builder) const {
-    return next_ ? next_->codegen(builder) : error("no next"); //
+  inline auto step(llvm::IRBuilder<>& builder) const {
+    return getBound(builder, step_);
   }
 
+  inline bool hasEnd() const { return end_ != nullptr; }
+
   inline auto end(llvm::IRBuilder<>& builder) const {
-    return end_ ? end_->codegen(builder) : error("no end"); //
+    return getBound(builder, end_);
   }
 
-  inline const bool endInclusive() const { return endInclusive_; }
+  inline bool endInclusive() const { return endInclusive_; }
+
+  inline const auto& state() const { return state_; }
+
+  static bool isa(const mpc_ast_t* const ast) {
+    if (getInnermostAstTag(ast) != "factor" || ast->children_num != 2) {
+      return false;
+    }
+    const auto composite = ast->children[1];
+    if (getOutermostAstTag(composite) != "composite") {
+      return false;
+    }
+    const auto hint = composite->children_num
+                          ? composite->children[0]->contents
+                          : composite->contents;
+    return std::string_view(hint) == "..";
+  }
 
 private:
-  std::unique_ptr<Factor> begin_;
-  std::unique_ptr<Factor> next_;
-  std::unique_ptr<Factor> end_;
+  const mpc_state_t state_;
+  std::unique_ptr<factors::Factor> begin_;
+  std::unique_ptr<factors::Factor> step_;
+  std::unique_ptr<factors::Factor> end_;
   bool endInclusive_{false};
+
+  llvm::Expected<llvm::Value*>
+  getBound(llvm::IRBuilder<>& builder,
+           const std::unique_ptr<factors::Factor>& bound) const {
+    if (!bound) {
+      return error("missing range bound at line {}", state_.row + 1);
+    }
+    auto value = bound->codegen(builder);
+    if (!value) {
+      return value.takeError();
+    }
+    auto loaded = getLoadedValue(builder, *value);
+    if (!loaded) {
+      return loaded.takeError();
+    }
+    if (!(*loaded)->getType()->isIntegerTy()) {
+      return error("expected an integral range bound at line {}",
+                   state_.row + 1);
+    }
+    return *loaded;
+  }
 };
 
-} // end namespace whack::ast
+} // end namespace whack::codegen::expressions
 
 #endif // WHACK_RANGE_HPP
@@ -18,6 +18,7 @@
 
 #pragma once
 
+#include "../types/typecache.hpp"
 #include "operators/logical_or.hpp"
 
 namespace whack::codegen::expressions {
@@ -25,7 +26,7 @@ namespace whack::codegen::expressions {
 class Ternary final : public Expression {
 public:
   explicit Ternary(const mpc_ast_t* const ast)
-      : state_{ast->state}, condition_{ast->children[0]},
+      : ast_{ast}, state_{ast->state}, condition_{ast->children[0]},
         hence_{getExpressionValue(ast->children[2])},
         otherwise_{getExpressionValue(ast->children[4])} {}
 
@@ -47,10 +48,13 @@ public:
                    "for ternary expression at line {}",
                    state_.row + 1);
     }
-    return builder.CreateSelect(*cond, *hence, *otherwise);
+    const auto ret = builder.CreateSelect(*cond, *hence, *otherwise);
+    types::TypeCache::record(builder, ast_, ret);
+    return ret;
   }
 
 private:
+  const mpc_ast_t* const ast_;
   const mpc_state_t state_;
   const operators::LogicalOr condition_;
   const expr_t hence_, otherwise_;
@@ -19,7 +19,10 @@
 #pragma once
 
 #include "types/types.hpp"
+#include <llvm/IR/GetElementPtrTypeIterator.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Operator.h>
 #include <llvm/Support/Casting.h>
 #include <mpc/mpc.h>
 #include <variant>
@@ -40,44 +43,76 @@ inline static auto& getGlobalContext() noexcept {
   return *reinterpret_cast<llvm::LLVMContext*>(LLVMGetGlobalContext());
 }
 
-// @todo
-static unsigned getAlignment(llvm::Type* const type) {
-  if (type == BasicTypes["char"]) {
-    return 1;
-  }
-  // if (type == BasicTypes["int"]) {
-  //   return 4;
-  // }
-  if (type->isIntegerTy()) {
-    return 4;
+static unsigned getStructAlignment(const llvm::Module&, const llvm::StringRef);
+
+// the ABI alignment of @param type for the target of @param module
+static unsigned getAlignment(const llvm::Module* const module,
+                             llvm::Type* const type) {
+  if (!type->isSized()) {
+    return 0; // we let LLVM pick
   }
-  if (type->isPointerTy()) {
-    return 8;
+  const auto alignment = module->getDataLayout().getABITypeAlignment(type);
+  if (const auto structure = llvm::dyn_cast<llvm::StructType>(type);
+      structure && structure->hasName()) { // e.g. @align(64)
+    return std::max(alignment,
+                    getStructAlignment(*module, structure->getName()));
   }
-  // @todo
-  if (const auto arrayTy = llvm::dyn_cast<llvm::ArrayType>(type)) {
-    if (arrayTy->getNumElements() > 3) {
-      return 16;
+  return alignment;
+}
+
+// whether @param ptr points into a field of a packed struct (which may lie
+// at any offset, so is accessed with alignment 1)
+static bool isPackedField(const llvm::Value* ptr) {
+  while (true) {
+    if (const auto gep = llvm::dyn_cast<llvm::GEPOperator>(ptr)) {
+      const auto end = llvm::gep_type_end(gep);
+      for (auto type = llvm::gep_type_begin(gep); type != end; ++type) {
+        if (const auto structure = type.getStructTypeOrNull();
+            structure && structure->isPacked()) {
+          return true;
+        }
+      }
+      ptr = gep->getPointerOperand();
+    } else if (const auto cast = llvm::dyn_cast<llvm::BitCastOperator>(ptr)) {
+      ptr = cast->getOperand(0);
+    } else {
+      return false;
     }
-    return 4;
   }
-  // @todo
-  return 8;
 }
 
 static auto align(llvm::Value* const value) {
   if (const auto inst = llvm::dyn_cast<llvm::Instruction>(value)) {
-    const auto type = inst->getType();
+    if (!inst->getParent()) {
+      return value;
+    }
+    const auto module = inst->getModule();
     if (const auto load = llvm::dyn_cast<llvm::LoadInst>(inst)) {
-      load->setAlignment(getAlignment(type));
+      load->setAlignment(isPackedField(load->getPointerOperand())
+                             ? 1
+                             : getAlignment(module, load->getType()));
     }
     if (const auto alloc = llvm::dyn_cast<llvm::AllocaInst>(inst)) {
-      alloc->setAlignment(getAlignment(alloc->getAllocatedType()));
+      alloc->setAlignment(getAlignment(module, alloc->getAllocatedType()));
+    }
+    if (const auto store = llvm::dyn_cast<llvm::StoreInst>(inst)) {
+      store->setAlignment(
+          isPackedField(store->getPointerOperand())
+              ? 1
+              : getAlignment(module, store->getValueOperand()->getType()));
     }
   }
   return value;
 }
 
+// whether `new` must ask for storage for @param type more aligned than
+// malloc's (which suits any fundamental type), e.g. for @align(64) structs
+static bool isOverAligned(const llvm::Module* const module,
+                          llvm::Type* const type) {
+  return type->isSized() && getAlignment(module, type) >
+                                2 * module->getDataLayout().getPointerSize();
+}
+
 static auto getTags(const mpc_ast_t* const ast) {
   small_vector<llvm::StringRef> rules;
   llvm::StringRef{ast->tag}.split(rules, '|');
@@ -123,6 +158,9 @@ public:
 class Expression : public AST {
 public:
   virtual llvm::Expected<llvm::Value*> codegen(llvm::IRBuilder<>&) const = 0;
+  // the type of the (loaded) value of the expression where it is known
+  // without emitting code, else nullptr
+  virtual llvm::Type* type(llvm::IRBuilder<>&) const { return nullptr; }
 };
 
 using expr_t = std::unique_ptr<Expression>;
@@ -137,6 +175,12 @@ static llvm::Expected<llvm::Value*>
 getLoadedValue(llvm::IRBuilder<>&, llvm::Value* const,
                const bool allowExpansion = false);
 
+// the type getLoadedValue gives @param value, without loading it
+static llvm::Type* getLoadedType(llvm::Value* const);
+
+// the storage an lvalue or reference designates, or nullptr for rvalues
+static llvm::Value* getAddress(llvm::IRBuilder<>&, llvm::Value* const);
+
 static llvm::Expected<small_vector<llvm::Value*>>
 getExprValues(llvm::IRBuilder<>&, const small_vector<expr_t>&,
               const bool allowExpansion = false);
@@ -190,6 +234,8 @@ public:
 
   inline constexpr Kind getKind() const noexcept { return kind_; }
   virtual llvm::Expected<llvm::Value*> codegen(llvm::IRBuilder<>&) const = 0;
+  // (see Expression::type)
+  virtual llvm::Type* type(llvm::IRBuilder<>&) const { return nullptr; }
 };
 
 static std::unique_ptr<Factor> getFactor(const mpc_ast_t* const);
@@ -286,17 +332,49 @@ static structopname_t getStructOpName(const mpc_ast_t* const);
 static llvm::Expected<std::string> getStructOpNameString(llvm::IRBuilder<>&,
                                                          const structopname_t&);
 
+static bool isDataClassCtor(const llvm::Module* const, const mpc_ast_t* const);
+
+static llvm::Expected<llvm::Value*> constructDataClass(llvm::IRBuilder<>&,
+                                                       const mpc_ast_t* const,
+                                                       const mpc_ast_t* const);
+
+struct MatchPattern {
+  enum PatternKind { kValue, kRange, kString, kVariant, kBinding, kWildcard };
+  PatternKind Kind;
+  mpc_state_t State;
+  llvm::Value* Value{nullptr};      // kValue
+  llvm::APInt Low, High;            // kRange (inclusive bounds)
+  std::string String;               // kString
+  unsigned Variant{0};              // kVariant
+  llvm::Type* VariantType{nullptr}; // kVariant
+  llvm::StringRef Binding;          // kBinding
+  std::vector<MatchPattern> Payload;
+};
+
 struct MatchInfo {
   using match_res_t = std::variant<std::unique_ptr<stmts::Stmt>, expr_t>;
   llvm::Value* Subject;
-  std::vector<std::pair<small_vector<llvm::Value*>, match_res_t>> Options;
+  // set when payload patterns need to address the subject
+  llvm::Value* SubjectAddress{nullptr};
+  std::vector<std::pair<small_vector<MatchPattern>, match_res_t>> Options;
   std::optional<match_res_t> Default;
   bool IsExpression;
+  mpc_state_t State;
 };
 
 static llvm::Expected<MatchInfo> getMatchInfo(const mpc_ast_t* const,
                                               llvm::IRBuilder<>&);
 
+static llvm::Error emitMatchDispatch(llvm::IRBuilder<>&, const MatchInfo&,
+                                     llvm::ArrayRef<llvm::BasicBlock*>,
+                                     llvm::BasicBlock* const);
+
+static llvm::Expected<small_vector<llvm::Value*>>
+bindMatchPayload(llvm::IRBuilder<>&, const MatchInfo&,
+                 const small_vector<MatchPattern>&);
+
+static void unbindMatchPayload(const small_vector<llvm::Value*>&);
+
 } // end namespace codegen
 } // end namespace whack
 
@@ -20,6 +20,7 @@
 
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/ValueMap.h>
 
 namespace whack::codegen {
 
@@ -42,6 +43,35 @@ static void setIsDereferenceable(llvm::LLVMContext& ctx,
       llvm::MDBuilder{ctx}.createTBAARoot("::dereferenceable"));
 }
 
+// lvalues are addresses of storage such as variables, fields and elements;
+// loading an lvalue once yields the value it designates. Codegen notes the
+// lvalues it makes here rather than in the IR (an entry goes away with its
+// instruction).
+static llvm::ValueMap<const llvm::Value*, bool>& getLValues() {
+  thread_local llvm::ValueMap<const llvm::Value*, bool> lvalues;
+  return lvalues;
+}
+
+static void setIsLValue(llvm::Value* const value) {
+  if (llvm::isa<llvm::Instruction>(value)) {
+    getLValues()[value] = true;
+  }
+}
+
+static const bool isLValue(llvm::Value* const value) {
+  if (llvm::isa<llvm::AllocaInst>(value)) {
+    return true;
+  }
+  // aggregates passed in memory
+  if (const auto arg = llvm::dyn_cast<llvm::Argument>(value)) {
+    return arg->hasByValAttr();
+  }
+  if (llvm::isa<llvm::Instruction>(value)) {
+    return getLValues().count(value) != 0;
+  }
+  return false;
+}
+
 static const auto getAllMetadataOperands(const llvm::Module& module,
                                          const llvm::StringRef metadata,
                                          const llvm::StringRef name) {
@@ -149,6 +179,100 @@ addStructTypeMetadata(llvm::Module* const module, const llvm::StringRef MDName,
   module->getOrInsertNamedMetadata(MDName)->addOperand(structMD);
 }
 
+// a distinct llvm.loop node (its first operand refers to itself)
+// with the given loop @param properties
+static llvm::MDNode*
+createLoopMetadata(llvm::LLVMContext& ctx,
+                   llvm::ArrayRef<llvm::Metadata*> properties = {}) {
+  const auto placeholder = llvm::MDNode::getTemporary(ctx, llvm::None);
+  small_vector<llvm::Metadata*> operands{placeholder.get()};
+  operands.append(properties.begin(), properties.end());
+  const auto loopID = llvm::MDNode::getDistinct(ctx, operands);
+  loopID->replaceOperandWith(0, loopID);
+  return loopID;
+}
+
+// records struct @param name whose layout differs from its declaration:
+// its alignment (0 if natural) and its fields in declaration order
+static void
+addStructLayoutMetadata(llvm::Module* const module, const llvm::StringRef name,
+                        const uint64_t alignment,
+                        const small_vector<llvm::StringRef>& decls) {
+  auto& ctx = module->getContext();
+  llvm::MDBuilder MDBuilder{ctx};
+  small_vector<llvm::Metadata*> operands{
+      MDBuilder.createString(name),
+      MDBuilder.createConstant(
+          llvm::ConstantInt::get(llvm::Type::getInt64Ty(ctx), alignment))};
+  for (const auto& decl : decls) {
+    operands.push_back(MDBuilder.createString(decl));
+  }
+  module->getOrInsertNamedMetadata("layouts")->addOperand(
+      llvm::MDNode::get(ctx, operands));
+}
+
+static unsigned getStructAlignment(const llvm::Module& module,
+                                   const llvm::StringRef name) {
+  if (const auto MD = getMetadataOperand(module, "layouts", name)) {
+    return llvm::mdconst::extract<llvm::ConstantInt>(
+               MD.value()->getOperand(1))
+        ->getZExtValue();
+  }
+  return 0;
+}
+
+// records enum @param name with its @param options and their values
+static void addEnumMetadata(llvm::Module* const module,
+                            const llvm::StringRef name,
+                            const ident_list_t& options,
+                            llvm::ArrayRef<llvm::Constant*> values) {
+  auto& ctx = module->getContext();
+  llvm::MDBuilder MDBuilder{ctx};
+  small_vector<llvm::Metadata*> operands{MDBuilder.createString(name)};
+  for (size_t i = 0; i < options.size(); ++i) {
+    operands.push_back(MDBuilder.createString(options[i]));
+    operands.push_back(MDBuilder.createConstant(values[i]));
+  }
+  module->getOrInsertNamedMetadata("enums")->addOperand(
+      llvm::MDNode::get(ctx, operands));
+}
+
+// the value of enum option @param option (`Enum::Option`), if any
+static llvm::Constant* getEnumOption(const llvm::Module& module,
+                                     const llvm::StringRef option) {
+  const auto sep = option.rfind("::");
+  if (sep == llvm::StringRef::npos) {
+    return nullptr;
+  }
+  const auto name = option.substr(sep + 2);
+  if (const auto MD =
+          getMetadataOperand(module, "enums", option.take_front(sep))) {
+    const auto operand = MD.value();
+    for (unsigned i = 1; i + 1 < operand->getNumOperands(); i += 2) {
+      if (llvm::cast<llvm::MDString>(operand->getOperand(i))->getString() ==
+          name) {
+        return llvm::mdconst::extract<llvm::Constant>(
+            operand->getOperand(i + 1));
+      }
+    }
+  }
+  return nullptr;
+}
+
+// the fields of a struct with a layout in declaration order
+static const auto getStructDeclOrder(const llvm::Module& module,
+                                     const llvm::StringRef name) {
+  small_vector<llvm::StringRef> decls;
+  if (const auto MD = getMetadataOperand(module, "layouts", name)) {
+    const auto operand = MD.value();
+    for (unsigned i = 2; i < operand->getNumOperands(); ++i) {
+      decls.push_back(
+          llvm::cast<llvm::MDString>(operand->getOperand(i))->getString());
+    }
+  }
+  return decls;
+}
+
 } // end namespace whack::codegen
 
 #endif // WHACK_METADATA_HPP
@@ -21,25 +21,24 @@
 #include "../parser.hpp"
 #include "../pass/manager.hpp"
 #include "../target.hpp"
+#include "constants.hpp"
 #include "elements/element.hpp"
 #include "metadata.hpp"
+#include "modulecache.hpp"
+#include "multiversion.hpp"
 #include <folly/Likely.h>
 #include <folly/Memory.h>
 #include <folly/ScopeGuard.h>
-#include <lib/IR/LLVMContextImpl.h>
+#include <llvm/ADT/SetVector.h>
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
 #include <llvm/IR/Module.h>
 #include <llvm/Linker/Linker.h>
 #include <llvm/Support/FileSystem.h>
 #include <llvm/Support/ManagedStatic.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
 #include <llvm/Support/Program.h>
-
-extern std::string InputFilename;
-extern std::string GrammarFilename;
-extern std::string OutputObjectFilename;
-extern std::string OutputExecutableFilename;
-extern bool EmitLLVM;
-extern std::vector<std::string> ModuleSearchPaths;
+#include <llvm/Target/TargetMachine.h>
 
 namespace whack::codegen {
 
@@ -49,7 +48,167 @@ struct ParserCreator {
 
 static llvm::ManagedStatic<Parser, ParserCreator> MainParser;
 static llvm::ManagedStatic<Target> MainTarget;
-static llvm::ManagedStatic<pass::Manager> PassManager;
+
+/// The modules imported while compiling a module, directly or through the
+/// modules it imports. Each is compiled once per compilation: importing it
+/// again along another path parses its summary instead (which its types
+/// are resolved from by name, without walking its code). Importers get
+/// the summary of a module (as in project builds), and the outermost
+/// module links its definitions in once, however many modules import it.
+/// Importing a module into the same module twice (e.g. from two `use`s
+/// alike) is a no-op, and a module which ends up importing itself is an
+/// error.
+class ImportGraph {
+public:
+  using summary_t = std::pair<std::string, std::unique_ptr<llvm::Module>>;
+
+  // the outermost graph on a thread is the one in use
+  ImportGraph() : outer_{current()} {
+    if (!outer_) {
+      current() = this;
+    }
+  }
+
+  ~ImportGraph() {
+    if (!outer_) {
+      current() = nullptr;
+    }
+  }
+
+  ImportGraph(const ImportGraph&) = delete;
+  ImportGraph& operator=(const ImportGraph&) = delete;
+
+  static ImportGraph* get() { return current(); }
+
+  // notes that the module in @param directory is being imported
+  llvm::Error enter(const std::string& directory,
+                    const llvm::StringRef name) {
+    if (llvm::find(importing_, directory) != importing_.end()) {
+      return error("module `{}` imports itself", name.str());
+    }
+    importing_.push_back(directory);
+    return llvm::Error::success();
+  }
+
+  void leave() { importing_.pop_back(); }
+
+  // whether the module being compiled is imported (rather than outermost)
+  bool isImporting() const { return !importing_.empty(); }
+
+  // the module source file @param source codegens to, if imported before
+  std::unique_ptr<llvm::Module> find(const std::string& source,
+                                     llvm::LLVMContext& ctx) const {
+    const auto module = modules_.find(source);
+    if (module == modules_.end()) {
+      return nullptr;
+    }
+    auto parsed = llvm::parseBitcodeFile(
+        llvm::MemoryBufferRef{module->second, source}, ctx);
+    if (!parsed) {
+      llvm::consumeError(parsed.takeError());
+      return nullptr;
+    }
+    return std::move(*parsed);
+  }
+
+  void add(const std::string& source, const llvm::Module& module) {
+    modules_[source] = getBitcode(module);
+  }
+
+  // the summaries of the source files of the module in @param directory
+  // (by source file), if it was imported before
+  llvm::Optional<small_vector<summary_t>>
+  findSummaries(const std::string& directory, llvm::LLVMContext& ctx) const {
+    const auto summaries = summaries_.find(directory);
+    if (summaries == summaries_.end()) {
+      return llvm::None;
+    }
+    small_vector<summary_t> parsed;
+    for (const auto& [source, bitcode] : summaries->second) {
+      auto summary =
+          llvm::parseBitcodeFile(llvm::MemoryBufferRef{bitcode, source}, ctx);
+      if (!summary) {
+        llvm::consumeError(summary.takeError());
+        return llvm::None;
+      }
+      parsed.emplace_back(source, std::move(*summary));
+    }
+    return std::move(parsed);
+  }
+
+  // notes the (summarized) modules @param summaries which the source files
+  // of the module in @param directory codegen to
+  void addSummaries(const std::string& directory,
+                    const llvm::ArrayRef<summary_t> summaries) {
+    auto& bitcodes = summaries_[directory];
+    for (const auto& [source, summary] : summaries) {
+      bitcodes.emplace_back(source, getBitcode(*summary));
+    }
+  }
+
+  // notes that @param dest imports the module in @param directory as
+  // @param importInfo says; false if it has already
+  static bool addImport(llvm::Module* const dest,
+                        const std::string& directory,
+                        const ModuleImportInfo& importInfo) {
+    auto key = directory;
+    if (importInfo.qualifier) {
+      key += format(" as {}", importInfo.qualifier->str());
+    }
+    if (importInfo.elements) {
+      key += importInfo.hiding ? " !{" : " {";
+      for (const auto& element : *importInfo.elements) {
+        key += format(" {}", element.str());
+      }
+      key += " }";
+    }
+    if (getMetadataOperand(*dest, "modules", key)) {
+      return false;
+    }
+    llvm::MDBuilder MDBuilder{dest->getContext()};
+    dest->getOrInsertNamedMetadata("modules")->addOperand(
+        MDBuilder.createTBAARoot(key));
+    return true;
+  }
+
+  // notes that @param dest needs the definitions of the module source file
+  // @param source, which the outermost module links in
+  static void require(llvm::Module* const dest, const std::string& source) {
+    if (getMetadataOperand(*dest, "requires", source)) {
+      return;
+    }
+    llvm::MDBuilder MDBuilder{dest->getContext()};
+    dest->getOrInsertNamedMetadata("requires")->addOperand(
+        MDBuilder.createTBAARoot(source));
+  }
+
+private:
+  ImportGraph* const outer_;
+  // the bitcode of the modules imported, by source file
+  std::unordered_map<std::string, std::string> modules_;
+  // the bitcode of the summaries of the modules imported (by source file),
+  // by module directory
+  std::unordered_map<std::string,
+                     small_vector<std::pair<std::string, std::string>>>
+      summaries_;
+  // the directories of the modules being imported, innermost last
+  std::vector<std::string> importing_;
+
+  static ImportGraph*& current() {
+    thread_local ImportGraph* graph{nullptr};
+    return graph;
+  }
+
+  static std::string getBitcode(const llvm::Module& module) {
+    std::string bitcode;
+    llvm::raw_string_ostream os{bitcode};
+    llvm::WriteBitcodeToFile(&module, os);
+    os.flush();
+    return bitcode;
+  }
+};
+
+static llvm::Error linkImports(llvm::Module* const module);
 
 class Module {
   using ast_t = std::unique_ptr<
@@ -57,46 +216,86 @@ class Module {
 
 public:
   explicit Module(const std::string& inputFileName)
-      : ownsContext_{true}, context_{new llvm::LLVMContext} {
+      : ownsContext_{true}, context_{new llvm::LLVMContext},
+        inputFileName_{inputFileName} {
     this->init(inputFileName);
   }
 
   explicit Module(const std::string& inputFileName,
                   llvm::LLVMContext* const context)
-      : ownsContext_{false}, context_{context} {
+      : ownsContext_{false}, context_{context}, inputFileName_{inputFileName} {
     this->init(inputFileName);
   }
 
-  Module() : Module(InputFilename) {}
-
   Module(const Module&) = delete;
   Module& operator=(const Module&) = delete;
 
-  llvm::Expected<std::unique_ptr<llvm::Module>> codegen() {
+  /// Compiles the module; unless @param wholeProgram, it is one of several
+  /// object files (e.g. of a batch), so the modules it imports are not
+  /// linked in (their own objects define what it uses of them) and what
+  /// it defines stays visible to other objects
+  llvm::Expected<std::unique_ptr<llvm::Module>>
+  codegen(const bool wholeProgram = true) {
     if (!ast_) {
       return error("invalid translation unit");
     }
+    // basic types live in the context of the module we compile
+    const auto outerContext = std::exchange(getTypeContext(), context_);
+    SCOPE_EXIT { getTypeContext() = outerContext; };
+    // the modules we import (and those they import) compile once
+    ImportGraph graph;
     auto module = std::make_unique<llvm::Module>(moduleName_, *context_);
-    if (auto err = this->fill(module.get())) {
+    types::TypeCache typeCache{module.get()};
+    // we lay out types (and hence align memory accesses) for our target
+    const auto machine =
+        reinterpret_cast<llvm::TargetMachine*>(MainTarget->getMachine());
+    module->setTargetTriple(machine->getTargetTriple().str());
+    module->setDataLayout(machine->createDataLayout());
+    if (auto err = this->fill(module.get(), wholeProgram)) {
       return err;
     }
     return module;
   }
 
-  llvm::Error compile() {
-    auto mod = this->codegen();
+  /// Compiles the module into an executable; if @param link is false
+  /// (batch compiles) we only emit an object file (or IR) next to the
+  /// input file, so that e.g. `a/util.w` and `b/util.w` do not collide
+  llvm::Error compile(const bool link = true) {
+    auto mod = this->codegen(link);
     if (!mod) {
       return mod.takeError();
     }
     const auto module = std::move(*mod);
+    if (!link) {
+      module->setModuleIdentifier(
+          llvm::sys::path::stem(inputFileName_).str());
+    }
+    const auto getOutputFilename = [&](const llvm::StringRef extension) {
+      if (link) {
+        return getAbsolutePath(module->getModuleIdentifier() + extension.str());
+      }
+      llvm::SmallString<128> path{inputFileName_};
+      llvm::sys::path::replace_extension(path, extension);
+      return path.str().str();
+    };
     if (EmitLLVM) {
-      return this->emitLLVMIR(module.get());
+      return this->emitLLVMIR(module.get(), getOutputFilename(".ll"));
     }
-    module->dump();
-    if (auto err = this->emitObjectFile(module.get())) {
+    const auto objectFilename = OutputObjectFilename.size()
+                                    ? OutputObjectFilename
+                                    : getOutputFilename(".o");
+    if (!link) {
+      return emitObjectFile(module.get(), objectFilename);
+    }
+    module->print(errs(), nullptr);
+    if (auto err = emitObjectFile(module.get(), objectFilename)) {
       return err;
     }
-    return this->link(module.get());
+    const auto executableFilename =
+        OutputExecutableFilename.size()
+            ? OutputExecutableFilename
+            : getAbsolutePath(module->getModuleIdentifier() + ".exe");
+    return Module::link({objectFilename}, executableFilename);
   }
 
   // @todo Test
@@ -127,6 +326,56 @@ public:
 
   inline const auto& name() const { return moduleName_; }
 
+  static llvm::Error emitObjectFile(const llvm::Module* const module,
+                                    const std::string& filename) {
+    char* err;
+    const auto e = LLVMTargetMachineEmitToFile(
+        MainTarget->getMachine(), llvm::wrap(module),
+        const_cast<char*>(filename.c_str()), LLVMObjectFile, &err);
+    if (e) {
+      auto ret = error(err);
+      LLVMDisposeMessage(err);
+      return ret;
+    }
+    return llvm::Error::success();
+  }
+
+  // links @param objects (and the runtime) into @param executable
+  static llvm::Error link(const std::vector<std::string>& objects,
+                          const std::string& executable) {
+    const auto gcc = llvm::sys::findProgramByName("gcc");
+    if (!gcc) {
+      return error("Could not find `gcc` on your system PATH. "
+                   "Please find MinGW GCC at "
+                   "https://nuwen.net and install.");
+    }
+    const auto runtime = getAbsolutePath("runtime.o");
+    std::vector<const char*> args{"gcc", runtime.c_str()};
+    for (const auto& object : objects) {
+      args.push_back(object.c_str());
+    }
+    args.insert(args.end(), {"-o", executable.c_str(), nullptr});
+    // what gcc says goes where our diagnostics do
+    llvm::SmallString<128> output;
+    if (llvm::sys::fs::createTemporaryFile("whack-link", "txt", output)) {
+      return error("could not create a file for the output of `gcc`");
+    }
+    SCOPE_EXIT { (void)llvm::sys::fs::remove(output); };
+    const llvm::Optional<llvm::StringRef> redirects[] = {
+        llvm::StringRef{""}, llvm::StringRef{output}, llvm::StringRef{output}};
+    std::string message;
+    const auto status = llvm::sys::ExecuteAndWait(
+        *gcc, args.data(), nullptr, redirects, 0, 0, &message);
+    if (auto said = llvm::MemoryBuffer::getFile(output)) {
+      errs() << (*said)->getBuffer();
+    }
+    if (status != 0) {
+      return error("could not link `{}` (`gcc` exited with status {}{})",
+                   executable, status, message.empty() ? "" : ": " + message);
+    }
+    return llvm::Error::success();
+  }
+
   ~Module() {
     if (ownsContext_ && context_ != nullptr) {
       delete context_;
@@ -136,6 +385,7 @@ public:
 private:
   const bool ownsContext_;
   llvm::LLVMContext* const context_;
+  const std::string inputFileName_;
   ast_t ast_;
   llvm::StringRef moduleName_;
   // Should be useful when we implement macros
@@ -182,7 +432,7 @@ private:
     }
   }
 
-  llvm::Error fill(llvm::Module* const module) {
+  llvm::Error fill(llvm::Module* const module, const bool wholeProgram) {
     llvm::Error err = llvm::Error::success();
     for (const auto& elem : elements_) {
       std::visit(
@@ -197,17 +447,36 @@ private:
     if (err) {
       return err;
     }
-    // We only run opt passes on the Main module @todo
-    if (module->getModuleIdentifier() == "Main") {
-      PassManager->run(module);
+    elements::Enumeration::emitExported(module);
+    if (auto err = Multiversion::emit(*module)) {
+      return err;
+    }
+    if (ImportGraph::get()->isImporting()) {
+      // importers read us back into a context with types of their own
+      ModuleSummary::pinTypes(*module);
+      return llvm::Error::success();
+    }
+    const auto machine =
+        reinterpret_cast<llvm::TargetMachine*>(MainTarget->getMachine());
+    if (!wholeProgram) {
+      // we only use the summaries of the modules we import
+      if (const auto required = module->getNamedMetadata("requires")) {
+        module->eraseNamedMetadata(required);
+      }
+      pass::Manager::get(machine, false).run(module);
+    } else if (auto err = linkImports(module)) {
+      return err;
+    } else if (module->getModuleIdentifier() == "Main") {
+      // We only run opt passes on the Main module @todo
+      pass::Manager::get(machine).run(module);
     }
     return llvm::Error::success();
   }
 
-  llvm::Error emitLLVMIR(const llvm::Module* const module) {
+  llvm::Error emitLLVMIR(const llvm::Module* const module,
+                         const std::string& filename) {
     std::error_code ec;
-    llvm::raw_fd_ostream os{module->getModuleIdentifier() + ".ll", ec,
-                            llvm::sys::fs::OpenFlags::F_RW};
+    llvm::raw_fd_ostream os{filename, ec, llvm::sys::fs::OpenFlags::F_RW};
     if (ec) {
       return error("error emitting LLVM IR: {}", ec.message());
     }
@@ -216,40 +485,6 @@ private:
     return llvm::Error::success();
   }
 
-  llvm::Error emitObjectFile(const llvm::Module* const module) {
-    char* err;
-    const auto outputObjectFilename =
-        OutputObjectFilename.size() ? OutputObjectFilename
-                                    : module->getModuleIdentifier() + ".o";
-    const auto e = LLVMTargetMachineEmitToFile(
-        MainTarget->getMachine(), llvm::wrap(module),
-        const_cast<char*>(outputObjectFilename.c_str()), LLVMObjectFile, &err);
-    if (e) {
-      auto ret = error(err);
-      LLVMDisposeMessage(err);
-      return ret;
-    }
-    return llvm::Error::success();
-  }
-
-  llvm::Error link(const llvm::Module* const module) {
-    if (!llvm::sys::findProgramByName("gcc")) {
-      return error("Could not find `gcc` on your system PATH. "
-                   "Please find MinGW GCC at "
-                   "https://nuwen.net and install.");
-    }
-    const auto outputObjectFilename =
-        OutputObjectFilename.size() ? OutputObjectFilename
-                                    : module->getModuleIdentifier() + ".o";
-    const auto outputExecutableFilename =
-        OutputExecutableFilename.size()
-            ? OutputExecutableFilename
-            : module->getModuleIdentifier() + ".exe";
-    const auto command = format("gcc runtime.o {} -o {}", outputObjectFilename,
-                                outputExecutableFilename);
-    system(command.c_str()); // @todo llvm::sys::ExecuteAndWait
-    return llvm::Error::success();
-  }
 };
 
 static llvm::Error
@@ -314,6 +549,7 @@ importModuleImpl(llvm::Module* const destModule,
     }
     alias.setName(newName);
     // enumerations...
+    renameMetadataOperand(*srcModule, "enums", aliasName, newName);
     for (auto& glob : srcModule->globals()) {
       const auto name = glob.getName();
       if (name.startswith(format("{}::", aliasName))) {
@@ -343,19 +579,24 @@ importModuleImpl(llvm::Module* const destModule,
 
   std::unordered_map<std::string, std::string> oldNewStructNames;
   const auto srcName = srcModule->getModuleIdentifier();
-  for (const auto& structure :
-       srcModule->getContext().pImpl->NamedStructTypes) {
-    const auto structName = structure.getKey();
-    if (structName.startswith("class::") ||
-        structName.startswith("interface::")) {
+  // We rename the struct types of the imported module alone (those it
+  // pins, and those its code mentions), looked up by the names its tables
+  // know them by: the context it shares with the importer may have other
+  // types of the same names
+  const auto types = ModuleSummary::takeTypes(*srcModule);
+  for (const auto& [structName, structure] : types) {
+    const llvm::StringRef nameRef{structName};
+    if (nameRef.startswith("class::") || nameRef.startswith("interface::") ||
+        nameRef.startswith(".tmp.")) {
       continue;
     }
     const auto newName = imported(structName)
-                             ? format("{}{}", qual, structName.data())
-                             : format(".tmp.{}.{}", srcName, structName.data());
-    structure.getValue()->setName(newName);
+                             ? format("{}{}", qual, structName)
+                             : format(".tmp.{}.{}", srcName, structName);
+    structure->setName(newName);
     renameMetadataOperand(*srcModule, "structures", structName, newName);
-    oldNewStructNames[structName.str()] = std::move(newName);
+    renameMetadataOperand(*srcModule, "layouts", structName, newName);
+    oldNewStructNames[structName] = std::move(newName);
   }
 
   // We import data classes
@@ -373,7 +614,9 @@ importModuleImpl(llvm::Module* const destModule,
       return err;
     }
     const auto baseName = format("class::{}", dataClass.data());
-    srcModule->getTypeByName(baseName)->setName(name);
+    if (const auto base = types.lookup(baseName)) {
+      base->setName(name);
+    }
 
     // We also import the variants
     for (const auto& variant :
@@ -386,9 +629,10 @@ importModuleImpl(llvm::Module* const destModule,
         }
         return err;
       }
-      const auto structure =
-          srcModule->getTypeByName(format("{}::{}", baseName, variant.data()));
-      structure->setName(newName);
+      if (const auto structure =
+              types.lookup(format("{}::{}", baseName, variant.data()))) {
+        structure->setName(newName);
+      }
     }
     renameMetadataOperand(*srcModule, "classes", dataClass,
                           format("{}{}", qual, dataClass.data()));
@@ -411,7 +655,9 @@ importModuleImpl(llvm::Module* const destModule,
 
     const auto oldName = format("interface::{}", interface.data());
     const auto newName = format("interface::{}", name);
-    srcModule->getTypeByName(oldName)->setName(newName);
+    if (const auto structure = types.lookup(oldName)) {
+      structure->setName(newName);
+    }
     renameMetadataOperand(*srcModule, "structures", oldName, newName);
     renameMetadataOperand(*srcModule, "interfaces", interface, name);
   }
@@ -439,9 +685,47 @@ importModuleImpl(llvm::Module* const destModule,
             return err;
           }
         } else {
-          (void)llvm::Function::Create(
+          const auto decl = llvm::Function::Create(
               funcType, llvm::Function::ExternalLinkage, name, destModule);
+          // we keep the ABI lowering of the declaration
+          decl->copyAttributesFrom(func);
+          decl->copyMetadata(func, 0);
+        }
+        return llvm::Error::success();
+      };
+
+      // calls to @param indirectionName (in the importer) go to the
+      // declaration under the symbol name
+      const auto redirect =
+          [&](const std::string& indirectionName) -> llvm::Error {
+        if (auto err = exists(indirectionName)) {
+          if (ignoreConflicts) {
+            llvm::consumeError(std::move(err));
+            return llvm::Error::success();
+          }
+          return err;
+        }
+        const auto indirection =
+            llvm::Function::Create(funcType, llvm::Function::InternalLinkage,
+                                   indirectionName, destModule);
+        const auto entry = llvm::BasicBlock::Create(indirection->getContext(),
+                                                    "entry", indirection);
+        llvm::IRBuilder<> builder{entry};
+        small_vector<llvm::Value*> args;
+        for (auto& arg : indirection->args()) {
+          args.push_back(&arg);
+        }
+        const auto call =
+            builder.CreateCall(destModule->getFunction(name), args);
+        if (funcType->getReturnType() != BasicTypes["void"]) {
+          builder.CreateRet(call);
+        } else {
+          builder.CreateRetVoid();
         }
+        indirection->copyAttributesFrom(func);
+        indirection->copyMetadata(func, 0);
+        call->setAttributes(func->getAttributes());
+        indirection->addFnAttr(llvm::Attribute::AttrKind::AlwaysInline);
         return llvm::Error::success();
       };
 
@@ -451,11 +735,22 @@ importModuleImpl(llvm::Module* const destModule,
           if (name.startswith(prefix)) {
             const auto newFuncName = format("struct::{}::{}", currentName,
                                             name.substr(prefix.size()).str());
-            func->setName(newFuncName);
+            if (!func->isDeclarationForLinker() || newFuncName == name) {
+              func->setName(newFuncName);
+              break;
+            }
+            // interface summaries declare the functions of structs (or
+            // carry their inline bodies), whose symbols we keep
+            if (auto err = importFuncDecl()) {
+              return err;
+            }
+            if (auto err = redirect(newFuncName)) {
+              return err;
+            }
             break;
           }
         }
-      } else if (func->empty()) {
+      } else if (func->isDeclarationForLinker()) {
         if (importInfo.qualifier) {
           if (!destModule->getFunction(name)) {
             if (auto err = importFuncDecl()) {
@@ -463,34 +758,9 @@ importModuleImpl(llvm::Module* const destModule,
             }
           }
           // We redirect qualified extern decls via a qualified-name inline func
-          const auto indirectionName = format("{}{}", qual, name.data());
-          if (auto err = exists(indirectionName)) {
-            if (ignoreConflicts) {
-              llvm::consumeError(std::move(err));
-              return llvm::Error::success();
-            } else {
-              return err;
-            }
-          }
-          const auto indirection =
-              llvm::Function::Create(funcType, llvm::Function::ExternalLinkage,
-                                     indirectionName, destModule);
-          const auto entry = llvm::BasicBlock::Create(indirection->getContext(),
-                                                      "entry", indirection);
-          llvm::IRBuilder<> builder{entry};
-          small_vector<llvm::Value*> args;
-          for (auto& arg : indirection->args()) {
-            args.push_back(&arg);
-          }
-          const auto call =
-              builder.CreateCall(destModule->getFunction(name), args);
-          if (funcType->getReturnType() != BasicTypes["void"]) {
-            builder.CreateRet(call);
-          } else {
-            builder.CreateRetVoid();
+          if (auto err = redirect(format("{}{}", qual, name.data()))) {
+            return err;
           }
-          indirection->copyAttributesFrom(func);
-          indirection->addFnAttr(llvm::Attribute::AttrKind::AlwaysInline);
         } else {
           if (auto err = importFuncDecl()) {
             return err;
@@ -502,10 +772,19 @@ importModuleImpl(llvm::Module* const destModule,
     } else {
       value->setName(newName);
     }
+    // symbols we hide are of no concern outside the importer
+    const auto global = llvm::cast<llvm::GlobalValue>(value);
+    if (global->getName().startswith(".tmp.") &&
+        !global->isDeclarationForLinker() && !global->hasLocalLinkage()) {
+      global->setLinkage(llvm::GlobalValue::InternalLinkage);
+    }
     return llvm::Error::success();
   };
 
   for (auto& glob : srcModule->globals()) {
+    if (glob.hasPrivateLinkage()) { // e.g. pooled constants
+      continue;
+    }
     if (auto err = setNewName(&glob)) {
       return err;
     }
@@ -517,28 +796,45 @@ importModuleImpl(llvm::Module* const destModule,
     }
   }
 
+  // what the imported module imported is no concern of the importer's
+  if (const auto modules = srcModule->getNamedMetadata("modules")) {
+    srcModule->eraseNamedMetadata(modules);
+  }
+
   if (llvm::Linker::linkModules(*destModule, std::move(importedModule))) {
     return error("cannot import module `{}` into module `{}`", srcName,
                  destName);
   }
+  // the linker renames pooled constants the modules have in common
+  ConstantPool::merge(*destModule);
   return llvm::Error::success();
 }
 
-/// @brief Imports symbols into destModule using importInfo
-/// @todo This import machinery obviously belongs
-///   elsewhere, broken up nice into small funcs
-static llvm::Error importModule(llvm::Module* const destModule,
-                                const ModuleImportInfo importInfo) {
+// the directory module paths are relative to on this thread: that of the
+// module being imported, else the working directory (which we leave be, as
+// modules compile concurrently in batches)
+static std::string& getImportDirectory() {
+  thread_local std::string directory;
+  return directory;
+}
+
+/// The directory of the module at @param modulePath (e.g. `a/b/C`), looked
+/// up relative to @param directory (the working directory if empty), then
+/// the module search paths (-I)
+static llvm::Expected<std::string>
+resolveModulePath(const llvm::StringRef directory,
+                  const llvm::StringRef modulePath) {
   using namespace llvm::sys;
-  llvm::SmallString<255> thisPath;
-  (void)fs::make_absolute(thisPath);
-  const auto modulePath = importInfo.modulePath.data();
-  auto path = format("{}/{}", thisPath.c_str(), modulePath);
+  llvm::SmallString<255> thisPath{directory};
+  if (thisPath.empty()) {
+    thisPath = getAbsolutePath(".");
+  }
+  auto path = format("{}/{}", thisPath.c_str(), modulePath.str());
   if (!fs::exists(path)) {
     bool found = false;
     // We look for the first match in provided module search paths
     for (const auto& searchPath : ModuleSearchPaths) {
-      const auto tryPath = format("{}/{}", searchPath, modulePath);
+      const auto tryPath = format("{}/{}", searchPath, modulePath.str());
       if (fs::exists(tryPath)) {
         path = std::move(tryPath);
         found = true;
@@ -546,19 +842,26 @@ static llvm::Error importModule(llvm::Module* const destModule,
       }
     }
     if (!found) {
-      return error("module path `{}` does not exist", modulePath);
+      return error("module path `{}` does not exist", modulePath.str());
     }
   }
+  llvm::SmallString<255> absolutePath{path};
+  (void)fs::make_absolute(absolutePath);
+  llvm::sys::path::remove_dots(absolutePath, true);
+  return absolutePath.str().str();
+}
 
-  (void)fs::set_current_path(path);
-  SCOPE_EXIT { (void)fs::set_current_path(thisPath); };
-
+// the (absolute paths of the) source files of the module in @param directory
+static llvm::Expected<std::vector<std::string>>
+getModuleSources(const llvm::StringRef directory) {
+  using namespace llvm::sys;
+  std::vector<std::string> sources;
   std::error_code ec;
-  for (auto it = fs::directory_iterator(path, ec);
+  for (auto it = fs::directory_iterator(directory, ec);
        it != fs::directory_iterator(); it = it.increment(ec)) {
-    if (ec) { // @todo
-      ec = {};
-      continue;
+    if (ec) {
+      return error("cannot list module directory `{}`: {}", directory.str(),
+                   ec.message());
     }
     const auto& pathEntry = it->path();
     // sub-modules are considered by use::decls.
@@ -568,18 +871,193 @@ static llvm::Error importModule(llvm::Module* const destModule,
     if (!llvm::StringRef{pathEntry}.endswith(".w")) {
       continue;
     }
-    Module temp{pathEntry, &destModule->getContext()};
-    if (temp.name() != importInfo.moduleName) {
+    llvm::SmallString<255> absolutePath{pathEntry};
+    (void)fs::make_absolute(absolutePath);
+    sources.push_back(absolutePath.str());
+  }
+  // so that builds are reproducible
+  std::sort(sources.begin(), sources.end());
+  return sources;
+}
+
+// the module the source file @param source codegens to, compiled at most
+// once per compilation (and not at all if cached)
+static llvm::Expected<std::unique_ptr<llvm::Module>>
+loadModule(const std::string& source, llvm::LLVMContext& ctx) {
+  const auto graph = ImportGraph::get();
+  if (auto loaded = graph->find(source, ctx)) {
+    return std::move(loaded);
+  }
+  auto loaded = ModuleCache::get(source, ctx);
+  if (!loaded) {
+    auto mod = ModuleCache::track(
+        source, [&]() -> llvm::Expected<std::unique_ptr<llvm::Module>> {
+          Module temp{source, &ctx};
+          return temp.codegen();
+        });
+    if (!mod) {
+      return mod.takeError();
+    }
+    loaded = std::move(*mod);
+  }
+  graph->add(source, *loaded);
+  return std::move(loaded);
+}
+
+/// Links the definitions of the modules @param module imported (and of
+/// those they imported in turn) into it, once each: importers only got
+/// their summaries. Definitions of the module's own take precedence, as
+/// they did when importers renamed what they imported.
+static llvm::Error linkImports(llvm::Module* const module) {
+  const auto required = module->getNamedMetadata("requires");
+  if (!required) {
+    return llvm::Error::success();
+  }
+  llvm::SetVector<std::string> sources;
+  const auto addRequired = [&sources](const llvm::Module& importer) {
+    for (const auto& source : getMetadataParts<1>(importer, "requires")) {
+      sources.insert(source.str());
+    }
+  };
+  addRequired(*module);
+  module->eraseNamedMetadata(required);
+
+  const auto graph = ImportGraph::get();
+  for (size_t i = 0; i < sources.size(); ++i) {
+    const auto source = sources[i];
+    // (cached modules might need modules we have not compiled yet)
+    const auto directory = llvm::sys::path::parent_path(source).str();
+    if (auto err = graph->enter(directory, directory)) {
+      return err;
+    }
+    SCOPE_EXIT { graph->leave(); };
+    const auto outerDirectory = std::exchange(getImportDirectory(), directory);
+    SCOPE_EXIT { getImportDirectory() = outerDirectory; };
+    auto loaded = loadModule(source, module->getContext());
+    if (!loaded) {
+      return loaded.takeError();
+    }
+    auto imported = std::move(*loaded);
+    addRequired(*imported);
+    const auto name = imported->getModuleIdentifier();
+    for (auto& global : imported->global_values()) {
+      const auto existing = module->getNamedValue(global.getName());
+      if (!existing || global.hasLocalLinkage() ||
+          global.isDeclarationForLinker() || global.isWeakForLinker() ||
+          existing->isDeclarationForLinker() || existing->isWeakForLinker()) {
+        continue;
+      }
+      global.setName(format(".tmp.{}.{}", name, global.getName().str()));
+      global.setLinkage(llvm::GlobalValue::InternalLinkage);
+    }
+    // its importers got its tables (with its summary)
+    small_vector<llvm::NamedMDNode*> tables;
+    for (auto& table : imported->named_metadata()) {
+      if (!table.getName().startswith("llvm.")) {
+        tables.push_back(&table);
+      }
+    }
+    for (const auto table : tables) {
+      imported->eraseNamedMetadata(table);
+    }
+    if (llvm::Linker::linkModules(*module, std::move(imported))) {
+      return error("cannot link module `{}` into module `{}`", name,
+                   module->getModuleIdentifier());
+    }
+  }
+  // the linker renames pooled constants the modules have in common
+  ConstantPool::merge(*module);
+  return llvm::Error::success();
+}
+
+/// @brief Imports symbols into destModule using importInfo
+/// @todo This import machinery obviously belongs
+///   elsewhere, broken up nice into small funcs
+static llvm::Error importModule(llvm::Module* const destModule,
+                                const ModuleImportInfo importInfo) {
+  using namespace llvm::sys;
+  auto resolved =
+      resolveModulePath(getImportDirectory(), importInfo.modulePath);
+  if (!resolved) {
+    return resolved.takeError();
+  }
+  const auto path = std::move(*resolved);
+  if (!ImportGraph::addImport(destModule, path, importInfo)) {
+    return llvm::Error::success();
+  }
+
+  // project builds have compiled the module already
+  auto summary = ModuleSummaries::get(path, destModule->getContext());
+  if (!summary) {
+    return summary.takeError();
+  }
+  if (*summary) {
+    if ((*summary)->getModuleIdentifier() != importInfo.moduleName) {
+      return error("invalid module name in module at path `{}` "
+                   "(expected `{}`, got `{}`)",
+                   path, importInfo.moduleName.data(),
+                   (*summary)->getModuleIdentifier());
+    }
+    return importModuleImpl(destModule, std::move(*summary), importInfo,
+                            true);
+  }
+
+  const auto graph = ImportGraph::get();
+  const auto checkName = [&](const llvm::Module& imported,
+                             const std::string& source) -> llvm::Error {
+    if (imported.getModuleIdentifier() != importInfo.moduleName) {
       return error("invalid module name in file at path `{}` "
                    "(expected `{}`, got `{}`)",
-                   pathEntry, importInfo.moduleName.data(), temp.name().data());
+                   source, importInfo.moduleName.data(),
+                   imported.getModuleIdentifier());
     }
-    auto mod = temp.codegen();
-    if (!mod) {
-      return mod.takeError();
+    return llvm::Error::success();
+  };
+  // the module was imported (and summarized) along another path
+  if (auto summaries = graph->findSummaries(path, destModule->getContext())) {
+    for (auto& [source, summary] : *summaries) {
+      if (auto err = checkName(*summary, source)) {
+        return err;
+      }
+      ImportGraph::require(destModule, source);
+      if (auto err = importModuleImpl(destModule, std::move(summary),
+                                      importInfo, true)) {
+        return err;
+      }
     }
-    if (auto err =
-            importModuleImpl(destModule, std::move(*mod), importInfo, true)) {
+    return llvm::Error::success();
+  }
+  if (auto err = graph->enter(path, importInfo.moduleName)) {
+    return err;
+  }
+  SCOPE_EXIT { graph->leave(); };
+  const auto outerDirectory = std::exchange(getImportDirectory(), path);
+  SCOPE_EXIT { getImportDirectory() = outerDirectory; };
+
+  auto sources = getModuleSources(path);
+  if (!sources) {
+    return sources.takeError();
+  }
+  small_vector<ImportGraph::summary_t> summaries;
+  for (const auto& source : *sources) {
+    auto loaded = loadModule(source, destModule->getContext());
+    if (!loaded) {
+      return loaded.takeError();
+    }
+    auto imported = std::move(*loaded);
+    if (auto err = checkName(*imported, source)) {
+      return err;
+    }
+    // the outermost module links the definitions in, once
+    ModuleSummary::summarize(*imported);
+    summaries.emplace_back(source, std::move(imported));
+  }
+  // (kept before importing renames what is imported)
+  graph->addSummaries(path, summaries);
+  for (auto& [source, summary] : summaries) {
+    ImportGraph::require(destModule, source);
+    if (auto err = importModuleImpl(destModule, std::move(summary),
+                                    importInfo, true)) {
       return err;
     }
   }
@@ -0,0 +1,200 @@
+/**
+ * Copyright 2018-present Onchere Bironga
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef WHACK_MODULECACHE_HPP
+#define WHACK_MODULECACHE_HPP
+
+#include "../target.hpp"
+#include "summary.hpp"
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <mutex>
+#include <unordered_map>
+
+namespace whack::codegen {
+
+/// Keeps the modules imported from source files (as bitcode, since every
+/// compile has its own context) for as long as the files, and the files
+/// they import in turn, are unchanged. Only enabled for the compile server
+/// and batch compiles, whose jobs share it. Modules are kept per target
+/// (-mcpu/-mattr) and module search paths, which requests may change.
+class ModuleCache {
+public:
+  static bool& enabled() {
+    static bool enabled{false};
+    return enabled;
+  }
+
+  // the module @param path (a source file) codegens to, or nullptr
+  static std::unique_ptr<llvm::Module> get(const std::string& path,
+                                           llvm::LLVMContext& ctx) {
+    if (!enabled()) {
+      return nullptr;
+    }
+    Entry cached;
+    {
+      std::lock_guard<std::mutex> lock{mutex()};
+      const auto entry = entries().find(getKey(path));
+      if (entry == entries().end()) {
+        return nullptr;
+      }
+      for (const auto& [source, modified] : entry->second.sources) {
+        if (getModificationTime(source) != modified) {
+          entries().erase(entry);
+          return nullptr;
+        }
+      }
+      cached = entry->second;
+    }
+    auto module = llvm::parseBitcodeFile(
+        llvm::MemoryBufferRef{cached.bitcode, cached.name}, ctx);
+    if (!module) {
+      llvm::consumeError(module.takeError());
+      return nullptr;
+    }
+    noteSources(cached.sources);
+    return std::move(*module);
+  }
+
+  /// Records the imports of source files as they are codegen'd: the
+  /// files a module is built from are noted while @param build runs
+  template <typename Build>
+  static auto track(const std::string& path, Build&& build) {
+    if (!enabled()) {
+      return build();
+    }
+    stack().emplace_back();
+    auto module = build();
+    auto sources = std::move(stack().back());
+    stack().pop_back();
+    sources.emplace_back(path, getModificationTime(path));
+    noteSources(sources);
+    if (module) {
+      add(path, **module, std::move(sources));
+    }
+    return module;
+  }
+
+private:
+  using timepoint_t = llvm::sys::TimePoint<>;
+  using sources_t = std::vector<std::pair<std::string, timepoint_t>>;
+
+  struct Entry {
+    std::string name;
+    std::string bitcode;
+    sources_t sources;
+  };
+
+  static std::unordered_map<std::string, Entry>& entries() {
+    static std::unordered_map<std::string, Entry> entries;
+    return entries;
+  }
+
+  static std::mutex& mutex() {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+  // the sources of the modules being built on this thread, innermost last
+  static std::vector<sources_t>& stack() {
+    thread_local std::vector<sources_t> stack;
+    return stack;
+  }
+
+  // what the module of source file @param path depends on besides sources
+  static std::string getKey(const std::string& path) {
+    auto key = path + '\n' + Target::getCPU();
+    key += '\n' + Target::getFeatures();
+    for (const auto& directory : ModuleSearchPaths) {
+      key += '\n' + directory;
+    }
+    return key;
+  }
+
+  static timepoint_t getModificationTime(const llvm::StringRef path) {
+    llvm::sys::fs::file_status status;
+    if (llvm::sys::fs::status(path, status)) {
+      return {};
+    }
+    return status.getLastModificationTime();
+  }
+
+  // the module being built (if any) also depends on @param sources
+  static void noteSources(const sources_t& sources) {
+    if (!stack().empty()) {
+      auto& outer = stack().back();
+      outer.insert(outer.end(), sources.begin(), sources.end());
+    }
+  }
+
+  static void add(const std::string& path, const llvm::Module& module,
+                  sources_t sources) {
+    std::string bitcode;
+    llvm::raw_string_ostream os{bitcode};
+    llvm::WriteBitcodeToFile(&module, os);
+    os.flush();
+    std::lock_guard<std::mutex> lock{mutex()};
+    entries()[getKey(path)] = Entry{module.getModuleIdentifier(),
+                                    std::move(bitcode), std::move(sources)};
+  }
+};
+
+/// The interface summaries (`.wi` files) of the modules a project
+/// build has compiled so far, by module directory: importers link these in
+/// rather than compiling the modules again. Builds (e.g. compile server
+/// requests) may run side by side, so each has its own, which the threads
+/// compiling its modules use.
+class ModuleSummaries {
+public:
+  // those of the build running on this thread, if any
+  static ModuleSummaries*& current() {
+    thread_local ModuleSummaries* summaries{nullptr};
+    return summaries;
+  }
+
+  void add(const std::string& directory, std::string summary) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    summaries_[directory] = std::move(summary);
+  }
+
+  // the summary of the module in @param directory, or nullptr
+  static llvm::Expected<std::unique_ptr<llvm::Module>>
+  get(const std::string& directory, llvm::LLVMContext& ctx) {
+    const auto summaries = current();
+    if (!summaries) {
+      return nullptr;
+    }
+    std::string path;
+    {
+      std::lock_guard<std::mutex> lock{summaries->mutex_};
+      const auto summary = summaries->summaries_.find(directory);
+      if (summary == summaries->summaries_.end()) {
+        return nullptr;
+      }
+      path = summary->second;
+    }
+    return ModuleSummary::read(path, ctx);
+  }
+
+private:
+  std::unordered_map<std::string, std::string> summaries_;
+  std::mutex mutex_;
+};
+
+} // end namespace whack::codegen
+
+#endif // WHACK_MODULECACHE_HPP
@@ -0,0 +1,225 @@
+/**
+ * Copyright 2018-present Onchere Bironga
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef WHACK_MULTIVERSION_HPP
+#define WHACK_MULTIVERSION_HPP
+
+#include "../target.hpp"
+#include "coroutine.hpp"
+#include "metadata.hpp"
+#include <llvm/ADT/Triple.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+namespace whack::codegen {
+
+/// Function multi-versioning. A function tagged e.g.
+/// `@target_clones("avx512f", "avx2", "default")` is compiled once for
+/// each of the features (on top of those we target), and once as is. The
+/// function itself then calls through a function pointer, which starts out
+/// pointing to a stub: on the first call, the stub has the resolver pick
+/// the first variant, in the order given, that the CPU supports (or the
+/// default), stores that in the pointer and calls it. Unlike ifuncs, this
+/// needs no support of the loader, so it works for COFF (MinGW) targets as
+/// well as for ELF ones.
+///
+/// Tags note the features of their functions in the "clones" table; the
+/// variants are made once the module is complete (and before it is
+/// optimized), so that every call to the function (and symbol lookups by
+/// its name) see the function itself.
+class Multiversion {
+public:
+  // the bit of @param feature in the features of libgcc's `__cpu_model`
+  // (which __builtin_cpu_supports tests), if it is one we can test
+  static std::optional<unsigned> getFeatureBit(const llvm::StringRef feature) {
+    static const llvm::StringMap<unsigned> Features{
+        {"cmov", 0},        {"mmx", 1},         {"popcnt", 2},
+        {"sse", 3},         {"sse2", 4},        {"sse3", 5},
+        {"ssse3", 6},       {"sse4.1", 7},      {"sse4.2", 8},
+        {"avx", 9},         {"avx2", 10},       {"sse4a", 11},
+        {"fma4", 12},       {"xop", 13},        {"fma", 14},
+        {"avx512f", 15},    {"bmi", 16},        {"bmi2", 17},
+        {"aes", 18},        {"pclmul", 19},     {"avx512vl", 20},
+        {"avx512bw", 21},   {"avx512dq", 22},   {"avx512cd", 23},
+        {"avx512er", 24},   {"avx512pf", 25},   {"avx512vbmi", 26},
+        {"avx512ifma", 27}};
+    const auto bit = Features.find(feature);
+    if (bit == Features.end()) {
+      return std::nullopt;
+    }
+    return bit->getValue();
+  }
+
+  // enables @param features (e.g. `avx2,fma`) for @param func, on top of
+  // those we target
+  static void addTargetFeatures(llvm::Function* const func,
+                                const llvm::StringRef features) {
+    auto all = func->hasFnAttribute("target-features")
+                   ? func->getFnAttribute("target-features")
+                         .getValueAsString()
+                         .str()
+                   : Target::getFeatures();
+    small_vector<llvm::StringRef> parts;
+    features.split(parts, ',', -1, false);
+    for (const auto feature : parts) {
+      all += all.empty() ? "" : ",";
+      if (!feature.startswith("+") && !feature.startswith("-")) {
+        all += "+";
+      }
+      all += feature.str();
+    }
+    func->addFnAttr("target-features", all);
+    if (!func->hasFnAttribute("target-cpu") && !Target::getCPU().empty()) {
+      func->addFnAttr("target-cpu", Target::getCPU());
+    }
+  }
+
+  // makes the variants of the functions in the "clones" table of
+  // @param module
+  static llvm::Error emit(llvm::Module& module) {
+    const auto clones = module.getNamedMetadata("clones");
+    if (!clones) {
+      return llvm::Error::success();
+    }
+    // importers get the variants, not the table
+    SCOPE_EXIT { module.eraseNamedMetadata(clones); };
+    const llvm::Triple triple{module.getTargetTriple()};
+    const auto supported = triple.getArch() == llvm::Triple::x86 ||
+                           triple.getArch() == llvm::Triple::x86_64;
+    for (const auto operand : clones->operands()) {
+      const auto name =
+          llvm::cast<llvm::MDString>(operand->getOperand(0))->getString();
+      const auto func = module.getFunction(name);
+      if (!func || func->isDeclaration()) {
+        continue;
+      }
+      if (!supported) {
+        warning("@target_clones of function `{}` ignored: multi-versioning "
+                "needs an x86 target (not `{}`)",
+                name.str(), triple.str());
+        continue;
+      }
+      if (func->isVarArg() || Coroutine::getPromiseType(func)) {
+        return error("cannot clone variadic function or generator `{}` "
+                     "for targets",
+                     name.str());
+      }
+      small_vector<llvm::StringRef> features;
+      for (unsigned i = 1; i < operand->getNumOperands(); i += 2) {
+        features.push_back(
+            llvm::cast<llvm::MDString>(operand->getOperand(i))->getString());
+      }
+      emitVariants(module, func, features);
+    }
+    return llvm::Error::success();
+  }
+
+private:
+  static void emitVariants(llvm::Module& module, llvm::Function* const func,
+                           const small_vector<llvm::StringRef>& features) {
+    auto& ctx = module.getContext();
+    const auto name = func->getName().str();
+    constexpr static auto internal = llvm::GlobalValue::InternalLinkage;
+
+    small_vector<std::pair<llvm::Function*, unsigned>> variants;
+    for (const auto feature : features) {
+      if (feature == "default") {
+        continue;
+      }
+      llvm::ValueToValueMapTy map;
+      const auto variant = llvm::CloneFunction(func, map);
+      variant->setName(name + "." + feature.str());
+      variant->setLinkage(internal);
+      addTargetFeatures(variant, feature);
+      variants.emplace_back(variant, getFeatureBit(feature).value());
+    }
+    // the default takes the body of the function
+    const auto fallback = llvm::Function::Create(
+        func->getFunctionType(), internal, name + ".default", &module);
+    fallback->copyAttributesFrom(func);
+    fallback->stealArgumentListFrom(*func);
+    fallback->getBasicBlockList().splice(fallback->begin(),
+                                         func->getBasicBlockList());
+
+    const auto resolver = llvm::Function::Create(
+        llvm::FunctionType::get(func->getType(), false), internal,
+        name + ".resolver", &module);
+    llvm::IRBuilder<> builder{llvm::BasicBlock::Create(ctx, "", resolver)};
+    builder.CreateCall(module.getOrInsertFunction(
+        "__cpu_indicator_init",
+        llvm::FunctionType::get(builder.getVoidTy(), false)));
+    const auto i32 = builder.getInt32Ty();
+    // struct { vendor, type, subtype, features[1] }
+    const auto modelType = llvm::StructType::get(
+        ctx, {i32, i32, i32, llvm::ArrayType::get(i32, 1)});
+    const auto model = module.getOrInsertGlobal("__cpu_model", modelType);
+    const auto supported = builder.CreateLoad(builder.CreateInBoundsGEP(
+        modelType, model,
+        {builder.getInt32(0), builder.getInt32(3), builder.getInt32(0)}));
+    llvm::Value* chosen = fallback;
+    for (auto variant = variants.rbegin(); variant != variants.rend();
+         ++variant) {
+      const auto mask = builder.getInt32(1u << variant->second);
+      chosen = builder.CreateSelect(
+          builder.CreateICmpEQ(builder.CreateAnd(supported, mask), mask),
+          variant->first, chosen);
+    }
+    builder.CreateRet(chosen);
+
+    // the pointer starts out at the stub, which resolves it
+    const auto stub = llvm::Function::Create(
+        func->getFunctionType(), internal, name + ".resolve", &module);
+    stub->copyAttributesFrom(func);
+    const auto pointer = new llvm::GlobalVariable{
+        module, func->getType(), false, internal, stub, name + ".ptr"};
+    const auto align = module.getDataLayout().getPointerABIAlignment(0);
+    pointer->setAlignment(align);
+
+    // (racing first calls store the same variant)
+    builder.SetInsertPoint(llvm::BasicBlock::Create(ctx, "", stub));
+    const auto resolved = builder.CreateCall(resolver);
+    const auto store = builder.CreateAlignedStore(resolved, pointer, align);
+    store->setAtomic(llvm::AtomicOrdering::Monotonic);
+    emitForward(builder, stub, resolved);
+
+    // the function now calls the variant the pointer holds
+    builder.SetInsertPoint(llvm::BasicBlock::Create(ctx, "", func));
+    const auto load = builder.CreateAlignedLoad(pointer, align);
+    load->setAtomic(llvm::AtomicOrdering::Monotonic);
+    emitForward(builder, func, load);
+  }
+
+  // has @param func tail call @param callee with its arguments
+  static void emitForward(llvm::IRBuilder<>& builder,
+                          llvm::Function* const func,
+                          llvm::Value* const callee) {
+    small_vector<llvm::Value*> args;
+    for (auto& arg : func->args()) {
+      args.push_back(&arg);
+    }
+    const auto call = builder.CreateCall(callee, args);
+    call->setCallingConv(func->getCallingConv());
+    call->setAttributes(func->getAttributes());
+    call->setTailCall();
+    if (func->getReturnType()->isVoidTy()) {
+      builder.CreateRetVoid();
+    } else {
+      builder.CreateRet(call);
+    }
+  }
+};
+
+} // end namespace whack::codegen
+
+#endif // WHACK_MULTIVERSION_HPP
@@ -0,0 +1,456 @@
+/**
+ * Copyright 2018-present Onchere Bironga
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef WHACK_SCOPE_HPP
+#define WHACK_SCOPE_HPP
+
+#include "fwd.hpp"
+#include <functional>
+#include <llvm/IR/IntrinsicInst.h>
+
+namespace whack::codegen {
+
+/// A lexical scope within a function. Stack slots for the locals of a scope
+/// are hoisted to the entry block of the function (so that mem2reg can
+/// promote them), and nested scopes bound their lifetimes with
+/// llvm.lifetime.start/end markers so that stack slots can be shared.
+///
+/// Scopes also keep the stack of pending cleanups (deferred statements).
+/// Each cleanup is emitted once, in a block that every exit through it
+/// (falling off the scope, `return`, `break` or `continue`) branches to
+/// after noting its destination in a selector slot; the block then
+/// switches on the selector to the next cleanup down or the destination.
+class Scope {
+public:
+  explicit Scope(const llvm::IRBuilder<>& builder)
+      : function_{builder.GetInsertBlock()->getParent()}, parent_{current()},
+        base_{parent_ && parent_->function_ == function_ ? parent_->depth()
+                                                         : 0} {
+    current() = this;
+  }
+
+  ~Scope() { current() = parent_; }
+
+  Scope(const Scope&) = delete;
+  Scope& operator=(const Scope&) = delete;
+
+  /// Code emitted while this lives belongs to no scope, e.g. speculative
+  /// codegen which is thrown away (its stack slots get no lifetime markers)
+  class Detached {
+  public:
+    Detached() : scope_{std::exchange(current(), nullptr)} {}
+    ~Detached() { current() = scope_; }
+
+    Detached(const Detached&) = delete;
+    Detached& operator=(const Detached&) = delete;
+
+  private:
+    Scope* const scope_;
+  };
+
+  // the outermost scope of a function; its locals live throughout it
+  inline bool isFunctionScope() const {
+    return !parent_ || parent_->function_ != function_;
+  }
+
+  // ends the lifetimes of the locals in this scope if control reaches
+  // the insertion point of @param builder. Locals whose address outlives
+  // the scope (e.g. closure environments, or references stored in outer
+  // variables) live throughout the function instead.
+  void exit(llvm::IRBuilder<>& builder) {
+    const auto block = builder.GetInsertBlock();
+    if (block->getTerminator()) {
+      return;
+    }
+    for (auto local = locals_.rbegin(); local != locals_.rend(); ++local) {
+      if (escapes(*local)) {
+        removeLifetimeMarkers(*local);
+      } else {
+        builder.CreateLifetimeEnd(*local);
+      }
+    }
+    locals_.clear();
+  }
+
+  // the innermost scope around the insertion point of @param builder
+  static Scope* get(const llvm::IRBuilder<>& builder) {
+    const auto scope = current();
+    if (scope && scope->function_ == builder.GetInsertBlock()->getParent()) {
+      return scope;
+    }
+    return nullptr;
+  }
+
+  using CleanupFn = std::function<llvm::Error(llvm::IRBuilder<>&)>;
+
+  // runs @param cleanup whenever control leaves this scope from here on
+  void pushCleanup(const stmts::Stmt* const cleanup) {
+    pushCleanup([cleanup](llvm::IRBuilder<>& builder) -> llvm::Error {
+      if (auto err = cleanup->codegen(builder)) {
+        return err;
+      }
+      return cleanup->runScopeExit(builder);
+    });
+  }
+
+  // emits @param cleanup whenever control leaves this scope from here on
+  // (e.g. destroying a generator iterated by a loop)
+  void pushCleanup(CleanupFn cleanup) {
+    cleanups_.push_back({std::move(cleanup)});
+  }
+
+  // the number of cleanups pending at the insertion point of @param builder
+  static size_t getCleanupDepth(const llvm::IRBuilder<>& builder) {
+    const auto scope = get(builder);
+    return scope ? scope->depth() : 0;
+  }
+
+  /// Branches to @param dest through the cleanups pending above
+  /// @param depth (the cleanup depth at @param dest)
+  static void branchThrough(llvm::IRBuilder<>& builder,
+                            llvm::BasicBlock* const dest, const size_t depth) {
+    auto scope = get(builder);
+    while (scope && scope->cleanups_.empty() && !scope->isFunctionScope()) {
+      scope = scope->parent_;
+    }
+    if (!scope || scope->depth() <= depth) {
+      builder.CreateBr(dest);
+      return;
+    }
+    auto& cleanup = scope->cleanups_.back();
+    const auto func = scope->function_;
+    if (!cleanup.block) {
+      cleanup.block =
+          llvm::BasicBlock::Create(func->getContext(), "cleanup", func);
+    }
+    const auto outermost = scope->functionScope();
+    if (!outermost->selector_) {
+      outermost->selector_ =
+          createEntryAlloca(func, BasicTypes["int"], "cleanup.dest");
+    }
+    const auto index = outermost->destinations_.insert(
+        {dest, static_cast<unsigned>(outermost->destinations_.size())});
+    align(builder.CreateStore(builder.getInt32(index.first->second),
+                              outermost->selector_));
+    if (llvm::find_if(cleanup.exits, [dest](const auto& exit) {
+          return exit.first == dest;
+        }) == cleanup.exits.end()) {
+      cleanup.exits.emplace_back(dest, depth);
+    }
+    builder.CreateBr(cleanup.block);
+  }
+
+  /// Branches to @param dest (the target of a `break` or `continue`)
+  /// through the cleanups pending above @param depth, ending the lifetimes
+  /// of the locals of the scopes left on the way, those within
+  /// @param outer (the scope around the loop)
+  static void branchOut(llvm::IRBuilder<>& builder,
+                        llvm::BasicBlock* const dest, const size_t depth,
+                        const Scope* const outer) {
+    small_vector<llvm::AllocaInst*> locals;
+    for (auto scope = get(builder); scope && scope != outer;
+         scope = scope->parent_) {
+      locals.append(scope->locals_.rbegin(), scope->locals_.rend());
+      if (scope->isFunctionScope()) {
+        break;
+      }
+    }
+    if (locals.empty()) {
+      branchThrough(builder, dest, depth);
+      return;
+    }
+    // the cleanups on the way may use the locals still
+    const auto func = builder.GetInsertBlock()->getParent();
+    const auto exit =
+        llvm::BasicBlock::Create(func->getContext(), "scope.exit", func);
+    branchThrough(builder, exit, depth);
+    const auto insertPt = builder.saveIP();
+    builder.SetInsertPoint(exit);
+    for (const auto local : locals) {
+      builder.CreateLifetimeEnd(local);
+    }
+    builder.CreateBr(dest);
+    builder.restoreIP(insertPt);
+  }
+
+  /// Emits @param stmt in a scope of its own unless it is a body (which
+  /// opens one), e.g. the unbraced branch of an `if` or arm of a `match`,
+  /// so that its defers and locals end with it
+  static llvm::Error codegen(llvm::IRBuilder<>& builder,
+                             const stmts::Stmt* const stmt) {
+    if (stmt->getKind() == stmts::Stmt::kBody) {
+      return stmt->codegen(builder);
+    }
+    Scope scope{builder};
+    if (auto err = stmt->codegen(builder)) {
+      return err;
+    }
+    if (auto err = scope.emitCleanups(builder)) {
+      return err;
+    }
+    scope.exit(builder);
+    return llvm::Error::success();
+  }
+
+  /// Emits the cleanups of this scope as control leaves it, leaving
+  /// @param builder where control falls through past the scope
+  llvm::Error emitCleanups(llvm::IRBuilder<>& builder) {
+    if (cleanups_.empty()) {
+      return llvm::Error::success();
+    }
+    auto& ctx = function_->getContext();
+    llvm::BasicBlock* cont = nullptr;
+    if (!builder.GetInsertBlock()->getTerminator()) {
+      cont = llvm::BasicBlock::Create(ctx, "cleanup.cont", function_);
+      branchThrough(builder, cont, base_);
+    }
+    while (!cleanups_.empty()) {
+      const auto cleanup = std::move(cleanups_.back());
+      cleanups_.pop_back();
+      if (!cleanup.block) {
+        continue; // no exit passes through it
+      }
+      cleanup.block->moveAfter(&function_->back());
+      builder.SetInsertPoint(cleanup.block);
+      if (auto err = cleanup.emit(builder)) {
+        return err;
+      }
+      if (builder.GetInsertBlock()->getTerminator()) {
+        continue;
+      }
+      const auto& exits = cleanup.exits;
+      if (exits.size() == 1) {
+        branchThrough(builder, exits[0].first, exits[0].second);
+        continue;
+      }
+      const auto outermost = functionScope();
+      const auto selector = align(builder.CreateLoad(outermost->selector_));
+      small_vector<llvm::BasicBlock*> hops;
+      for (size_t i = 0; i < exits.size(); ++i) {
+        hops.push_back(
+            llvm::BasicBlock::Create(ctx, "cleanup.dest", function_));
+      }
+      // the first destination takes the default
+      const auto switcher = builder.CreateSwitch(
+          selector, hops[0], static_cast<unsigned>(exits.size() - 1));
+      for (size_t i = 0; i < exits.size(); ++i) {
+        const auto& [dest, depth] = exits[i];
+        if (i > 0) {
+          switcher->addCase(builder.getInt32(outermost->destinations_[dest]),
+                            hops[i]);
+        }
+        builder.SetInsertPoint(hops[i]);
+        branchThrough(builder, dest, depth);
+      }
+    }
+    if (cont) {
+      cont->moveAfter(&function_->back());
+      builder.SetInsertPoint(cont);
+    }
+    return llvm::Error::success();
+  }
+
+  // a stack slot that lives throughout @param func
+  static llvm::AllocaInst* createEntryAlloca(llvm::Function* const func,
+                                             llvm::Type* const type,
+                                             const llvm::Twine& name) {
+    auto& entry = func->getEntryBlock();
+    auto insertPt = entry.begin();
+    while (insertPt != entry.end() && llvm::isa<llvm::AllocaInst>(*insertPt)) {
+      ++insertPt;
+    }
+    llvm::IRBuilder<> entryBuilder{&entry, insertPt};
+    const auto alloc = entryBuilder.CreateAlloca(type, 0, nullptr, name);
+    align(alloc);
+    return alloc;
+  }
+
+  static llvm::AllocaInst* createAlloca(llvm::IRBuilder<>& builder,
+                                        llvm::Type* const type,
+                                        const llvm::Twine& name) {
+    const auto func = builder.GetInsertBlock()->getParent();
+    const auto alloc = createEntryAlloca(func, type, name);
+    const auto scope = current();
+    if (scope && scope->function_ == func && !scope->isFunctionScope()) {
+      builder.CreateLifetimeStart(alloc);
+      scope->locals_.push_back(alloc);
+    }
+    return alloc;
+  }
+
+private:
+  struct Cleanup {
+    CleanupFn emit;
+    llvm::BasicBlock* block{nullptr};
+    // the destinations of exits through the cleanup, and their depths
+    small_vector<std::pair<llvm::BasicBlock*, size_t>> exits{};
+  };
+
+  llvm::Function* const function_;
+  Scope* const parent_;
+  const size_t base_;
+  small_vector<llvm::AllocaInst*> locals_;
+  small_vector<Cleanup> cleanups_;
+  // selector values of exit destinations (in the function scope)
+  llvm::AllocaInst* selector_{nullptr};
+  llvm::DenseMap<llvm::BasicBlock*, unsigned> destinations_;
+
+  inline size_t depth() const { return base_ + cleanups_.size(); }
+
+  static bool isLifetimeMarker(const llvm::Value* const value) {
+    const auto intrinsic = llvm::dyn_cast<llvm::IntrinsicInst>(value);
+    return intrinsic &&
+           (intrinsic->getIntrinsicID() == llvm::Intrinsic::lifetime_start ||
+            intrinsic->getIntrinsicID() == llvm::Intrinsic::lifetime_end);
+  }
+
+  // whether the address @param value (of a local) may be used once the
+  // scope is left: stored somewhere, or passed to a call
+  static bool escapes(const llvm::Value* const value) {
+    for (const auto user : value->users()) {
+      if (llvm::isa<llvm::LoadInst>(user) || isLifetimeMarker(user) ||
+          llvm::isa<llvm::MemIntrinsic>(user)) {
+        continue;
+      }
+      if (const auto store = llvm::dyn_cast<llvm::StoreInst>(user)) {
+        if (store->getValueOperand() == value) {
+          return true;
+        }
+        continue;
+      }
+      if (llvm::isa<llvm::BitCastInst>(user) ||
+          llvm::isa<llvm::GetElementPtrInst>(user)) {
+        if (escapes(user)) {
+          return true;
+        }
+        continue;
+      }
+      return true;
+    }
+    return false;
+  }
+
+  static void removeLifetimeMarkers(llvm::Value* const value) {
+    small_vector<llvm::Instruction*> markers;
+    for (const auto user : value->users()) {
+      if (isLifetimeMarker(user)) {
+        markers.push_back(llvm::cast<llvm::Instruction>(user));
+      } else if (const auto cast = llvm::dyn_cast<llvm::BitCastInst>(user)) {
+        for (const auto castUser : cast->users()) {
+          if (isLifetimeMarker(castUser)) {
+            markers.push_back(llvm::cast<llvm::Instruction>(castUser));
+          }
+        }
+      }
+    }
+    for (const auto marker : markers) {
+      const auto ptr = marker->getOperand(1);
+      marker->eraseFromParent();
+      if (ptr != value && ptr->use_empty()) {
+        llvm::cast<llvm::Instruction>(ptr)->eraseFromParent();
+      }
+    }
+  }
+
+  Scope* functionScope() {
+    auto scope = this;
+    while (!scope->isFunctionScope()) {
+      scope = scope->parent_;
+    }
+    return scope;
+  }
+
+  static Scope*& current() {
+    thread_local Scope* scope{nullptr};
+    return scope;
+  }
+};
+
+/// The targets of break and continue within a (possibly labeled) loop
+class LoopScope {
+public:
+  explicit LoopScope(const llvm::IRBuilder<>& builder,
+                     llvm::BasicBlock* const breakTarget,
+                     llvm::BasicBlock* const continueTarget,
+                     const llvm::StringRef label = "")
+      : function_{builder.GetInsertBlock()->getParent()}, parent_{current()},
+        break_{breakTarget}, continue_{continueTarget},
+        depth_{Scope::getCleanupDepth(builder)}, scope_{Scope::get(builder)},
+        label_{label} {
+    current() = this;
+  }
+
+  ~LoopScope() { current() = parent_; }
+
+  LoopScope(const LoopScope&) = delete;
+  LoopScope& operator=(const LoopScope&) = delete;
+
+  inline auto breakTarget() const { return break_; }
+  inline auto continueTarget() const { return continue_; }
+  // the cleanups pending around the loop (which break/continue keep)
+  inline auto cleanupDepth() const { return depth_; }
+  // the scope around the loop (whose locals break/continue keep)
+  inline auto scope() const { return scope_; }
+
+  // the innermost loop around the insertion point of @param builder,
+  // or the one labeled @param label (e.g. 'outer)
+  static const LoopScope* get(const llvm::IRBuilder<>& builder,
+                              const llvm::StringRef label = "") {
+    const auto func = builder.GetInsertBlock()->getParent();
+    for (auto loop = current(); loop && loop->function_ == func;
+         loop = loop->parent_) {
+      if (label.empty() || loop->label_ == label) {
+        return loop;
+      }
+    }
+    return nullptr;
+  }
+
+  // the label of loop statement @param ast (`'label: for ...`), or of
+  // the loop break/continue statement @param ast names, if any
+  static llvm::StringRef getLabel(const mpc_ast_t* const ast) {
+    for (auto i = 0; i < ast->children_num && i < 2; ++i) {
+      if (getInnermostAstTag(ast->children[i]) == "looplabel") {
+        return ast->children[i]->contents;
+      }
+    }
+    return "";
+  }
+
+private:
+  llvm::Function* const function_;
+  LoopScope* const parent_;
+  llvm::BasicBlock* const break_;
+  llvm::BasicBlock* const continue_;
+  const size_t depth_;
+  const Scope* const scope_;
+  const llvm::StringRef label_;
+
+  static LoopScope*& current() {
+    thread_local LoopScope* loop{nullptr};
+    return loop;
+  }
+};
+
+// creates a stack slot for a local or temporary in the current scope
+inline static llvm::AllocaInst* createAlloca(llvm::IRBuilder<>& builder,
+                                             llvm::Type* const type,
+                                             const llvm::Twine& name = "") {
+  return Scope::createAlloca(builder, type, name);
+}
+
+} // end namespace whack::codegen
+
+#endif // WHACK_SCOPE_HPP
@@ -18,6 +18,9 @@
 
 #pragma once
 
+#include "../aggregate.hpp"
+#include "../constants.hpp"
+
 namespace whack::codegen::stmts {
 
 class Assign final : public Stmt {
@@ -60,24 +63,35 @@ public:
       if (!v) {
         return v.takeError();
       }
-      auto variable = *v;
       // we discard the store
-      if (variable->getName() == "_") {
+      if ((*v)->getName() == "_") {
         return llvm::Error::success();
       }
-      if (hasMetadata(variable, llvm::LLVMContext::MD_dereferenceable)) {
-        variable = align(builder.CreateLoad(variable));
+      const auto variable = expressions::getAddress(builder, *v);
+      if (!variable) {
+        return error("cannot assign to an rvalue at line {}", state_.row + 1);
+      }
+      if (ConstantPool::isInPool(variable,
+                                 builder.GetInsertBlock()
+                                     ->getModule()
+                                     ->getDataLayout())) {
+        return error("cannot assign to an immutable value at line {}",
+                     state_.row + 1);
       }
       const auto varType = variable->getType()->getPointerElementType();
       if (value->getType() != varType) {
         return error("type mismatch: cannot assign at line {}", state_.row + 1);
       }
-      align(builder.CreateStore(value, variable));
+      aggregate::emitStore(builder, value, variable);
       return llvm::Error::success();
     };
 
     if (variables_.size() > exprList_.size()) {
-      auto v = exprList_[0]->codegen(builder);
+      auto e = exprList_[0]->codegen(builder);
+      if (!e) {
+        return e.takeError();
+      }
+      auto v = expressions::getLoadedValue(builder, *e);
       if (!v) {
         return v.takeError();
       }
@@ -98,14 +112,12 @@ public:
                      "(expected {}, got {})",
                      state_.row + 1, numExpected, variables_.size());
       }
+      small_vector<llvm::Value*> elements;
       for (size_t i = 0; i < variables_.size(); ++i) {
-        llvm::Value* val;
-        if (type->isStructTy()) {
-          val = builder.CreateExtractValue(value, i);
-        } else { // is array/vector
-          val = builder.CreateExtractElement(value, i);
-        }
-        if (auto err = store(val, variables_[i].get())) {
+        elements.push_back(aggregate::getElement(builder, value, i));
+      }
+      for (size_t i = 0; i < variables_.size(); ++i) {
+        if (auto err = store(elements[i], variables_[i].get())) {
           return err;
         }
       }
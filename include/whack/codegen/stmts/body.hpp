@@ -18,7 +18,9 @@
 
 #pragma once
 
+#include "../multiversion.hpp"
 #include "../tags.hpp"
+#include <llvm/Analysis/ValueTracking.h>
 
 namespace whack::codegen::stmts {
 
@@ -36,11 +38,16 @@ public:
   }
 
   llvm::Error codegen(llvm::IRBuilder<>& builder) const final {
+    Scope scope{builder};
     for (const auto& stmt : statements_) {
       if (auto err = stmt->codegen(builder)) {
         return err;
       }
     }
+    if (auto err = scope.emitCleanups(builder)) {
+      return err;
+    }
+    scope.exit(builder);
     return llvm::Error::success();
   }
 
@@ -53,28 +60,30 @@ public:
     return llvm::Error::success();
   }
 
-  inline static bool classof(const Stmt* const stmt) {
-    return stmt->getKind() == kBody;
-  }
-
-private:
-  const mpc_state_t state_;
-  std::unique_ptr<Tags> tags_;
-  small_vector<std::unique_ptr<Stmt>> statements_;
-
-  llvm::Error handleTags(llvm::IRBuilder<>& builder) const {
+  // applies tags such as @noinline or @target("avx2") to @param func
+  // whose body this is
+  llvm::Error handleFunctionTags(llvm::IRBuilder<>& builder,
+                                 llvm::Function* const func) const {
     static llvm::StringMap<llvm::Attribute::AttrKind> InternalTags{
         {"noinline", llvm::Attribute::AttrKind::NoInline},
         {"inline", llvm::Attribute::AttrKind::InlineHint},
         {"mustinline", llvm::Attribute::AttrKind::AlwaysInline},
         {"noreturn", llvm::Attribute::AttrKind::NoReturn}};
 
-    const auto func = builder.GetInsertBlock()->getParent();
+    if (!tags_) {
+      return llvm::Error::success();
+    }
     for (const auto& [name, args] : tags_->get()) {
       if (name.index() == 0) { // <scoperes>
         llvm_unreachable("not implemented!");
       } else { // <ident>
         const auto& tag = std::get<expressions::factors::Ident>(name).name();
+        if (tag == "target" || tag == "target_clones") {
+          if (auto err = this->handleTargetTag(builder, func, tag, args)) {
+            return err;
+          }
+          continue;
+        }
         if (!InternalTags.count(tag)) { // @todo: Other tag kinds
           return error("tag `{}` not implemented at line {}", tag,
                        state_.row + 1);
@@ -84,8 +93,139 @@ private:
     }
     return llvm::Error::success();
   }
+
+  // llvm.loop properties for the optimization hints on a loop body,
+  // e.g. @vectorize(8) or @(unroll(4), interleave(2))
+  llvm::Expected<small_vector<llvm::Metadata*>>
+  loopProperties(llvm::IRBuilder<>& builder) const {
+    small_vector<llvm::Metadata*> properties;
+    if (!tags_) {
+      return properties;
+    }
+    auto& ctx = builder.getContext();
+    const auto property = [&](const llvm::StringRef kind,
+                              std::optional<llvm::Constant*> value = {}) {
+      small_vector<llvm::Metadata*> operands{llvm::MDString::get(ctx, kind)};
+      if (value) {
+        operands.push_back(llvm::ConstantAsMetadata::get(value.value()));
+      }
+      properties.push_back(llvm::MDNode::get(ctx, operands));
+    };
+    for (const auto& [tagName, args] : tags_->get()) {
+      if (tagName.index() != 1) {
+        return error("invalid loop tag at line {}", state_.row + 1);
+      }
+      const auto& name =
+          std::get<expressions::factors::Ident>(tagName).name();
+      std::optional<uint64_t> count;
+      if (args) {
+        if (args->size() != 1) {
+          return error("loop tag `{}` expects a single count at line {}",
+                       name, state_.row + 1);
+        }
+        auto arg = args->front()->codegen(builder);
+        if (!arg) {
+          return arg.takeError();
+        }
+        const auto value = llvm::dyn_cast<llvm::ConstantInt>(*arg);
+        if (!value || value->isNegative() || value->isZero()) {
+          return error("loop tag `{}` expects a positive constant count "
+                       "at line {}",
+                       name, state_.row + 1);
+        }
+        count = value->getZExtValue();
+      }
+      const auto i32 = [&] {
+        return llvm::ConstantInt::get(BasicTypes["int"], count.value());
+      };
+      const auto enable = llvm::ConstantInt::getTrue(ctx);
+      if (name == "vectorize") {
+        if (count) {
+          property("llvm.loop.vectorize.width", i32());
+        }
+        // a width of 1 disables vectorization
+        property("llvm.loop.vectorize.enable",
+                 count == 1u ? llvm::ConstantInt::getFalse(ctx) : enable);
+      } else if (name == "interleave" && count) {
+        property("llvm.loop.interleave.count", i32());
+      } else if (name == "unroll") {
+        if (count) {
+          property("llvm.loop.unroll.count", i32());
+        } else {
+          property("llvm.loop.unroll.enable");
+        }
+      } else if (name == "nounroll" && !count) {
+        property("llvm.loop.unroll.disable");
+      } else if (name == "distribute" && !count) {
+        property("llvm.loop.distribute.enable", enable);
+      } else {
+        return error("invalid loop tag `{}` at line {}", name,
+                     state_.row + 1);
+      }
+    }
+    return properties;
+  }
+
+  inline static bool classof(const Stmt* const stmt) {
+    return stmt->getKind() == kBody;
+  }
+
+private:
+  /// @target("avx2", "fma") compiles @param func with those features
+  /// enabled; @target_clones("avx2", "default") compiles it for each
+  /// (see Multiversion)
+  llvm::Error
+  handleTargetTag(llvm::IRBuilder<>& builder, llvm::Function* const func,
+                  const llvm::StringRef tag,
+                  const std::optional<small_vector<expr_t>>& args) const {
+    if (!args || args->empty()) {
+      return error("tag `{}` expects target features at line {}", tag.str(),
+                   state_.row + 1);
+    }
+    small_vector<std::string> features;
+    for (const auto& arg : *args) {
+      auto value = arg->codegen(builder);
+      if (!value) {
+        return value.takeError();
+      }
+      llvm::StringRef feature;
+      if (!llvm::getConstantStringInfo(*value, feature)) {
+        return error("tag `{}` expects string literals at line {}",
+                     tag.str(), state_.row + 1);
+      }
+      if (tag == "target_clones" && feature != "default" &&
+          !Multiversion::getFeatureBit(feature)) {
+        return error("cannot select a clone by target feature `{}` "
+                     "at line {}",
+                     feature.str(), state_.row + 1);
+      }
+      features.push_back(feature.str());
+    }
+    if (tag == "target") {
+      for (const auto& feature : features) {
+        Multiversion::addTargetFeatures(func, feature);
+      }
+    } else {
+      addStructTypeMetadata(func->getParent(), "clones", func->getName(),
+                            features);
+    }
+    return llvm::Error::success();
+  }
+
+  const mpc_state_t state_;
+  std::unique_ptr<Tags> tags_;
+  small_vector<std::unique_ptr<Stmt>> statements_;
 };
 
+// the loop properties for @param body of a loop
+static llvm::Expected<small_vector<llvm::Metadata*>>
+getLoopProperties(llvm::IRBuilder<>& builder, const Stmt* const body) {
+  if (const auto block = llvm::dyn_cast<Body>(body)) {
+    return block->loopProperties(builder);
+  }
+  return small_vector<llvm::Metadata*>{};
+}
+
 } // end namespace whack::codegen::stmts
 
 #endif // WHACK_BODY_HPP
@@ -18,21 +18,27 @@
 
 #pragma once
 
-#include <llvm/IR/CFG.h>
-
 namespace whack::codegen::stmts {
 
 class Break final : public Stmt {
 public:
-  explicit constexpr Break(const mpc_ast_t* const ast) noexcept
-      : Stmt(kBreak), state_{ast->state} {}
+  explicit Break(const mpc_ast_t* const ast)
+      : Stmt(kBreak), state_{ast->state},
+        label_{LoopScope::getLabel(ast)} {}
 
   llvm::Error codegen(llvm::IRBuilder<>& builder) const final {
-    if (!handleBreak(builder, builder.GetInsertBlock())) {
+    const auto loop = LoopScope::get(builder, label_);
+    if (!loop && !label_.empty()) {
+      return error("could not find loop `{}` at line {}", label_.str(),
+                   state_.row + 1);
+    }
+    if (!loop) {
       return error("could not find a loop to break "
                    "out of at line {}",
                    state_.row + 1);
     }
+    Scope::branchOut(builder, loop->breakTarget(), loop->cleanupDepth(),
+                     loop->scope());
     return llvm::Error::success();
   }
 
@@ -42,39 +48,7 @@ public:
 
 private:
   const mpc_state_t state_;
-
-  static bool handleBreak(llvm::IRBuilder<>& builder,
-                          llvm::BasicBlock* const current) {
-    const auto currentName = current->getName();
-    for (const auto pred : llvm::predecessors(current)) {
-      llvm::BranchInst* branch = nullptr;
-      if (llvm::isa<llvm::BranchInst>(pred->back())) {
-        branch = &llvm::cast<llvm::BranchInst>(pred->back());
-      }
-      const auto name = pred->getName();
-      if (name.startswith("while") || name.startswith("for")) {
-        branch = llvm::cast<llvm::BranchInst>(
-            pred->getSinglePredecessor()->getTerminator());
-      }
-      if (branch) {
-        const auto succ0 = branch->getSuccessor(0);
-        const auto succ1 = branch->getSuccessor(1);
-        if (succ0->getName() == currentName) {
-          builder.CreateBr(succ1);
-          return true;
-        } else if (succ1->getName() == currentName) {
-          builder.CreateBr(succ0);
-          return true;
-        }
-      }
-      if (!llvm::pred_empty(pred)) {
-        if (handleBreak(builder, pred)) {
-          return true;
-        }
-      }
-    }
-    return false;
-  }
+  const llvm::StringRef label_;
 };
 
 } // end namespace whack::codegen::stmts
@@ -18,21 +18,27 @@
 
 #pragma once
 
-#include <llvm/IR/CFG.h>
-
 namespace whack::codegen::stmts {
 
 class Continue final : public Stmt {
 public:
-  explicit constexpr Continue(const mpc_ast_t* const ast) noexcept
-      : Stmt(kContinue), state_{ast->state} {}
+  explicit Continue(const mpc_ast_t* const ast)
+      : Stmt(kContinue), state_{ast->state},
+        label_{LoopScope::getLabel(ast)} {}
 
   llvm::Error codegen(llvm::IRBuilder<>& builder) const final {
-    if (!handleContinue(builder, builder.GetInsertBlock())) {
+    const auto loop = LoopScope::get(builder, label_);
+    if (!loop && !label_.empty()) {
+      return error("could not find loop `{}` at line {}", label_.str(),
+                   state_.row + 1);
+    }
+    if (!loop) {
       return error("could not find a loop to continue "
                    "with at line {}",
                    state_.row + 1);
     }
+    Scope::branchOut(builder, loop->continueTarget(), loop->cleanupDepth(),
+                     loop->scope());
     return llvm::Error::success();
   }
 
@@ -42,29 +48,7 @@ public:
 
 private:
   const mpc_state_t state_;
-
-  static bool handleContinue(llvm::IRBuilder<>& builder,
-                             llvm::BasicBlock* const current) {
-    const auto currentName = current->getName();
-    if (currentName.startswith("while") || currentName.startswith("for")) {
-      builder.CreateBr(current);
-      return true;
-    }
-    for (const auto pred : llvm::predecessors(current)) {
-      const auto name = pred->getName();
-      if (name.startswith("while") || name.startswith("for")) {
-        builder.CreateBr(pred);
-        return true;
-      } else {
-        if (!llvm::pred_empty(pred)) {
-          if (handleContinue(builder, pred)) {
-            return true;
-          }
-        }
-      }
-    }
-    return false;
-  }
+  const llvm::StringRef label_;
 };
 
 } // end namespace whack::codegen::stmts
@@ -0,0 +1,561 @@
+/**
+ * Copyright 2019-present Onchere Bironga
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef WHACK_DECISIONTREE_HPP
+#define WHACK_DECISIONTREE_HPP
+
+#include "../constants.hpp"
+#include <llvm/ADT/StringSet.h>
+#include <llvm/IR/CFG.h>
+#include <map>
+
+namespace whack::codegen {
+
+static std::optional<llvm::StringRef> getDataClassName(llvm::Type* const type) {
+  const auto structure = llvm::dyn_cast<llvm::StructType>(type);
+  if (!structure || !structure->hasName()) {
+    return std::nullopt;
+  }
+  auto name = structure->getName();
+  if (!name.consume_front("class::")) {
+    return std::nullopt;
+  }
+  return name;
+}
+
+/// Lowers the options of a match into a decision tree.
+/// Integral options (values and ranges) become a switch when they expand
+/// densely enough (which LLVM turns into jump tables or bit tests), else a
+/// binary search over the ranges. String options are dispatched on a hash
+/// of the subject, and data class options switch on the variant tag before
+/// testing payloads in option order.
+class DecisionTree {
+public:
+  // ranges in integral matches expand into at most this many switch cases
+  constexpr static uint64_t MaxSwitchCases = 1024;
+  // up to this many cases are tested linearly in a binary search leaf
+  constexpr static size_t MaxLinearCases = 3;
+  // matches over fewer strings than this compare them linearly
+  constexpr static size_t MinHashedStrings = 4;
+
+  static llvm::Error emit(llvm::IRBuilder<>& builder,
+                          const MatchInfo& matchInfo,
+                          llvm::ArrayRef<llvm::BasicBlock*> arms,
+                          llvm::BasicBlock* const defaultBlock) {
+    const auto type = matchInfo.Subject->getType();
+    if (const auto className = getDataClassName(type)) {
+      return emitVariants(builder, matchInfo, className.value(), arms,
+                          defaultBlock);
+    }
+
+    // a wildcard catches everything not matched by the options before it
+    rows_t rows;
+    auto catchAll = defaultBlock;
+    for (size_t i = 0; i < matchInfo.Options.size(); ++i) {
+      for (const auto& pattern : matchInfo.Options[i].first) {
+        if (catchAll != defaultBlock) {
+          warning("unreachable match option at line {}",
+                  pattern.State.row + 1);
+          continue;
+        }
+        if (pattern.Kind == MatchPattern::kWildcard) {
+          catchAll = arms[i];
+        } else {
+          rows.emplace_back(&pattern, arms[i]);
+        }
+      }
+    }
+
+    const auto is = [&](auto&& pred) {
+      return std::all_of(rows.begin(), rows.end(),
+                         [&](const auto& row) { return pred(*row.first); });
+    };
+    if (is([](const MatchPattern& pattern) {
+          return pattern.Kind == MatchPattern::kRange ||
+                 (pattern.Kind == MatchPattern::kValue &&
+                  llvm::isa<llvm::ConstantInt>(pattern.Value));
+        })) {
+      const auto hasDefault =
+          matchInfo.Default.has_value() || catchAll != defaultBlock;
+      return emitIntegrals(builder, matchInfo.Subject, rows, catchAll,
+                           hasDefault);
+    }
+    if (is([](const MatchPattern& pattern) {
+          return pattern.Kind == MatchPattern::kString;
+        })) {
+      return emitStrings(builder, matchInfo.Subject, rows, catchAll);
+    }
+    return emitComparisons(builder, matchInfo.Subject, rows, catchAll);
+  }
+
+  // binds the payload of the data class pattern in @param patterns
+  static llvm::Expected<small_vector<llvm::Value*>>
+  bind(llvm::IRBuilder<>& builder, const MatchInfo& matchInfo,
+       const small_vector<MatchPattern>& patterns) {
+    small_vector<llvm::Value*> bindings;
+    if (patterns.size() != 1 || patterns[0].Kind != MatchPattern::kVariant) {
+      return bindings;
+    }
+    const auto& pattern = patterns[0];
+    const auto variantType = pattern.VariantType;
+    llvm::Value* variant = nullptr;
+    for (size_t i = 0; i < pattern.Payload.size(); ++i) {
+      const auto& field = pattern.Payload[i];
+      if (field.Kind != MatchPattern::kBinding) {
+        continue;
+      }
+      if (auto err = expressions::factors::Ident::isUnique(builder,
+                                                           field.Binding)) {
+        return std::move(err);
+      }
+      if (!variant) {
+        variant = builder.CreateBitCast(matchInfo.SubjectAddress,
+                                        variantType->getPointerTo(0));
+      }
+      const auto ptr = builder.CreateStructGEP(variantType, variant, i + 1);
+      const auto value = align(builder.CreateLoad(ptr));
+      const auto alloc = createAlloca(builder, value->getType(), field.Binding);
+      builder.CreateStore(value, alloc);
+      bindings.push_back(alloc);
+    }
+    return bindings;
+  }
+
+  // takes the bindings from bind() out of scope
+  static void unbind(const small_vector<llvm::Value*>& bindings) {
+    for (const auto binding : bindings) {
+      binding->setName(".tmp." + binding->getName().str());
+    }
+  }
+
+private:
+  using row_t = std::pair<const MatchPattern*, llvm::BasicBlock*>;
+  using rows_t = small_vector<row_t>;
+
+  struct Case {
+    llvm::APInt Low, High;
+    llvm::BasicBlock* Dest;
+  };
+
+  static llvm::BasicBlock* createBlock(llvm::IRBuilder<>& builder,
+                                       const llvm::StringRef name) {
+    const auto func = builder.GetInsertBlock()->getParent();
+    return llvm::BasicBlock::Create(func->getContext(), name, func);
+  }
+
+  static llvm::BasicBlock* createUnreachable(llvm::IRBuilder<>& builder) {
+    const auto block = createBlock(builder, "unreachable");
+    llvm::IRBuilder<>{block}.CreateUnreachable();
+    return block;
+  }
+
+  // tests low <= subject <= high with a single unsigned compare
+  static llvm::Value* inRange(llvm::IRBuilder<>& builder,
+                              llvm::Value* const subject,
+                              const llvm::APInt& low, const llvm::APInt& high) {
+    auto& ctx = builder.getContext();
+    if (low == high) {
+      return builder.CreateICmpEQ(subject, llvm::ConstantInt::get(ctx, low));
+    }
+    const auto offset =
+        builder.CreateSub(subject, llvm::ConstantInt::get(ctx, low));
+    return builder.CreateICmpULE(offset,
+                                 llvm::ConstantInt::get(ctx, high - low));
+  }
+
+  static llvm::Error emitIntegrals(llvm::IRBuilder<>& builder,
+                                   llvm::Value* const subject,
+                                   const rows_t& rows,
+                                   llvm::BasicBlock* const catchAll,
+                                   const bool hasDefault) {
+    // disjoint cases sorted by their lower bound, where earlier options
+    // take precedence over the overlapping parts of later ones
+    std::vector<Case> cases;
+    for (const auto& [pattern, dest] : rows) {
+      const auto& low =
+          pattern->Kind == MatchPattern::kRange
+              ? pattern->Low
+              : llvm::cast<llvm::ConstantInt>(pattern->Value)->getValue();
+      const auto& high =
+          pattern->Kind == MatchPattern::kRange
+              ? pattern->High
+              : llvm::cast<llvm::ConstantInt>(pattern->Value)->getValue();
+      small_vector<std::pair<llvm::APInt, llvm::APInt>> uncovered;
+      auto current = low;
+      bool covered = false;
+      for (const auto& c : cases) {
+        if (c.High.slt(current)) {
+          continue;
+        }
+        if (c.Low.sgt(high)) {
+          break;
+        }
+        if (c.Low.sgt(current)) {
+          uncovered.emplace_back(current, c.Low - 1);
+        }
+        if (c.High.sge(high)) {
+          covered = true;
+          break;
+        }
+        current = c.High + 1;
+      }
+      if (!covered) {
+        uncovered.emplace_back(current, high);
+      }
+      if (uncovered.empty()) {
+        if (pattern->Kind == MatchPattern::kValue) {
+          return error("duplicate option for match at line {}",
+                       pattern->State.row + 1);
+        }
+        warning("unreachable match option at line {}", pattern->State.row + 1);
+        continue;
+      }
+      for (auto& [lo, hi] : uncovered) {
+        cases.push_back(Case{std::move(lo), std::move(hi), dest});
+      }
+      std::sort(cases.begin(), cases.end(), [](const Case& a, const Case& b) {
+        return a.Low.slt(b.Low);
+      });
+    }
+
+    // merge neighbouring cases going to the same option
+    std::vector<Case> merged;
+    for (auto& c : cases) {
+      if (!merged.empty()) {
+        auto& last = merged.back();
+        if (last.Dest == c.Dest && !last.High.isMaxSignedValue() &&
+            last.High + 1 == c.Low) {
+          last.High = c.High;
+          continue;
+        }
+      }
+      merged.emplace_back(std::move(c));
+    }
+
+    if (merged.empty()) {
+      builder.CreateBr(catchAll);
+      return llvm::Error::success();
+    }
+
+    // options covering every value of the subject make the default dead
+    bool exhaustive = merged.front().Low.isMinSignedValue() &&
+                      merged.back().High.isMaxSignedValue();
+    for (size_t i = 1; exhaustive && i < merged.size(); ++i) {
+      exhaustive = merged[i - 1].High + 1 == merged[i].Low;
+    }
+    const auto fallback =
+        exhaustive && !hasDefault ? createUnreachable(builder) : catchAll;
+
+    uint64_t numCases = 0;
+    for (const auto& c : merged) {
+      numCases += (c.High - c.Low).getLimitedValue(MaxSwitchCases) + 1;
+      if (numCases > MaxSwitchCases) {
+        break;
+      }
+    }
+    if (numCases <= MaxSwitchCases) {
+      auto& ctx = builder.getContext();
+      const auto switcher = builder.CreateSwitch(subject, fallback, numCases);
+      for (const auto& c : merged) {
+        for (auto value = c.Low;; ++value) {
+          switcher->addCase(llvm::ConstantInt::get(ctx, value), c.Dest);
+          if (value == c.High) {
+            break;
+          }
+        }
+      }
+      return llvm::Error::success();
+    }
+    emitBinarySearch(builder, subject, merged, fallback);
+    return llvm::Error::success();
+  }
+
+  static void emitBinarySearch(llvm::IRBuilder<>& builder,
+                               llvm::Value* const subject,
+                               llvm::ArrayRef<Case> cases,
+                               llvm::BasicBlock* const fallback) {
+    if (cases.size() <= MaxLinearCases) {
+      for (const auto& c : cases) {
+        const auto next = createBlock(builder, "match.next");
+        builder.CreateCondBr(inRange(builder, subject, c.Low, c.High), c.Dest,
+                             next);
+        builder.SetInsertPoint(next);
+      }
+      builder.CreateBr(fallback);
+      return;
+    }
+    const auto mid = cases.size() / 2;
+    const auto lower = createBlock(builder, "match.lt");
+    const auto upper = createBlock(builder, "match.ge");
+    const auto pivot =
+        llvm::ConstantInt::get(builder.getContext(), cases[mid].Low);
+    builder.CreateCondBr(builder.CreateICmpSLT(subject, pivot), lower, upper);
+    builder.SetInsertPoint(lower);
+    emitBinarySearch(builder, subject, cases.take_front(mid), fallback);
+    builder.SetInsertPoint(upper);
+    emitBinarySearch(builder, subject, cases.drop_front(mid), fallback);
+  }
+
+  // must match __builtin_strhash in the runtime (64-bit FNV-1a)
+  static uint64_t hashString(const llvm::StringRef str) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const auto c : str) {
+      hash ^= static_cast<uint8_t>(c);
+      hash *= 1099511628211ULL;
+    }
+    return hash;
+  }
+
+  static llvm::Value* stringEquals(llvm::IRBuilder<>& builder,
+                                   llvm::Value* const subject,
+                                   const llvm::StringRef str) {
+    const auto module = builder.GetInsertBlock()->getModule();
+    const auto charPtrTy = BasicTypes["char"]->getPointerTo(0);
+    const auto strcmp = module->getOrInsertFunction(
+        "strcmp", llvm::FunctionType::get(BasicTypes["int"],
+                                          {charPtrTy, charPtrTy}, false));
+    const auto cmp = builder.CreateCall(
+        strcmp, {subject, ConstantPool::getString(module, str)});
+    return builder.CreateICmpEQ(cmp, llvm::ConstantInt::get(cmp->getType(), 0));
+  }
+
+  static void emitStringChain(llvm::IRBuilder<>& builder,
+                              llvm::Value* const subject,
+                              llvm::ArrayRef<row_t> rows,
+                              llvm::BasicBlock* const fallback) {
+    for (const auto& [pattern, dest] : rows) {
+      const auto next = createBlock(builder, "match.next");
+      builder.CreateCondBr(stringEquals(builder, subject, pattern->String),
+                           dest, next);
+      builder.SetInsertPoint(next);
+    }
+    builder.CreateBr(fallback);
+  }
+
+  static llvm::Error emitStrings(llvm::IRBuilder<>& builder,
+                                 llvm::Value* const subject,
+                                 const rows_t& rows,
+                                 llvm::BasicBlock* const catchAll) {
+    llvm::StringSet<> seen;
+    for (const auto& [pattern, _] : rows) {
+      if (!seen.insert(pattern->String).second) {
+        return error("duplicate option for match at line {}",
+                     pattern->State.row + 1);
+      }
+    }
+    // a null subject matches no string (and must not be hashed or compared)
+    const auto nonNull = createBlock(builder, "match.nonnull");
+    builder.CreateCondBr(builder.CreateIsNull(subject), catchAll, nonNull);
+    builder.SetInsertPoint(nonNull);
+    if (rows.size() < MinHashedStrings) {
+      emitStringChain(builder, subject, rows, catchAll);
+      return llvm::Error::success();
+    }
+
+    // options sharing a hash are told apart by comparing them in order
+    std::map<uint64_t, rows_t> buckets;
+    for (const auto& row : rows) {
+      buckets[hashString(row.first->String)].push_back(row);
+    }
+    const auto module = builder.GetInsertBlock()->getModule();
+    const auto int64Ty = llvm::Type::getInt64Ty(builder.getContext());
+    const auto hasher = module->getOrInsertFunction(
+        "__builtin_strhash",
+        llvm::FunctionType::get(int64Ty, {BasicTypes["char"]->getPointerTo(0)},
+                                false));
+    const auto hash = builder.CreateCall(hasher, subject);
+    const auto switcher = builder.CreateSwitch(hash, catchAll, buckets.size());
+    for (const auto& [value, bucket] : buckets) {
+      const auto block = createBlock(builder, "match.hash");
+      switcher->addCase(llvm::ConstantInt::get(int64Ty, value), block);
+      builder.SetInsertPoint(block);
+      emitStringChain(builder, subject, bucket, catchAll);
+    }
+    return llvm::Error::success();
+  }
+
+  static llvm::Expected<llvm::Value*> test(llvm::IRBuilder<>& builder,
+                                           llvm::Value* const subject,
+                                           const MatchPattern& pattern) {
+    switch (pattern.Kind) {
+    case MatchPattern::kValue:
+      return expressions::operators::getEquality(builder, subject, "==",
+                                                 pattern.Value);
+    case MatchPattern::kRange:
+      return inRange(builder, subject, pattern.Low, pattern.High);
+    case MatchPattern::kString:
+      return stringEquals(builder, subject, pattern.String);
+    case MatchPattern::kBinding:
+    case MatchPattern::kWildcard:
+      return builder.getTrue();
+    default:
+      return error("invalid match option at line {}", pattern.State.row + 1);
+    }
+  }
+
+  static llvm::Error emitComparisons(llvm::IRBuilder<>& builder,
+                                     llvm::Value* const subject,
+                                     const rows_t& rows,
+                                     llvm::BasicBlock* const catchAll) {
+    for (const auto& [pattern, dest] : rows) {
+      if (pattern->Kind == MatchPattern::kString) {
+        return error("cannot mix string and non-string match options "
+                     "at line {}",
+                     pattern->State.row + 1);
+      }
+      auto cond = test(builder, subject, *pattern);
+      if (!cond) {
+        return cond.takeError();
+      }
+      const auto next = createBlock(builder, "match.next");
+      builder.CreateCondBr(*cond, dest, next);
+      builder.SetInsertPoint(next);
+    }
+    builder.CreateBr(catchAll);
+    return llvm::Error::success();
+  }
+
+  static bool isIrrefutable(const MatchPattern& pattern) {
+    return std::all_of(pattern.Payload.begin(), pattern.Payload.end(),
+                       [](const MatchPattern& field) {
+                         return field.Kind == MatchPattern::kBinding ||
+                                field.Kind == MatchPattern::kWildcard;
+                       });
+  }
+
+  static llvm::Error emitVariants(llvm::IRBuilder<>& builder,
+                                  const MatchInfo& matchInfo,
+                                  const llvm::StringRef className,
+                                  llvm::ArrayRef<llvm::BasicBlock*> arms,
+                                  llvm::BasicBlock* const defaultBlock) {
+    const auto subject = matchInfo.Subject;
+    const auto module = builder.GetInsertBlock()->getModule();
+    const auto variants = getMetadataParts(*module, "classes", className);
+
+    std::vector<rows_t> rows(variants.size());
+    auto catchAll = defaultBlock;
+    bool hasWildcard = false;
+    for (size_t i = 0; i < matchInfo.Options.size(); ++i) {
+      for (const auto& pattern : matchInfo.Options[i].first) {
+        if (hasWildcard) {
+          warning("unreachable match option at line {}",
+                  pattern.State.row + 1);
+          continue;
+        }
+        if (pattern.Kind == MatchPattern::kWildcard) {
+          catchAll = arms[i];
+          hasWildcard = true;
+          continue;
+        }
+        auto& variantRows = rows[pattern.Variant];
+        if (!variantRows.empty() && isIrrefutable(*variantRows.back().first)) {
+          warning("unreachable match option at line {}",
+                  pattern.State.row + 1);
+          continue;
+        }
+        variantRows.emplace_back(&pattern, arms[i]);
+      }
+    }
+
+    small_vector<llvm::StringRef> missing;
+    for (size_t v = 0; v < variants.size(); ++v) {
+      if (rows[v].empty() || !isIrrefutable(*rows[v].back().first)) {
+        missing.push_back(variants[v]);
+      }
+    }
+    if (!missing.empty() && !hasWildcard && !matchInfo.Default) {
+      std::string names;
+      for (size_t i = 0; i < missing.size(); ++i) {
+        names += format("{}`{}::{}`", i ? ", " : "", className.str(),
+                        missing[i].str());
+      }
+      return error("non-exhaustive match on data class `{}` (missing {}) "
+                   "at line {}",
+                   className.str(), names, matchInfo.State.row + 1);
+    }
+    if (missing.empty() && hasWildcard) {
+      warning("unreachable wildcard in match at line {}",
+              matchInfo.State.row + 1);
+    }
+    const auto fallback = missing.empty() && !matchInfo.Default
+                              ? createUnreachable(builder)
+                              : catchAll;
+
+    const auto tag = builder.CreateExtractValue(subject, 0);
+    const auto tagType = llvm::cast<llvm::IntegerType>(tag->getType());
+    const auto switcher = builder.CreateSwitch(tag, fallback, variants.size());
+    for (size_t v = 0; v < variants.size(); ++v) {
+      if (rows[v].empty()) {
+        continue;
+      }
+      const auto block = createBlock(builder, "match.variant");
+      switcher->addCase(llvm::ConstantInt::get(tagType, v), block);
+      builder.SetInsertPoint(block);
+      bool terminated = false;
+      for (const auto& [pattern, dest] : rows[v]) {
+        if (isIrrefutable(*pattern)) {
+          builder.CreateBr(dest);
+          terminated = true;
+          break;
+        }
+        const auto variantType = pattern->VariantType;
+        const auto variant = builder.CreateBitCast(
+            matchInfo.SubjectAddress, variantType->getPointerTo(0));
+        llvm::Value* cond = builder.getTrue();
+        for (size_t i = 0; i < pattern->Payload.size(); ++i) {
+          const auto& field = pattern->Payload[i];
+          if (field.Kind == MatchPattern::kBinding ||
+              field.Kind == MatchPattern::kWildcard) {
+            continue;
+          }
+          const auto ptr = builder.CreateStructGEP(variantType, variant, i + 1);
+          auto fieldCond = test(builder, align(builder.CreateLoad(ptr)), field);
+          if (!fieldCond) {
+            return fieldCond.takeError();
+          }
+          cond = builder.CreateAnd(cond, *fieldCond);
+        }
+        const auto next = createBlock(builder, "match.next");
+        builder.CreateCondBr(cond, dest, next);
+        builder.SetInsertPoint(next);
+      }
+      if (!terminated) {
+        builder.CreateBr(catchAll);
+      }
+    }
+    return llvm::Error::success();
+  }
+};
+
+static llvm::Error emitMatchDispatch(llvm::IRBuilder<>& builder,
+                                     const MatchInfo& matchInfo,
+                                     llvm::ArrayRef<llvm::BasicBlock*> arms,
+                                     llvm::BasicBlock* const defaultBlock) {
+  return DecisionTree::emit(builder, matchInfo, arms, defaultBlock);
+}
+
+static llvm::Expected<small_vector<llvm::Value*>>
+bindMatchPayload(llvm::IRBuilder<>& builder, const MatchInfo& matchInfo,
+                 const small_vector<MatchPattern>& patterns) {
+  return DecisionTree::bind(builder, matchInfo, patterns);
+}
+
+static void unbindMatchPayload(const small_vector<llvm::Value*>& bindings) {
+  DecisionTree::unbind(bindings);
+}
+
+} // end namespace whack::codegen
+
+#endif // WHACK_DECISIONTREE_HPP
@@ -18,6 +18,7 @@
 
 #pragma once
 
+#include "../aggregate.hpp"
 #include "../expressions/factors/initializer.hpp"
 #include <llvm/IR/MDBuilder.h>
 
@@ -65,13 +66,22 @@ public:
           if (!init) {
             return init.takeError();
           }
-          (*init)->setName(var);
+          if (llvm::isa<llvm::AllocaInst>(*init)) {
+            (*init)->setName(var);
+          } else {
+            aggregate::emitStore(builder, *init,
+                                 createAlloca(builder, type, var));
+          }
           found = true;
           break;
         }
       }
       if (!found) {
-        builder.CreateAlloca(type, 0, nullptr, var);
+        const auto alloc = createAlloca(builder, type, var);
+        if (type->isStructTy() && Arena::isa(alloc)) { // starts out empty
+          align(builder.CreateStore(llvm::Constant::getNullValue(type),
+                                    alloc));
+        }
       }
     }
     return llvm::Error::success();
@@ -18,50 +18,23 @@
 
 #pragma once
 
-#include <llvm/IR/CFG.h>
-
 namespace whack::codegen::stmts {
 
+/// Runs a statement whenever control leaves the enclosing scope (falling
+/// off its end, or via return, break or continue), in reverse order of
+/// the defers
 class Defer final : public Stmt {
 public:
   explicit Defer(const mpc_ast_t* const ast)
-      : Stmt(kDefer), stmt_{getStmt(ast->children[1])} {}
+      : Stmt(kDefer), state_{ast->state}, stmt_{getStmt(ast->children[1])} {}
 
   inline llvm::Error codegen(llvm::IRBuilder<>& builder) const final {
-    deferBlock_ = builder.GetInsertBlock();
-    return llvm::Error::success();
-  }
-
-  llvm::Error runScopeExit(llvm::IRBuilder<>& builder) const final {
-    llvm::SmallPtrSet<llvm::BasicBlock* const, 10> terminators;
-    std::function<void(llvm::BasicBlock* const)> apply;
-    apply = [&](llvm::BasicBlock* const block) {
-      if (llvm::succ_empty(block)) {
-        terminators.insert(block);
-        return;
-      }
-      for (const auto successor : llvm::successors(block)) {
-        apply(successor);
-      }
-    };
-    apply(deferBlock_);
-    const auto run = [&](llvm::BasicBlock* const block) -> llvm::Error {
-      auto& back = block->back();
-      if (back.isTerminator()) {
-        builder.SetInsertPoint(&back);
-      } else {
-        builder.SetInsertPoint(block);
-      }
-      if (auto err = stmt_->codegen(builder)) {
-        return err;
-      }
-      return stmt_->runScopeExit(builder);
-    };
-    for (const auto block : terminators) {
-      if (auto err = run(block)) {
-        return err;
-      }
+    const auto scope = Scope::get(builder);
+    if (!scope) {
+      return error("cannot defer outside of a function at line {}",
+                   state_.row + 1);
     }
+    scope->pushCleanup(stmt_.get());
     return llvm::Error::success();
   }
 
@@ -70,8 +43,8 @@ public:
   }
 
 private:
+  const mpc_state_t state_;
   std::unique_ptr<Stmt> stmt_;
-  mutable llvm::BasicBlock* deferBlock_;
 };
 
 } // end namespace whack::codegen::stmts
@@ -34,17 +34,35 @@ public:
         return e.takeError();
       }
       auto source = *e;
-      if (llvm::isa<llvm::AllocaInst>(source)) {
-        source = builder.CreateLoad(source);
+      if (isLValue(source)) {
+        source = align(builder.CreateLoad(source));
       }
       if (!source->getType()->isPointerTy()) {
         return error("invalid type for operator delete at line {}",
                      state_.row + 1);
       }
+      // arena memory is released with its arena: memory we cannot tell
+      // came from an arena (e.g. through a parameter) is the heap's
+      if (Arena::isArenaMemory(source)) {
+        continue;
+      }
+      const auto module = block->getModule();
+      llvm::IRBuilder<> deleter{block};
+      if (!block->empty() && block->back().isTerminator()) {
+        deleter.SetInsertPoint(&block->back());
+      }
+      if (isOverAligned(module, source->getType()->getPointerElementType())) {
+        const auto charPtrTy = BasicTypes["char"]->getPointerTo(0);
+        deleter.CreateCall(
+            module->getOrInsertFunction("__builtin_aligned_free",
+                                        BasicTypes["void"], charPtrTy),
+            deleter.CreateBitCast(source, charPtrTy));
+        continue;
+      }
       if (!block->empty() && block->back().isTerminator()) {
         (void)llvm::CallInst::CreateFree(source, &block->back());
       } else {
-        builder.Insert(llvm::CallInst::CreateFree(source, block));
+        deleter.Insert(llvm::CallInst::CreateFree(source, block));
       }
     }
     return llvm::Error::success();
@@ -1,5 +1,5 @@
 /**
- * Copyright 2018 Onchere Bironga
+ * Copyright 2018-present Onchere Bironga
  *
  * Licensed under the Apache License, Version 2.0 (the "License");
  * you may not use this file except in compliance with the License.
@@ -18,29 +18,32 @@
 
 #pragma once
 
-#include "ast.hpp"
-#include "condition.hpp"
-#include "range.hpp"
+#include "../expressions/range.hpp"
 
 namespace whack::codegen::stmts {
 
+/// `for <identlist> in <factor> (if <logicalor>)?`
 class ForInExpr final : public AST {
 public:
   explicit ForInExpr(const mpc_ast_t* const ast)
-      : identList_{getIdentList(ast->children[1])}, range_{ast->children[3]} {
+      : state_{ast->state}, identList_{getIdentList(ast->children[1])},
+        iterable_{ast->children[3]} {
     if (ast->children_num > 4) {
-      condition_ = std::make_unique<Condition>(ast->children[5]);
+      filter_ = std::make_unique<expressions::operators::LogicalOr>(
+          ast->children[5]);
     }
   }
 
+  inline const auto& state() const { return state_; }
   inline const auto& identList() const { return identList_; }
-  inline const auto& range() const { return range_; }
-  inline const auto& condition() const { return condition_; }
+  inline const auto iterable() const { return iterable_; }
+  inline const auto& filter() const { return filter_; }
 
 private:
-  ident_list_t identList_;
-  Range range_;
-  std::unique_ptr<LogicalOr> condition_;
+  const mpc_state_t state_;
+  const ident_list_t identList_;
+  const mpc_ast_t* const iterable_;
+  std::unique_ptr<expressions::operators::LogicalOr> filter_;
 };
 
 } // end namespace whack::codegen::stmts
@@ -1,5 +1,5 @@
 /**
- * Copyright 2018 Onchere Bironga
+ * Copyright 2018-present Onchere Bironga
  *
  * Licensed under the Apache License, Version 2.0 (the "License");
  * you may not use this file except in compliance with the License.
@@ -18,93 +18,454 @@
 
 #pragma once
 
+#include "../coroutine.hpp"
+#include "forinexpr.hpp"
+#include "let.hpp"
 #include <folly/ScopeGuard.h>
 #include <llvm/IR/ValueSymbolTable.h>
 
 namespace whack::codegen::stmts {
 
+/// Loops are emitted in canonical form: a header holding the exit test,
+/// the body, and a single latch whose backedge carries llvm.loop metadata,
+/// so that IndVarSimplify and the loop vectorizer recognize them.
 class For final : public Stmt {
   class ForIncrExpr {
   public:
-    explicit ForIncrExpr(const mpc_ast_t* const ast)
-        : let{ast->children[1]}, comparison{ast->children[2]} {
-      for (auto i = 4; i < ast->children_num; i += 2) {
-        const auto incr = ast->children[i];
-        if (getInnermostAstTag(incr) == "preop") {
-          steps.emplace_back(std::make_unique<PreOpStmt>(incr));
-        } else { // <postop>
-          steps.emplace_back(std::make_unique<PostOpStmt>(incr));
+    explicit ForIncrExpr(const mpc_ast_t* const ast) {
+      auto semi = ast->children_num - 1;
+      while (!isSemicolon(ast->children[semi])) {
+        --semi;
+      }
+      condition = std::make_unique<expressions::operators::LogicalOr>(
+          ast->children[semi - 1]);
+      for (auto i = 1; i < semi - 1; ++i) {
+        if (!isSemicolon(ast->children[i])) {
+          init.emplace_back(getStmt(ast->children[i]));
         }
       }
+      for (auto i = semi + 1; i < ast->children_num; ++i) {
+        steps.emplace_back(getStmt(ast->children[i]));
+      }
     }
 
   private:
     friend class For;
-    const Let let;
-    const Comparison comparison;
+    small_vector<std::unique_ptr<Stmt>> init;
+    std::unique_ptr<expressions::operators::LogicalOr> condition;
     small_vector<std::unique_ptr<Stmt>> steps;
+
+    inline static bool isSemicolon(const mpc_ast_t* const ast) {
+      return !ast->children_num && std::string_view(ast->contents) == ";";
+    }
   };
 
 public:
   explicit For(const mpc_ast_t* const ast)
-      : Stmt(kFor), expr_{ast->children[0]}, stmt_{getStmt(ast->children[1])} {}
+      : Stmt(kFor), label_{LoopScope::getLabel(ast)},
+        expr_{ast->children[label_.empty() ? 0 : 2]},
+        stmt_{getStmt(ast->children[label_.empty() ? 1 : 3])} {}
 
   llvm::Error codegen(llvm::IRBuilder<>& builder) const final {
-    const auto func = builder.GetInsertBlock()->getParent();
-    auto& ctx = func->getContext();
     if (getInnermostAstTag(expr_) == "forinexpr") {
-      return error("forinexpr not implemented at line {}",
-                   expr_->state.row + 1);
-    } else { // <forincrexpr>
-      const auto body = llvm::BasicBlock::Create(ctx, "for", func);
-      const auto cont = llvm::BasicBlock::Create(ctx, "cont", func);
-      const ForIncrExpr expr{expr_};
-      if (auto err = expr.let.codegen(builder)) {
+      return codegenForIn(builder);
+    }
+    return codegenForIncr(builder); // <forincrexpr>
+  }
+
+  inline llvm::Error runScopeExit(llvm::IRBuilder<>& builder) const final {
+    const llvm::IRBuilder<>::InsertPointGuard guard{builder};
+    builder.SetInsertPoint(cont_);
+    return stmt_->runScopeExit(builder);
+  }
+
+  inline static bool classof(const Stmt* const stmt) {
+    return stmt->getKind() == kFor;
+  }
+
+private:
+  const llvm::StringRef label_;
+  const mpc_ast_t* const expr_;
+  std::unique_ptr<Stmt> stmt_;
+  mutable llvm::BasicBlock* cont_;
+
+  llvm::Error codegenForIn(llvm::IRBuilder<>& builder) const {
+    const ForInExpr expr{expr_};
+    if (expressions::Range::isa(expr.iterable())) {
+      return codegenRange(builder, expr);
+    }
+    return codegenGenerator(builder, expr);
+  }
+
+  // for i in begin..step..end (if filter)?
+  llvm::Error codegenRange(llvm::IRBuilder<>& builder,
+                           const ForInExpr& expr) const {
+    using namespace expressions;
+    const auto line = expr.state().row + 1;
+    if (expr.identList().size() != 1) {
+      return error("expected a single loop variable at line {}", line);
+    }
+    const Range range{expr.iterable()};
+    const auto name = expr.identList()[0];
+    if (name != "_") {
+      if (auto err = factors::Ident::isUnique(builder, name)) {
         return err;
       }
-      SCOPE_EXIT {
-        const auto symTbl = builder.GetInsertBlock()->getValueSymbolTable();
-        for (const auto& var : expr.let.variables()) {
-          const auto alloc = symTbl->lookup(var);
-          // we restrict scope of let variables via renaming
-          alloc->setName(".tmp." + alloc->getName().str());
-        }
-      };
-      auto comparison = expr.comparison.codegen(builder);
-      if (!comparison) {
-        return comparison.takeError();
+    }
+
+    auto begin = range.begin(builder);
+    if (!begin) {
+      return begin.takeError();
+    }
+    const auto type = (*begin)->getType();
+    llvm::Value* step = llvm::ConstantInt::get(type, 1);
+    if (range.hasStep()) {
+      auto s = range.step(builder);
+      if (!s) {
+        return s.takeError();
       }
-      builder.CreateCondBr(*comparison, body, cont);
-      builder.SetInsertPoint(body);
-      if (auto err = stmt_->codegen(builder)) {
+      step = builder.CreateSExtOrTrunc(*s, type);
+      if (const auto c = llvm::dyn_cast<llvm::ConstantInt>(step);
+          c && c->isZero()) {
+        return error("range step cannot be zero at line {}", line);
+      }
+    }
+    llvm::Value* end = nullptr;
+    if (range.hasEnd()) {
+      auto e = range.end(builder);
+      if (!e) {
+        return e.takeError();
+      }
+      end = builder.CreateSExtOrTrunc(*e, type);
+    }
+
+    auto properties = getLoopProperties(builder, stmt_.get());
+    if (!properties) {
+      return properties.takeError();
+    }
+
+    const auto preheader = builder.GetInsertBlock();
+    const auto func = preheader->getParent();
+    auto& ctx = func->getContext();
+    const auto header = llvm::BasicBlock::Create(ctx, "for.cond", func);
+    const auto body = llvm::BasicBlock::Create(ctx, "for", func);
+    const auto latch = llvm::BasicBlock::Create(ctx, "for.latch", func);
+    cont_ = llvm::BasicBlock::Create(ctx, "cont", func);
+
+    builder.CreateBr(header);
+    builder.SetInsertPoint(header);
+    const auto iv = builder.CreatePHI(type, 2, name == "_" ? "" : name);
+    iv->addIncoming(*begin, preheader);
+    if (end) {
+      builder.CreateCondBr(
+          exitTest(builder, iv, end, step, range.endInclusive()), body,
+          cont_);
+    } else {
+      builder.CreateBr(body);
+    }
+
+    builder.SetInsertPoint(body);
+    if (auto err = codegenFilter(builder, expr, latch)) {
+      return err;
+    }
+    if (auto err = codegenBody(builder, cont_, latch)) {
+      return err;
+    }
+
+    builder.SetInsertPoint(latch);
+    llvm::Value* next;
+    if (end) {
+      // past the last value, iv + step might overflow: we leave first
+      if (!isUnitStep(step) || range.endInclusive()) {
+        const auto increment =
+            llvm::BasicBlock::Create(ctx, "for.inc", func);
+        builder.CreateCondBr(
+            hasNext(builder, iv, end, step, range.endInclusive()), increment,
+            cont_);
+        builder.SetInsertPoint(increment);
+      }
+      next = builder.CreateNSWAdd(iv, step);
+    } else {
+      next = builder.CreateAdd(iv, step); // unbounded: it wraps
+    }
+    iv->addIncoming(next, builder.GetInsertBlock());
+    createBackedge(builder, header, *properties);
+    cont_->moveAfter(builder.GetInsertBlock());
+    builder.SetInsertPoint(cont_);
+    if (iv->hasName()) {
+      // we restrict scope of the loop variable via renaming
+      iv->setName(".tmp." + iv->getName().str());
+    }
+    return llvm::Error::success();
+  }
+
+  // for x, y in generator(...) (if filter)?
+  llvm::Error codegenGenerator(llvm::IRBuilder<>& builder,
+                               const ForInExpr& expr) const {
+    using namespace expressions;
+    const auto line = expr.state().row + 1;
+    auto iterable = factors::getFactor(expr.iterable())->codegen(builder);
+    if (!iterable) {
+      return iterable.takeError();
+    }
+    const auto handle = *iterable;
+    const auto generator = Coroutine::getGenerator(handle);
+    if (!generator) {
+      return error("can only iterate over ranges and generators at line {}",
+                   line);
+    }
+    const auto promiseType = Coroutine::getPromiseType(generator).value();
+    if (!promiseType) {
+      return error("generator `{}` yields no values at line {}",
+                   generator->getName().str(), line);
+    }
+    const auto& names = expr.identList();
+    if (names.size() > 1 &&
+        (!promiseType->isStructTy() ||
+         promiseType->getStructNumElements() != names.size())) {
+      return error("invalid number of loop variables for generator `{}` "
+                   "at line {}",
+                   generator->getName().str(), line);
+    }
+    for (const auto& name : names) {
+      if (name == "_") {
+        continue;
+      }
+      if (auto err = factors::Ident::isUnique(builder, name)) {
+        return err;
+      }
+    }
+
+    auto properties = getLoopProperties(builder, stmt_.get());
+    if (!properties) {
+      return properties.takeError();
+    }
+
+    const auto func = builder.GetInsertBlock()->getParent();
+    auto& ctx = func->getContext();
+    const auto header = llvm::BasicBlock::Create(ctx, "for.cond", func);
+    const auto body = llvm::BasicBlock::Create(ctx, "for", func);
+    const auto latch = llvm::BasicBlock::Create(ctx, "for.latch", func);
+    const auto exit = llvm::BasicBlock::Create(ctx, "for.end", func);
+
+    // we destroy the frame on every exit (including `return` and breaks out
+    // of enclosing loops) so that it can be elided
+    Scope scope{builder};
+    scope.pushCleanup([handle](llvm::IRBuilder<>& builder) {
+      Coroutine::destroy(builder, handle);
+      return llvm::Error::success();
+    });
+
+    // the generator has run up to its first yield (or its end)
+    builder.CreateBr(header);
+    builder.SetInsertPoint(header);
+    builder.CreateCondBr(Coroutine::done(builder, handle), exit, body);
+
+    builder.SetInsertPoint(body);
+    const auto promise = Coroutine::promise(builder, handle, promiseType);
+    const auto value = align(builder.CreateLoad(promise));
+    small_vector<llvm::Value*> variables;
+    if (names.size() == 1) {
+      variables.push_back(value);
+    } else {
+      for (unsigned i = 0; i < names.size(); ++i) {
+        variables.push_back(builder.CreateExtractValue(value, i));
+      }
+    }
+    for (size_t i = 0; i < names.size(); ++i) {
+      if (names[i] != "_") {
+        variables[i]->setName(names[i]);
+      }
+    }
+    if (auto err = codegenFilter(builder, expr, latch)) {
+      return err;
+    }
+    if (auto err = codegenBody(builder, exit, latch)) {
+      return err;
+    }
+
+    builder.SetInsertPoint(latch);
+    Coroutine::resume(builder, handle);
+    createBackedge(builder, header, *properties);
+
+    exit->moveAfter(latch);
+    builder.SetInsertPoint(exit);
+    if (auto err = scope.emitCleanups(builder)) {
+      return err;
+    }
+    scope.exit(builder);
+    cont_ = builder.GetInsertBlock();
+    for (const auto variable : variables) {
+      if (variable->hasName()) {
+        // we restrict scope of loop variables via renaming
+        variable->setName(".tmp." + variable->getName().str());
+      }
+    }
+    return llvm::Error::success();
+  }
+
+  // for init; condition; steps
+  llvm::Error codegenForIncr(llvm::IRBuilder<>& builder) const {
+    const ForIncrExpr expr{expr_};
+    auto properties = getLoopProperties(builder, stmt_.get());
+    if (!properties) {
+      return properties.takeError();
+    }
+    for (const auto& init : expr.init) {
+      if (auto err = init->codegen(builder)) {
         return err;
       }
-      for (const auto& step : expr.steps) {
-        if (auto err = step->codegen(builder)) {
-          return err;
+    }
+    SCOPE_EXIT {
+      const auto func = builder.GetInsertBlock()->getParent();
+      const auto symTbl = func->getValueSymbolTable();
+      for (const auto& init : expr.init) {
+        if (const auto let = llvm::dyn_cast<Let>(init.get())) {
+          for (const auto& var : let->variables()) {
+            if (const auto alloc = symTbl->lookup(var)) {
+              // we restrict scope of let variables via renaming
+              alloc->setName(".tmp." + alloc->getName().str());
+            }
+          }
         }
       }
-      comparison = expr.comparison.codegen(builder);
-      if (!comparison) {
-        return comparison.takeError();
+    };
+
+    const auto func = builder.GetInsertBlock()->getParent();
+    auto& ctx = func->getContext();
+    const auto header = llvm::BasicBlock::Create(ctx, "for.cond", func);
+    const auto body = llvm::BasicBlock::Create(ctx, "for", func);
+    const auto latch = llvm::BasicBlock::Create(ctx, "for.latch", func);
+    cont_ = llvm::BasicBlock::Create(ctx, "cont", func);
+
+    builder.CreateBr(header);
+    builder.SetInsertPoint(header);
+    auto cond = expr.condition->codegen(builder);
+    if (!cond) {
+      return cond.takeError();
+    }
+    auto condition = expressions::getLoadedValue(builder, *cond);
+    if (!condition) {
+      return condition.takeError();
+    }
+    builder.CreateCondBr(*condition, body, cont_);
+
+    builder.SetInsertPoint(body);
+    if (auto err = codegenBody(builder, cont_, latch)) {
+      return err;
+    }
+
+    builder.SetInsertPoint(latch);
+    for (const auto& step : expr.steps) {
+      if (auto err = step->codegen(builder)) {
+        return err;
       }
-      builder.CreateCondBr(*comparison, body, cont);
-      builder.SetInsertPoint(cont);
     }
+    createBackedge(builder, header, *properties);
+    cont_->moveAfter(builder.GetInsertBlock());
+    builder.SetInsertPoint(cont_);
     return llvm::Error::success();
   }
 
-  inline llvm::Error runScopeExit(llvm::IRBuilder<>& builder) const final {
-    return stmt_->runScopeExit(builder);
+  // skips to @param latch unless the if filter of @param expr holds
+  llvm::Error codegenFilter(llvm::IRBuilder<>& builder, const ForInExpr& expr,
+                            llvm::BasicBlock* const latch) const {
+    const auto& filter = expr.filter();
+    if (!filter) {
+      return llvm::Error::success();
+    }
+    auto cond = filter->codegen(builder);
+    if (!cond) {
+      return cond.takeError();
+    }
+    auto condition = expressions::getLoadedValue(builder, *cond);
+    if (!condition) {
+      return condition.takeError();
+    }
+    const auto then = llvm::BasicBlock::Create(
+        builder.getContext(), "then", builder.GetInsertBlock()->getParent());
+    builder.CreateCondBr(*condition, then, latch);
+    builder.SetInsertPoint(then);
+    return llvm::Error::success();
   }
 
-  inline static bool classof(const Stmt* const stmt) {
-    return stmt->getKind() == kFor;
+  // emits the loop body, falling through to @param latch
+  llvm::Error codegenBody(llvm::IRBuilder<>& builder,
+                          llvm::BasicBlock* const exit,
+                          llvm::BasicBlock* const latch) const {
+    {
+      const LoopScope loop{builder, exit, latch, label_};
+      if (auto err = stmt_->codegen(builder)) {
+        return err;
+      }
+    }
+    if (!builder.GetInsertBlock()->getTerminator()) {
+      builder.CreateBr(latch);
+    }
+    latch->moveAfter(builder.GetInsertBlock());
+    return llvm::Error::success();
   }
 
-private:
-  const mpc_ast_t* const expr_;
-  std::unique_ptr<Stmt> stmt_;
+  // compares signed, in the direction of @param step
+  static llvm::Value* exitTest(llvm::IRBuilder<>& builder,
+                               llvm::Value* const iv, llvm::Value* const end,
+                               llvm::Value* const step, const bool inclusive) {
+    const auto ascending = [&] {
+      return inclusive ? builder.CreateICmpSLE(iv, end)
+                       : builder.CreateICmpSLT(iv, end);
+    };
+    const auto descending = [&] {
+      return inclusive ? builder.CreateICmpSGE(iv, end)
+                       : builder.CreateICmpSGT(iv, end);
+    };
+    if (const auto c = llvm::dyn_cast<llvm::ConstantInt>(step)) {
+      return c->isNegative() ? descending() : ascending();
+    }
+    const auto isNegative = builder.CreateICmpSLT(
+        step, llvm::ConstantInt::get(step->getType(), 0));
+    return builder.CreateSelect(isNegative, descending(), ascending());
+  }
+
+  // whether @param step is a constant 1 or -1 (for which iv + step cannot
+  // overflow while iv is short of an exclusive end)
+  static bool isUnitStep(llvm::Value* const step) {
+    const auto c = llvm::dyn_cast<llvm::ConstantInt>(step);
+    return c && (c->isOne() || c->isMinusOne());
+  }
+
+  /// Whether iv + step is still within the range, which iv is: the
+  /// distance left to @param end exceeds the magnitude of @param step (or
+  /// equals it when @param inclusive). Distances and magnitudes are
+  /// unsigned, so this holds up to the limits of the type (e.g. 0..=MAX).
+  static llvm::Value* hasNext(llvm::IRBuilder<>& builder,
+                              llvm::Value* const iv, llvm::Value* const end,
+                              llvm::Value* const step, const bool inclusive) {
+    const auto test = [&](llvm::Value* const distance,
+                          llvm::Value* const magnitude) {
+      return inclusive ? builder.CreateICmpUGE(distance, magnitude)
+                       : builder.CreateICmpUGT(distance, magnitude);
+    };
+    const auto ascending = [&] {
+      return test(builder.CreateSub(end, iv), step);
+    };
+    const auto descending = [&] {
+      return test(builder.CreateSub(iv, end), builder.CreateNeg(step));
+    };
+    if (const auto c = llvm::dyn_cast<llvm::ConstantInt>(step)) {
+      return c->isNegative() ? descending() : ascending();
+    }
+    const auto isNegative = builder.CreateICmpSLT(
+        step, llvm::ConstantInt::get(step->getType(), 0));
+    return builder.CreateSelect(isNegative, descending(), ascending());
+  }
+
+  static void createBackedge(llvm::IRBuilder<>& builder,
+                             llvm::BasicBlock* const header,
+                             llvm::ArrayRef<llvm::Metadata*> properties) {
+    const auto br = builder.CreateBr(header);
+    br->setMetadata(llvm::LLVMContext::MD_loop,
+                    createLoopMetadata(builder.getContext(), properties));
+  }
 };
 
 } // end namespace whack::codegen::stmts
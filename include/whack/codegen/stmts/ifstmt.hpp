@@ -58,21 +58,21 @@ public:
       thenBlock_->moveAfter(current);
       builder.CreateCondBr(*condition, thenBlock_, elseBlock_);
       builder.SetInsertPoint(thenBlock_);
-      if (auto err = then_->codegen(builder)) {
+      if (auto err = Scope::codegen(builder, then_.get())) {
         return err;
       }
       thenBlock_ = builder.GetInsertBlock();
-      if (!thenBlock_->back().isTerminator()) {
+      if (!thenBlock_->getTerminator()) {
         builder.CreateBr(contBlock);
       }
 
       elseBlock_->moveAfter(thenBlock_);
       builder.SetInsertPoint(elseBlock_);
-      if (auto err = else_->codegen(builder)) {
+      if (auto err = Scope::codegen(builder, else_.get())) {
         return err;
       }
       elseBlock_ = builder.GetInsertBlock();
-      if (!elseBlock_->back().isTerminator()) {
+      if (!elseBlock_->getTerminator()) {
         builder.CreateBr(contBlock);
       }
 
@@ -87,11 +87,11 @@ public:
       thenBlock_->moveAfter(current);
       builder.CreateCondBr(*condition, thenBlock_, contBlock);
       builder.SetInsertPoint(thenBlock_);
-      if (auto err = then_->codegen(builder)) {
+      if (auto err = Scope::codegen(builder, then_.get())) {
         return err;
       }
       thenBlock_ = builder.GetInsertBlock();
-      if (!thenBlock_->back().isTerminator()) {
+      if (!thenBlock_->getTerminator()) {
         builder.CreateBr(contBlock);
       }
 
@@ -18,6 +18,9 @@
 
 #pragma once
 
+#include "../aggregate.hpp"
+#include "../constants.hpp"
+
 namespace whack::codegen::stmts {
 
 class Let final : public Stmt {
@@ -32,7 +35,11 @@ public:
   llvm::Error codegen(llvm::IRBuilder<>& builder) const final {
     using namespace expressions::factors;
     if (identList_.size() > 1 && exprList_.size() == 1) {
-      auto expr = exprList_[0]->codegen(builder);
+      auto e = exprList_[0]->codegen(builder);
+      if (!e) {
+        return e.takeError();
+      }
+      auto expr = expressions::getLoadedValue(builder, *e);
       if (!expr) {
         return expr.takeError();
       }
@@ -49,14 +56,18 @@ public:
         if (auto err = Ident::isUnique(builder, name)) {
           return err;
         }
-        const auto value = builder.CreateExtractValue(*expr, i, "");
+        const auto value = aggregate::getElement(builder, *expr, i);
         const auto alloc =
-            align(builder.CreateAlloca(value->getType(), 0, nullptr, name));
-        align(builder.CreateStore(value, alloc));
+            createAlloca(builder, value->getType(), name);
+        aggregate::emitStore(builder, value, alloc);
       }
     } else if (exprList_.size() == identList_.size()) {
       for (size_t i = 0; i < identList_.size(); ++i) {
-        auto val = exprList_[i]->codegen(builder);
+        auto val = [&] {
+          // immutable bindings of constant aggregates use the pool's copy
+          const ConstantPool::InPlace inPlace{!varsAreMutable_};
+          return exprList_[i]->codegen(builder);
+        }();
         if (!val) {
           return val.takeError();
         }
@@ -72,6 +83,8 @@ public:
         if (llvm::isa<llvm::AllocaInst>(value) && hasMetadata(value, refMD)) {
           align(value);
           value->setName(name);
+        } else if (ConstantPool::isInPlace(value)) {
+          value->setName(name);
         } else {
           auto v = expressions::getLoadedValue(builder, *val);
           if (!v) {
@@ -79,11 +92,11 @@ public:
           }
           const auto value = *v;
           const auto alloc =
-              align(builder.CreateAlloca(value->getType(), 0, nullptr, name));
-          align(builder.CreateStore(value, alloc));
+              createAlloca(builder, value->getType(), name);
           if (hasMetadata(value, refMD)) {
             setIsDereferenceable(builder.getContext(), alloc);
           }
+          aggregate::emitStore(builder, value, alloc);
         }
       }
     } else {
@@ -18,8 +18,183 @@
 
 #pragma once
 
+#include "../expressions/range.hpp"
+#include "decisiontree.hpp"
+
 namespace whack::codegen {
 
+// ast is guaranteed to outlive the returned patterns
+static auto getPatternList(const mpc_ast_t* const ast) {
+  small_vector<const mpc_ast_t*> patterns;
+  if (getInnermostAstTag(ast) == "exprlist") {
+    for (auto i = 0; i < ast->children_num; i += 2) {
+      patterns.push_back(ast->children[i]);
+    }
+  } else {
+    patterns.push_back(ast);
+  }
+  return patterns;
+}
+
+static llvm::Expected<MatchPattern> getMatchPattern(const mpc_ast_t* const,
+                                                    llvm::IRBuilder<>&,
+                                                    llvm::Type* const);
+
+static llvm::Expected<MatchPattern>
+getVariantPattern(const mpc_ast_t* const ast, llvm::IRBuilder<>& builder,
+                  llvm::Type* const type) {
+  const auto isCall = getInnermostAstTag(ast) == "factor";
+  const auto ctor = isCall ? ast->children[0] : ast;
+  const auto module = builder.GetInsertBlock()->getModule();
+  if (!elements::DataClass::isa(ctor, module)) {
+    return error("expected a data class constructor pattern at line {}",
+                 ast->state.row + 1);
+  }
+  const auto [className, ctorName] =
+      elements::DataClass::getDataClassInfo(ctor);
+  if (module->getTypeByName(format("class::{}", className)) != type) {
+    return error("type mismatch: `{}::{}` does not construct the match "
+                 "subject at line {}",
+                 className, ctorName, ast->state.row + 1);
+  }
+  const auto idx = elements::DataClass::getIndex(module, className, ctorName);
+  if (!idx) {
+    return error("could not find constructor `{}` for data "
+                 "class `{}` at line {}",
+                 ctorName, className, ast->state.row + 1);
+  }
+  MatchPattern pattern{MatchPattern::kVariant, ast->state};
+  pattern.Variant = idx.value();
+  pattern.VariantType =
+      module->getTypeByName(format("class::{}::{}", className, ctorName));
+  if (!isCall) {
+    return pattern;
+  }
+
+  const auto composite = ast->children[1];
+  if (std::string_view(composite->children[0]->contents) != "(") {
+    return error("invalid data class pattern at line {}", ast->state.row + 1);
+  }
+  small_vector<const mpc_ast_t*> args;
+  if (composite->children_num > 2 &&
+      getOutermostAstTag(composite->children[1]) == "exprlist") {
+    args = getPatternList(composite->children[1]);
+  }
+  const auto variantType = pattern.VariantType;
+  if (args.size() != variantType->getStructNumElements() - 1) {
+    return error("invalid number of elements for constructor "
+                 "`{}` of data class `{}` at line {}",
+                 ctorName, className, ast->state.row + 1);
+  }
+  for (size_t i = 0; i < args.size(); ++i) {
+    const auto arg = args[i];
+    const auto fieldType = variantType->getStructElementType(i + 1);
+    if (getInnermostAstTag(arg) == "ident") {
+      const std::string_view name{arg->contents};
+      if (name != "_" && name != "nullptr") {
+        MatchPattern binding{MatchPattern::kBinding, arg->state};
+        binding.Binding = arg->contents;
+        pattern.Payload.emplace_back(std::move(binding));
+        continue;
+      }
+    }
+    auto field = getMatchPattern(arg, builder, fieldType);
+    if (!field) {
+      return field.takeError();
+    }
+    if (field->Kind == MatchPattern::kVariant) {
+      return error("nested data class patterns are not supported at line {}",
+                   arg->state.row + 1);
+    }
+    pattern.Payload.emplace_back(std::move(*field));
+  }
+  return pattern;
+}
+
+static llvm::Expected<MatchPattern> getMatchPattern(const mpc_ast_t* const ast,
+                                                    llvm::IRBuilder<>& builder,
+                                                    llvm::Type* const type) {
+  using namespace expressions;
+  const auto tag = getInnermostAstTag(ast);
+  if (tag == "ident" && std::string_view(ast->contents) == "_") {
+    return MatchPattern{MatchPattern::kWildcard, ast->state};
+  }
+
+  if (tag == "string" && ast->contents[0] == '"') {
+    if (type != BasicTypes["char"]->getPointerTo(0)) {
+      return error("invalid type for match option at line {}",
+                   ast->state.row + 1);
+    }
+    MatchPattern pattern{MatchPattern::kString, ast->state};
+    pattern.String =
+        llvm::StringRef{ast->contents}.drop_front().drop_back().str();
+    return pattern;
+  }
+
+  if (Range::isa(ast)) {
+    const Range range{ast};
+    if (range.hasStep() || !range.hasEnd()) {
+      return error("expected a bounded range without a step for match "
+                   "option at line {}",
+                   ast->state.row + 1);
+    }
+    auto low = range.begin(builder);
+    if (!low) {
+      return low.takeError();
+    }
+    auto high = range.end(builder);
+    if (!high) {
+      return high.takeError();
+    }
+    const auto lowC = llvm::dyn_cast<llvm::ConstantInt>(*low);
+    const auto highC = llvm::dyn_cast<llvm::ConstantInt>(*high);
+    if (!lowC || !highC) {
+      return error("expected constant range bounds for match option "
+                   "at line {}",
+                   ast->state.row + 1);
+    }
+    if (lowC->getType() != type || highC->getType() != type) {
+      return error("invalid type for match option at line {}",
+                   ast->state.row + 1);
+    }
+    MatchPattern pattern{MatchPattern::kRange, ast->state};
+    pattern.Low = lowC->getValue();
+    pattern.High = highC->getValue();
+    if (!range.endInclusive()) {
+      if (pattern.High == pattern.Low) {
+        return error("empty range for match option at line {}",
+                     ast->state.row + 1);
+      }
+      --pattern.High;
+    }
+    if (pattern.High.slt(pattern.Low)) {
+      return error("empty range for match option at line {}",
+                   ast->state.row + 1);
+    }
+    return pattern;
+  }
+
+  if (getDataClassName(type)) {
+    return getVariantPattern(ast, builder, type);
+  }
+
+  auto opt = getExpressionValue(ast)->codegen(builder);
+  if (!opt) {
+    return opt.takeError();
+  }
+  auto option = getLoadedValue(builder, *opt);
+  if (!option) {
+    return option.takeError();
+  }
+  if ((*option)->getType() != type) {
+    return error("invalid type for match option at line {}",
+                 ast->state.row + 1);
+  }
+  MatchPattern pattern{MatchPattern::kValue, ast->state};
+  pattern.Value = *option;
+  return pattern;
+}
+
 static llvm::Expected<MatchInfo> getMatchInfo(const mpc_ast_t* const ast,
                                               llvm::IRBuilder<>& builder) {
   using namespace expressions;
@@ -33,48 +208,47 @@ static llvm::Expected<MatchInfo> getMatchInfo(const mpc_ast_t* const ast,
   }
   MatchInfo matchInfo;
   matchInfo.Subject = *subject;
+  matchInfo.State = ast->state;
   const auto type = matchInfo.Subject->getType();
   const auto tag = getOutermostAstTag(ast->children[3]);
   matchInfo.IsExpression =
       tag == "matchexprcase" ||
       (tag == "default" &&
        getOutermostAstTag(ast->children[5]) == "expression");
-  small_vector<llvm::Value*> allOptions;
+  bool needsAddress = false;
 
   for (auto i = 3; i < ast->children_num - 1; ++i) {
     const auto ref = ast->children[i];
     if (std::string_view(ref->contents) != "default") {
-      small_vector<llvm::Value*> values;
+      small_vector<MatchPattern> patterns;
       const auto expr = matchInfo.IsExpression ? ref->children[0] : ref;
-      for (const auto& e : getExprList(expr)) {
-        auto opt = e->codegen(builder);
-        if (!opt) {
-          return opt.takeError();
-        }
-        auto o = getLoadedValue(builder, *opt);
-        if (!o) {
-          return o.takeError();
-        }
-        const auto option = *o;
-        if (option->getType() != type) {
-          return error("invalid type for match option at line {}",
-                       expr->state.row + 1);
+      for (const auto alternative : getPatternList(expr)) {
+        auto pattern = getMatchPattern(alternative, builder, type);
+        if (!pattern) {
+          return pattern.takeError();
         }
-        if (std::find(allOptions.begin(), allOptions.end(), option) !=
-            allOptions.end()) {
-          return error("duplicate option for match at line {}",
-                       expr->state.row + 1);
+        needsAddress |= !pattern->Payload.empty();
+        patterns.emplace_back(std::move(*pattern));
+      }
+      if (patterns.size() > 1) {
+        for (const auto& pattern : patterns) {
+          for (const auto& field : pattern.Payload) {
+            if (field.Kind == MatchPattern::kBinding) {
+              return error("cannot bind `{}` in a match option with "
+                           "alternatives at line {}",
+                           field.Binding.str(), field.State.row + 1);
+            }
+          }
         }
-        values.push_back(option);
-        allOptions.push_back(option);
       }
       const auto res =
           matchInfo.IsExpression ? ref->children[2] : ast->children[i + 2];
       using res_t = MatchInfo::match_res_t;
       matchInfo.Options.emplace_back(
-          std::make_pair(std::move(values), matchInfo.IsExpression
-                                                ? res_t{getExpressionValue(res)}
-                                                : res_t{stmts::getStmt(res)}));
+          std::make_pair(std::move(patterns),
+                         matchInfo.IsExpression
+                             ? res_t{getExpressionValue(res)}
+                             : res_t{stmts::getStmt(res)}));
       if (matchInfo.IsExpression) {
         if (std::string_view(ast->children[i + 1]->contents) == ";") {
           ++i;
@@ -91,6 +265,13 @@ static llvm::Expected<MatchInfo> getMatchInfo(const mpc_ast_t* const ast,
       break;
     }
   }
+
+  if (needsAddress) {
+    // payload patterns read the fields of the subject in place
+    const auto alloc = createAlloca(builder, type);
+    builder.CreateStore(matchInfo.Subject, alloc);
+    matchInfo.SubjectAddress = alloc;
+  }
   return matchInfo;
 }
 
@@ -109,47 +290,59 @@ public:
     const auto& matchInfo = *info;
     const auto func = builder.GetInsertBlock()->getParent();
     auto& ctx = func->getContext();
-    auto defaultBlock = llvm::BasicBlock::Create(ctx, "default", func);
+    small_vector<llvm::BasicBlock*> arms;
+    for (size_t i = 0; i < matchInfo.Options.size(); ++i) {
+      arms.push_back(llvm::BasicBlock::Create(ctx, "case", func));
+    }
+    const auto defaultBlock = llvm::BasicBlock::Create(ctx, "default", func);
     const auto contBlock = llvm::BasicBlock::Create(ctx, "block", func);
-    const auto switcher = builder.CreateSwitch(matchInfo.Subject, defaultBlock,
-                                               matchInfo.Options.size());
-    for (const auto& [alternatives, stmt] : matchInfo.Options) {
-      auto caseBlock = llvm::BasicBlock::Create(ctx, "case", func);
-      for (const auto& value : alternatives) {
-        switcher->addCase(llvm::dyn_cast<llvm::ConstantInt>(value), caseBlock);
-      }
-      caseBlock->moveBefore(contBlock);
-      builder.SetInsertPoint(caseBlock);
+    if (auto err = emitMatchDispatch(builder, matchInfo, arms, defaultBlock)) {
+      return err;
+    }
+
+    const auto emitArm = [&](const auto& stmt) -> llvm::Error {
       const auto& s = std::get<0>(stmt);
-      if (auto err = s->codegen(builder)) {
+      if (auto err = Scope::codegen(builder, s.get())) {
         return err;
       }
       if (auto err = s->runScopeExit(builder)) {
         return err;
       }
-      caseBlock = builder.GetInsertBlock();
-      if (!caseBlock->back().isTerminator()) {
+      if (!builder.GetInsertBlock()->getTerminator()) {
         builder.CreateBr(contBlock);
       }
-    }
+      return llvm::Error::success();
+    };
 
-    builder.SetInsertPoint(defaultBlock);
-    if (matchInfo.Default) {
-      const auto& defaultStmt = std::get<0>(matchInfo.Default.value());
-      if (auto err = defaultStmt->codegen(builder)) {
-        return err;
+    for (size_t i = 0; i < arms.size(); ++i) {
+      const auto& [patterns, stmt] = matchInfo.Options[i];
+      arms[i]->moveBefore(defaultBlock);
+      builder.SetInsertPoint(arms[i]);
+      auto bindings = bindMatchPayload(builder, matchInfo, patterns);
+      if (!bindings) {
+        return bindings.takeError();
       }
-      if (auto err = defaultStmt->runScopeExit(builder)) {
+      if (auto err = emitArm(stmt)) {
         return err;
       }
-      defaultBlock = builder.GetInsertBlock();
-      if (!defaultBlock->back().isTerminator()) {
+      unbindMatchPayload(*bindings);
+    }
+
+    if (!matchInfo.Default && llvm::pred_empty(defaultBlock)) {
+      defaultBlock->eraseFromParent();
+    } else {
+      defaultBlock->moveBefore(contBlock);
+      builder.SetInsertPoint(defaultBlock);
+      if (matchInfo.Default) {
+        if (auto err = emitArm(matchInfo.Default.value())) {
+          return err;
+        }
+      } else {
         builder.CreateBr(contBlock);
       }
-    } else {
-      builder.CreateBr(contBlock);
     }
 
+    contBlock->moveAfter(builder.GetInsertBlock());
     builder.SetInsertPoint(contBlock);
     return llvm::Error::success();
   }
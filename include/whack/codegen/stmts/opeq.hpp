@@ -37,7 +37,15 @@ public:
     if (!e) {
       return e.takeError();
     }
-    auto variable = *var;
+    const auto variable = expressions::getAddress(builder, *var);
+    if (!variable) {
+      return error("cannot assign to an rvalue at line {}", state_.row + 1);
+    }
+    if (ConstantPool::isInPool(
+            variable, builder.GetInsertBlock()->getModule()->getDataLayout())) {
+      return error("cannot assign to an immutable value at line {}",
+                   state_.row + 1);
+    }
     auto expression = expressions::getLoadedValue(builder, *e);
     if (!expression) {
       return expression.takeError();
@@ -45,11 +53,7 @@ public:
     const auto expr = *expression;
     using namespace expressions::operators;
     auto res = [&]() -> llvm::Expected<llvm::Value*> {
-      auto l = expressions::getLoadedValue(builder, variable);
-      if (!l) {
-        return l.takeError();
-      }
-      const auto lhs = *l;
+      const auto lhs = align(builder.CreateLoad(variable));
       if (op_ == "+" || op_ == "-") {
         return getAdditive(builder, lhs, op_, expr);
       }
@@ -71,10 +75,7 @@ public:
     if (!res) {
       return res.takeError();
     }
-    if (hasMetadata(variable, llvm::LLVMContext::MD_dereferenceable)) {
-      variable = builder.CreateLoad(variable);
-    }
-    builder.CreateStore(*res, variable);
+    align(builder.CreateStore(*res, variable));
     return llvm::Error::success();
   }
 
@@ -18,6 +18,9 @@
 
 #pragma once
 
+#include "../abi.hpp"
+#include "../coroutine.hpp"
+
 namespace whack::codegen::stmts {
 
 class Return final : public Stmt {
@@ -30,35 +33,46 @@ public:
   }
 
   llvm::Error codegen(llvm::IRBuilder<>& builder) const final {
-    if (exprList_.empty()) {
-      builder.CreateRetVoid();
-    } else if (exprList_.size() == 1) {
-      auto expr = exprList_.back()->codegen(builder);
+    const auto coroutine = Coroutine::get(builder);
+    if (coroutine && !exprList_.empty()) {
+      return error("cannot return values from a generator "
+                   "at line {} (tip: yield them instead)",
+                   state_.row + 1);
+    }
+    small_vector<llvm::Value*> values;
+    for (const auto& expression : exprList_) {
+      auto expr = expression->codegen(builder);
       if (!expr) {
         return expr.takeError();
       }
-      auto ret = expressions::getLoadedValue(builder, *expr);
-      if (!ret) {
-        return ret.takeError();
+      auto val = expressions::getLoadedValue(builder, *expr);
+      if (!val) {
+        return val.takeError();
       }
-      builder.CreateRet(*ret);
-    } else {
-      small_vector<llvm::Value*> values;
-      for (const auto& expression : exprList_) {
-        auto expr = expression->codegen(builder);
-        if (!expr) {
-          return expr.takeError();
-        }
-        auto val = expressions::getLoadedValue(builder, *expr);
-        if (!val) {
-          return val.takeError();
-        }
-        values.push_back(*val);
+      values.push_back(*val);
+    }
+    if (Scope::getCleanupDepth(builder)) {
+      // we keep the values in slots while the pending cleanups run
+      const auto func = builder.GetInsertBlock()->getParent();
+      small_vector<llvm::AllocaInst*> slots;
+      for (const auto value : values) {
+        slots.push_back(
+            Scope::createEntryAlloca(func, value->getType(), "retval"));
+        aggregate::emitStore(builder, value, slots.back());
       }
-      builder.CreateAggregateRet(values.data(),
-                                 static_cast<unsigned>(values.size()));
+      const auto ret =
+          llvm::BasicBlock::Create(builder.getContext(), "return", func);
+      Scope::branchThrough(builder, ret, 0);
+      builder.SetInsertPoint(ret);
+      for (size_t i = 0; i < slots.size(); ++i) {
+        values[i] = align(builder.CreateLoad(slots[i]));
+      }
+    }
+    if (coroutine) {
+      coroutine->finish(builder);
+      return llvm::Error::success();
     }
-    return llvm::Error::success();
+    return abi::emitReturn(builder, values);
   }
 
   inline static bool classof(const Stmt* const stmt) {
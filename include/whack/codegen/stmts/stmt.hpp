@@ -18,7 +18,6 @@
 
 #pragma once
 
-// #include "forstmt.hpp"
 #include "../elements/alias.hpp"
 #include "../elements/comment.hpp"
 #include "../elements/dataclass.hpp"
@@ -32,6 +31,7 @@
 #include "declassign.hpp"
 #include "deferstmt.hpp"
 #include "deletestmt.hpp"
+#include "forstmt.hpp"
 #include "ifstmt.hpp"
 #include "let.hpp"
 #include "match.hpp"
@@ -93,7 +93,7 @@ static std::unique_ptr<Stmt> getStmt(const mpc_ast_t* const ast) {
   OPT("declassign", DeclAssign)
   OPT("whilestmt", While)
   OPT("ifstmt", If)
-  // OPT("forstmt", For)
+  OPT("forstmt", For)
   OPT("assign", Assign)
   OPT("typeswitch", TypeSwitch)
   OPT("opeq", OpEq)
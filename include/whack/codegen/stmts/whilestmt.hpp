@@ -23,29 +23,51 @@ namespace whack::codegen::stmts {
 class While final : public Stmt {
 public:
   explicit While(const mpc_ast_t* const ast)
-      : Stmt(kWhile), condition_{ast->children[1]}, stmt_{getStmt(
-                                                        ast->children[2])} {}
+      : Stmt(kWhile), label_{LoopScope::getLabel(ast)},
+        condition_{ast->children[label_.empty() ? 1 : 3]},
+        stmt_{getStmt(ast->children[label_.empty() ? 2 : 4])} {}
 
   llvm::Error codegen(llvm::IRBuilder<>& builder) const final {
+    auto properties = getLoopProperties(builder, stmt_.get());
+    if (!properties) {
+      return properties.takeError();
+    }
     const auto func = builder.GetInsertBlock()->getParent();
     auto& ctx = builder.getContext();
+    const auto header = llvm::BasicBlock::Create(ctx, "while.cond", func);
     const auto block = llvm::BasicBlock::Create(ctx, "while", func);
+    const auto latch = llvm::BasicBlock::Create(ctx, "while.latch", func);
     cont_ = llvm::BasicBlock::Create(ctx, "cont", func);
+    builder.CreateBr(header);
+    builder.SetInsertPoint(header);
     auto cond = condition_.codegen(builder);
     if (!cond) {
       return cond.takeError();
     }
-    builder.CreateCondBr(*cond, block, cont_);
-    builder.SetInsertPoint(block);
-    if (auto err = stmt_->codegen(builder)) {
-      return err;
+    auto condition = expressions::getLoadedValue(builder, *cond);
+    if (!condition) {
+      return condition.takeError();
     }
-    if (!builder.GetInsertBlock()->back().isTerminator()) {
-      cond = condition_.codegen(builder);
-      if (!cond) {
-        return cond.takeError();
+    builder.CreateCondBr(*condition, block, cont_);
+    builder.SetInsertPoint(block);
+    {
+      const LoopScope loop{builder, cont_, latch, label_};
+      if (auto err = stmt_->codegen(builder)) {
+        return err;
       }
-      builder.CreateCondBr(*cond, block, cont_);
+    }
+    if (!builder.GetInsertBlock()->getTerminator()) {
+      builder.CreateBr(latch);
+    }
+    // the single latch of the loop, which `continue` also branches to
+    if (llvm::pred_empty(latch)) {
+      latch->eraseFromParent(); // the body never loops
+    } else {
+      latch->moveAfter(builder.GetInsertBlock());
+      builder.SetInsertPoint(latch);
+      const auto br = builder.CreateBr(header);
+      br->setMetadata(llvm::LLVMContext::MD_loop,
+                      createLoopMetadata(ctx, *properties));
     }
     cont_->moveAfter(builder.GetInsertBlock());
     builder.SetInsertPoint(cont_);
@@ -53,7 +75,7 @@ public:
   }
 
   inline llvm::Error runScopeExit(llvm::IRBuilder<>& builder) const final {
-    llvm::IRBuilder<>::InsertPointGuard{builder};
+    const llvm::IRBuilder<>::InsertPointGuard guard{builder};
     builder.SetInsertPoint(cont_);
     return stmt_->runScopeExit(builder);
   }
@@ -63,6 +85,7 @@ public:
   }
 
 private:
+  const llvm::StringRef label_;
   const expressions::operators::LogicalOr condition_;
   const std::unique_ptr<Stmt> stmt_;
   mutable llvm::BasicBlock* cont_;
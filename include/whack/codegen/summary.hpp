@@ -0,0 +1,301 @@
+/**
+ * Copyright 2018-present Onchere Bironga
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef WHACK_SUMMARY_HPP
+#define WHACK_SUMMARY_HPP
+
+#include "fwd.hpp"
+#include "metadata.hpp"
+#include <llvm/ADT/MapVector.h>
+#include <llvm/ADT/SetVector.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+namespace whack::codegen {
+
+/// The interface summary of a module (a `.wi` file), which is all its
+/// importers need of it: the declarations of its functions and globals,
+/// its types (struct layouts, interfaces, data class variants), aliases
+/// and metadata tables, and the bodies of its @inline and @mustinline
+/// functions (available_externally, for the inliner) which use no local
+/// state (only constants). Every other body is left to the object file of
+/// the module, and resolved when linking.
+/// Importers compiling the module themselves get the same summary of it,
+/// and the outermost module links its definitions in once.
+///
+/// A summary is the bitcode of such a module after a header of the magic
+/// `WHKI` and the (little endian) format version.
+class ModuleSummary {
+public:
+  constexpr static char Magic[4] = {'W', 'H', 'K', 'I'};
+  constexpr static uint32_t Version = 2;
+
+  // reduces @param module to its summary, and writes that to @param filename
+  static llvm::Error write(llvm::Module& module, const std::string& filename) {
+    summarize(module);
+    std::error_code ec;
+    llvm::raw_fd_ostream os{filename, ec, llvm::sys::fs::F_None};
+    if (ec) {
+      return error("cannot write module summary `{}`: {}", filename,
+                   ec.message());
+    }
+    os.write(Magic, sizeof(Magic));
+    for (auto i = 0; i < 4; ++i) {
+      os << static_cast<char>((Version >> (8 * i)) & 0xff);
+    }
+    llvm::WriteBitcodeToFile(&module, os);
+    return llvm::Error::success();
+  }
+
+  static llvm::Expected<std::unique_ptr<llvm::Module>>
+  read(const std::string& filename, llvm::LLVMContext& ctx) {
+    auto buffer = llvm::MemoryBuffer::getFile(filename);
+    if (!buffer) {
+      return error("cannot read module summary `{}`: {}", filename,
+                   buffer.getError().message());
+    }
+    const auto contents = (*buffer)->getBuffer();
+    const auto header = sizeof(Magic) + sizeof(Version);
+    if (contents.size() < header ||
+        !contents.startswith(llvm::StringRef{Magic, sizeof(Magic)})) {
+      return error("`{}` is not a module summary", filename);
+    }
+    uint32_t version = 0;
+    for (auto i = 0; i < 4; ++i) {
+      version |= static_cast<uint32_t>(
+                     static_cast<uint8_t>(contents[sizeof(Magic) + i]))
+                 << (8 * i);
+    }
+    if (version != Version) {
+      return error("module summary `{}` has format version {} (expected {})",
+                   filename, version, Version);
+    }
+    auto module = llvm::parseBitcodeFile(
+        llvm::MemoryBufferRef{contents.drop_front(header), filename}, ctx);
+    if (!module) {
+      return module.takeError();
+    }
+    return std::move(*module);
+  }
+
+  // pins the struct types of @param module (those its code mentions, and
+  // those its tables name) under the names its tables know them by, so
+  // that a context reading the module back (which renames the types it
+  // has others of the same name for) cannot mix them up. The tables only
+  // name our own types while the module is the one being compiled, so
+  // types pinned before keep their pins.
+  static void pinTypes(llvm::Module& module) {
+    const auto pinned = module.getOrInsertNamedMetadata("types");
+    llvm::StringSet<> names;
+    llvm::SmallPtrSet<llvm::StructType*, 16> known;
+    for (const auto pin : pinned->operands()) {
+      names.insert(llvm::cast<llvm::MDString>(pin->getOperand(0))->getString());
+      known.insert(getPinned(pin));
+    }
+    llvm::SetVector<llvm::StructType*> types;
+    const auto addNamed = [&](const std::string& name) {
+      if (names.count(name)) {
+        return;
+      }
+      if (const auto type = module.getTypeByName(name)) {
+        types.insert(type);
+      }
+    };
+    for (const auto& name : getMetadataParts<1>(module, "structures")) {
+      addNamed(name.str());
+    }
+    for (const auto& name : getMetadataParts<1>(module, "classes")) {
+      const auto base = format("class::{}", name.str());
+      addNamed(base);
+      for (const auto& variant : getMetadataParts(module, "classes", name)) {
+        addNamed(format("{}::{}", base, variant.str()));
+      }
+    }
+    for (const auto type : module.getIdentifiedStructTypes()) {
+      types.insert(type);
+    }
+    llvm::MDBuilder MDBuilder{module.getContext()};
+    for (const auto type : types) {
+      if (!type->hasName() || !known.insert(type).second) {
+        continue;
+      }
+      pinned->addOperand(llvm::MDNode::get(
+          module.getContext(),
+          {MDBuilder.createString(type->getName()),
+           llvm::ConstantAsMetadata::get(
+               llvm::ConstantPointerNull::get(type->getPointerTo()))}));
+    }
+  }
+
+  // the struct types of @param module by the names its tables know them
+  // by: those it pins (summaries pin every type they mention, so we need
+  // not walk their code), else those its code mentions; the pins are of
+  // no use once read
+  static llvm::MapVector<std::string, llvm::StructType*>
+  takeTypes(llvm::Module& module) {
+    llvm::MapVector<std::string, llvm::StructType*> types;
+    llvm::SmallPtrSet<llvm::StructType*, 16> known;
+    if (const auto pinned = module.getNamedMetadata("types")) {
+      for (const auto pin : pinned->operands()) {
+        const auto type = getPinned(pin);
+        if (known.insert(type).second) {
+          types.insert(
+              {llvm::cast<llvm::MDString>(pin->getOperand(0))->getString(),
+               type});
+        }
+      }
+      module.eraseNamedMetadata(pinned);
+      return types;
+    }
+    for (const auto type : module.getIdentifiedStructTypes()) {
+      if (type->hasName() && known.insert(type).second) {
+        types.insert({type->getName(), type});
+      }
+    }
+    return types;
+  }
+
+  // reduces @param module to its summary (in memory)
+  static void summarize(llvm::Module& module) {
+    // declarations alone might not mention every type importers need
+    pinTypes(module);
+    // importers of the summary do not link in what the module imported
+    if (const auto required = module.getNamedMetadata("requires")) {
+      module.eraseNamedMetadata(required);
+    }
+
+    // inline bodies are kept, with the local symbols they refer to, as
+    // long as these are constant: importers get copies of their own
+    llvm::SmallPtrSet<llvm::GlobalValue*, 16> kept;
+    for (auto& func : module) {
+      if (func.isDeclaration() || func.hasLocalLinkage() || !isInline(func)) {
+        continue;
+      }
+      llvm::SmallPtrSet<llvm::GlobalValue*, 16> locals;
+      if (getConstantLocals(func, locals)) {
+        kept.insert(&func);
+        kept.insert(locals.begin(), locals.end());
+      }
+    }
+
+    small_vector<llvm::GlobalValue*> locals;
+    for (auto& func : module) {
+      if (kept.count(&func)) {
+        if (!func.hasLocalLinkage()) {
+          func.setLinkage(llvm::GlobalValue::AvailableExternallyLinkage);
+        }
+        continue;
+      }
+      if (func.hasLocalLinkage()) {
+        locals.push_back(&func);
+      }
+      if (!func.isDeclaration()) {
+        func.deleteBody();
+      }
+    }
+    for (auto& global : module.globals()) {
+      if (kept.count(&global)) {
+        continue;
+      }
+      if (global.hasLocalLinkage()) {
+        locals.push_back(&global);
+      }
+      global.setInitializer(nullptr);
+      global.setLinkage(llvm::GlobalValue::ExternalLinkage);
+    }
+    // only the bodies and initializers we dropped (and each other) used
+    // these
+    for (auto erased = true; erased;) {
+      erased = false;
+      for (auto& local : locals) {
+        if (local && local->use_empty()) {
+          local->eraseFromParent();
+          local = nullptr;
+          erased = true;
+        }
+      }
+    }
+  }
+
+private:
+  static bool isInline(const llvm::Function& func) {
+    return func.hasFnAttribute(llvm::Attribute::InlineHint) ||
+           func.hasFnAttribute(llvm::Attribute::AlwaysInline);
+  }
+
+  // the local symbols @param func refers to, directly or not, into
+  // @param locals; false if any of them is a variable which is mutable
+  // (e.g. a @target_clones dispatch pointer) or whose address matters, as
+  // copies of it would split its state. Pooled constants are fine.
+  static bool
+  getConstantLocals(llvm::Function& func,
+                    llvm::SmallPtrSetImpl<llvm::GlobalValue*>& locals) {
+    small_vector<llvm::GlobalValue*> worklist{&func};
+    while (!worklist.empty()) {
+      const auto value = worklist.pop_back_val();
+      if (const auto callee = llvm::dyn_cast<llvm::Function>(value)) {
+        for (const auto& inst : llvm::instructions(callee)) {
+          addLocals(&inst, locals, worklist);
+        }
+      } else if (const auto global =
+                     llvm::dyn_cast<llvm::GlobalVariable>(value)) {
+        if (!global->isConstant() || !global->hasGlobalUnnamedAddr()) {
+          return false;
+        }
+        if (global->hasInitializer()) {
+          addLocals(global->getInitializer(), locals, worklist);
+        }
+      }
+    }
+    return true;
+  }
+
+  // the local symbols (e.g. pooled constants) @param value refers to
+  static void addLocals(const llvm::User* const value,
+                        llvm::SmallPtrSetImpl<llvm::GlobalValue*>& locals,
+                        small_vector<llvm::GlobalValue*>& worklist) {
+    for (const auto& operand : value->operands()) {
+      const auto global = llvm::dyn_cast<llvm::GlobalValue>(operand.get());
+      if (global && global->hasLocalLinkage()) {
+        if (locals.insert(global).second) {
+          worklist.push_back(global);
+        }
+      } else if (const auto constant =
+                     llvm::dyn_cast<llvm::ConstantExpr>(operand.get())) {
+        addLocals(constant, locals, worklist);
+      } else if (const auto aggregate =
+                     llvm::dyn_cast<llvm::ConstantAggregate>(operand.get())) {
+        addLocals(aggregate, locals, worklist);
+      }
+    }
+  }
+
+  // the struct type @param pin pins
+  static llvm::StructType* getPinned(const llvm::MDNode* const pin) {
+    const auto null =
+        llvm::mdconst::extract<llvm::ConstantPointerNull>(pin->getOperand(1));
+    return llvm::cast<llvm::StructType>(
+        null->getType()->getPointerElementType());
+  }
+};
+
+} // end namespace whack::codegen
+
+#endif // WHACK_SUMMARY_HPP
@@ -37,8 +37,13 @@ public:
     if (!type) {
       return type.takeError();
     }
-    return reinterpret_cast<llvm::Type*>(llvm::ArrayType::get(
-        *type, llvm::dyn_cast<llvm::ConstantInt>(*len)->getZExtValue()));
+    const auto length = llvm::dyn_cast<llvm::ConstantInt>(*len);
+    if (!length) {
+      return error("expected a constant array length at line {}",
+                   ast_->state.row + 1);
+    }
+    return reinterpret_cast<llvm::Type*>(
+        llvm::ArrayType::get(*type, length->getZExtValue()));
   }
 
 private:
@@ -18,54 +18,23 @@
 
 #pragma once
 
-#include "../fwd.hpp"
-#include <lib/IR/LLVMContextImpl.h>
+#include "inference.hpp"
 
 namespace whack::codegen::types {
 
+// `type(expr)`
 class ExprType final : public AST {
 public:
-  explicit ExprType(const mpc_ast_t* const ast)
-      : expr_{expressions::getExpressionValue(ast->children[2])} {}
+  explicit ExprType(const mpc_ast_t* const ast) noexcept
+      : expr_{ast->children[2]} {}
 
-  llvm::Expected<llvm::Type*> codegen(llvm::IRBuilder<>& builder) const {
-    llvm::Module* module;
-    if (const auto block = builder.GetInsertBlock()) {
-      module = block->getModule();
-    } else {
-      module = *builder.getContext().pImpl->OwnedModules.begin();
-    }
-    llvm::Function* func;
-    bool tempFunction = false;
-    if (const auto block = builder.GetInsertBlock()) {
-      func = block->getParent();
-    } else {
-      func = llvm::Function::Create(
-          llvm::FunctionType::get(BasicTypes["void"], false),
-          llvm::Function::ExternalLinkage, "", module);
-      tempFunction = true;
-    }
-    const auto tempBlock =
-        llvm::BasicBlock::Create(func->getContext(), "", func);
-    llvm::IRBuilder<> tmp{tempBlock};
-    auto e = expr_->codegen(tmp);
-    if (!e) {
-      return e.takeError();
-    }
-    auto expr = expressions::getLoadedValue(tmp, *e);
-    if (!expr) {
-      return expr.takeError();
-    }
-    if (tempFunction) {
-      func->eraseFromParent();
-    } else {
-      tempBlock->eraseFromParent();
-    }
-    return (*expr)->getType();
+  inline llvm::Expected<llvm::Type*>
+  codegen(llvm::IRBuilder<>& builder) const {
+    return TypeInference::infer(builder, expr_);
   }
 
 private:
-  const expr_t expr_;
+  const mpc_ast_t* const expr_;
 };
 
 } // end namespace whack::codegen::types
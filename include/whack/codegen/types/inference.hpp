@@ -0,0 +1,222 @@
+/**
+ * Copyright 2018-present Onchere Bironga
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef WHACK_INFERENCE_HPP
+#define WHACK_INFERENCE_HPP
+
+#include "../scope.hpp"
+#include "typecache.hpp"
+#include <llvm/ADT/SmallPtrSet.h>
+
+namespace whack::codegen::types {
+
+/// Infers the type of an expression (for `type(expr)` and type switches)
+/// without leaving IR behind. Types codegen already computed come from
+/// the cache, and most others (literals, names, fields and calls of known
+/// functions) are read off the expression (see Expression::type). As a
+/// fallback, the expression is evaluated speculatively in a scratch block
+/// of the function it is in (so that it sees the locals of the function),
+/// outside any scope, and everything it emits (blocks, hoisted stack
+/// slots, functions and globals of the module) is removed again.
+class TypeInference {
+public:
+  static llvm::Expected<llvm::Type*> infer(llvm::IRBuilder<>& builder,
+                                           const mpc_ast_t* const ast) {
+    const auto block = builder.GetInsertBlock();
+    const auto func = block ? block->getParent() : nullptr;
+    const auto cache = TypeCache::get();
+    const TypeCache::key_t key{ast, func};
+    if (cache) {
+      if (const auto type = cache->find(key)) {
+        return type;
+      }
+    }
+    if (func) {
+      if (const auto type =
+              expressions::getExpressionValue(ast)->type(builder)) {
+        if (cache) {
+          cache->add(key, type);
+        }
+        return type;
+      }
+    } else if (!cache) {
+      return error("cannot infer a type outside of a module");
+    }
+    auto type = func ? inferIn(func, ast) : inferOutside(cache->module(), ast);
+    if (type && cache) {
+      cache->add(key, *type);
+    }
+    return type;
+  }
+
+private:
+  using globals_t = llvm::SmallPtrSet<const llvm::GlobalValue*, 32>;
+
+  // the functions and globals of @param module
+  static globals_t getGlobals(const llvm::Module& module) {
+    globals_t globals;
+    for (const auto& func : module) {
+      globals.insert(&func);
+    }
+    for (const auto& global : module.globals()) {
+      globals.insert(&global);
+    }
+    return globals;
+  }
+
+  // whether @param value is used by anything but the functions and
+  // globals in @param values
+  static bool isUsedOutside(const llvm::Value* const value,
+                            const globals_t& values) {
+    for (const auto user : value->users()) {
+      if (const auto inst = llvm::dyn_cast<llvm::Instruction>(user)) {
+        if (!values.count(inst->getFunction())) {
+          return true;
+        }
+      } else if (const auto global = llvm::dyn_cast<llvm::GlobalValue>(user)) {
+        if (!values.count(global)) {
+          return true;
+        }
+      } else if (isUsedOutside(user, values)) { // (constant expressions)
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // erases the functions and globals of @param module not in
+  // @param existing (e.g. instances and pooled constants evaluation
+  // added), which only the scratch code we removed used (or each other,
+  // e.g. recursive instances); nothing else may use them
+  static void eraseAdded(llvm::Module& module, const globals_t& existing) {
+    small_vector<llvm::GlobalValue*> added;
+    globals_t unused;
+    for (auto& func : module) {
+      if (!existing.count(&func)) {
+        added.push_back(&func);
+        unused.insert(&func);
+      }
+    }
+    for (auto& global : module.globals()) {
+      if (!existing.count(&global)) {
+        added.push_back(&global);
+        unused.insert(&global);
+      }
+    }
+    // what is used from outside stays, and so does what it uses
+    for (auto kept = true; kept;) {
+      kept = false;
+      for (const auto value : added) {
+        if (unused.count(value) && isUsedOutside(value, unused)) {
+          unused.erase(value);
+          kept = true;
+        }
+      }
+    }
+    assert(unused.size() == added.size() &&
+           "code outside of type inference uses what evaluation added");
+    for (const auto value : added) {
+      if (unused.count(value)) {
+        value->dropAllReferences();
+      }
+    }
+    for (const auto value : added) {
+      if (!unused.count(value)) {
+        continue;
+      }
+      if (const auto func = llvm::dyn_cast<llvm::Function>(value)) {
+        TypeCache::forget(func);
+      }
+      value->eraseFromParent();
+    }
+  }
+
+  static llvm::Expected<llvm::Type*> evaluate(llvm::BasicBlock* const block,
+                                              const mpc_ast_t* const ast) {
+    Scope::Detached detached;
+    llvm::IRBuilder<> tmp{block};
+    auto e = expressions::getExpressionValue(ast)->codegen(tmp);
+    if (!e) {
+      return e.takeError();
+    }
+    auto expr = expressions::getLoadedValue(tmp, *e);
+    if (!expr) {
+      return expr.takeError();
+    }
+    return (*expr)->getType();
+  }
+
+  static llvm::Expected<llvm::Type*> inferIn(llvm::Function* const func,
+                                             const mpc_ast_t* const ast) {
+    llvm::SmallPtrSet<const llvm::Value*, 16> existing;
+    for (const auto& block : *func) {
+      existing.insert(&block);
+    }
+    auto& entry = func->getEntryBlock();
+    for (const auto& inst : entry) {
+      existing.insert(&inst);
+    }
+    const auto module = func->getParent();
+    const auto globals = getGlobals(*module);
+    const auto scratch =
+        llvm::BasicBlock::Create(func->getContext(), "", func);
+    auto type = evaluate(scratch, ast);
+    // the blocks evaluation created, then the stack slots it hoisted
+    small_vector<llvm::BasicBlock*> blocks;
+    for (auto& block : *func) {
+      if (!existing.count(&block)) {
+        blocks.push_back(&block);
+      }
+    }
+    for (const auto block : blocks) {
+      block->dropAllReferences();
+    }
+    for (const auto block : blocks) {
+      block->eraseFromParent();
+    }
+    // (later slots may use earlier ones)
+    small_vector<llvm::Instruction*> hoisted;
+    for (auto& inst : entry) {
+      if (!existing.count(&inst)) {
+        hoisted.push_back(&inst);
+      }
+    }
+    for (const auto inst : llvm::reverse(hoisted)) {
+      if (inst->use_empty()) {
+        inst->eraseFromParent();
+      }
+    }
+    eraseAdded(*module, globals);
+    return type;
+  }
+
+  // e.g. types of module-level aliases: we evaluate in a scratch function
+  static llvm::Expected<llvm::Type*> inferOutside(llvm::Module* const module,
+                                                  const mpc_ast_t* const ast) {
+    const auto globals = getGlobals(*module);
+    const auto func = llvm::Function::Create(
+        llvm::FunctionType::get(BasicTypes["void"], false),
+        llvm::Function::ExternalLinkage, "", module);
+    const auto entry =
+        llvm::BasicBlock::Create(func->getContext(), "", func);
+    auto type = evaluate(entry, ast);
+    eraseAdded(*module, globals); // the scratch function too
+    return type;
+  }
+};
+
+} // end namespace whack::codegen::types
+
+#endif // WHACK_INFERENCE_HPP
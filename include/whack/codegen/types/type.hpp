@@ -18,9 +18,11 @@
 
 #pragma once
 
+#include "../arena.hpp"
 #include "arraytype.hpp"
 #include "exprtype.hpp"
 #include "fntype.hpp"
+#include "vectortype.hpp"
 #include <llvm/Support/raw_ostream.h>
 
 namespace whack::codegen::types {
@@ -51,14 +53,15 @@ public:
       return ArrayType{ast_}.codegen(builder);
     }
 
+    if (tag == "vectortype") {
+      return VectorType{ast_}.codegen(builder);
+    }
+
     if (tag == "overloadid" || tag == "scoperes" || tag == "ident") {
       const auto identifier = expressions::factors::getIdentifierString(ast_);
-      llvm::Module* module;
-      if (const auto block = builder.GetInsertBlock()) {
-        module = block->getModule();
-      } else {
-        module = *builder.getContext().pImpl->OwnedModules.begin();
-      }
+      const auto block = builder.GetInsertBlock();
+      const auto module =
+          block ? block->getModule() : TypeCache::get()->module();
       if (auto type = getFromTypeName(module, identifier)) {
         return type.value();
       }
@@ -90,6 +93,10 @@ public:
       return type;
     }
 
+    if (typeName == "arena") {
+      return Arena::getType(module);
+    }
+
     if (auto type = module->getTypeByName(typeName)) {
       return type;
     }
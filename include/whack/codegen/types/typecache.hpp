@@ -0,0 +1,91 @@
+/**
+ * Copyright 2018-present Onchere Bironga
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef WHACK_TYPECACHE_HPP
+#define WHACK_TYPECACHE_HPP
+
+#pragma once
+
+#include "../fwd.hpp"
+
+namespace whack::codegen::types {
+
+/// The types inferred for the expressions of the module being compiled,
+/// by AST node and the function the expression is in (which binds its
+/// names). Expression codegen records the types it computes here, and
+/// inference fills in the rest. Each module compiled (e.g. an import)
+/// gets its own cache.
+class TypeCache {
+public:
+  using key_t = std::pair<const mpc_ast_t*, const llvm::Function*>;
+
+  explicit TypeCache(llvm::Module* const module)
+      : outer_{std::exchange(current(), this)}, module_{module} {}
+  ~TypeCache() { current() = outer_; }
+
+  TypeCache(const TypeCache&) = delete;
+  TypeCache& operator=(const TypeCache&) = delete;
+
+  static TypeCache* get() { return current(); }
+
+  // the module being compiled (e.g. for code outside of functions)
+  llvm::Module* module() const { return module_; }
+
+  llvm::Type* find(const key_t& key) const {
+    const auto type = types_.find(key);
+    return type == types_.end() ? nullptr : type->second;
+  }
+
+  void add(const key_t& key, llvm::Type* const type) { types_[key] = type; }
+
+  // notes the type codegen gave the expression at @param ast
+  static void record(const llvm::IRBuilder<>& builder,
+                     const mpc_ast_t* const ast, llvm::Value* const value) {
+    const auto cache = get();
+    const auto block = builder.GetInsertBlock();
+    if (!cache || !block) {
+      return;
+    }
+    if (const auto type = expressions::getLoadedType(value)) {
+      cache->add({ast, block->getParent()}, type);
+    }
+  }
+
+  // @param func is going away (its address may be reused)
+  static void forget(const llvm::Function* const func) {
+    if (const auto cache = get()) {
+      for (auto type = cache->types_.begin(); type != cache->types_.end();) {
+        const auto current = type++;
+        if (current->first.second == func) {
+          cache->types_.erase(current);
+        }
+      }
+    }
+  }
+
+private:
+  TypeCache* const outer_;
+  llvm::Module* const module_;
+  llvm::DenseMap<key_t, llvm::Type*> types_;
+
+  static TypeCache*& current() {
+    thread_local TypeCache* cache{nullptr};
+    return cache;
+  }
+};
+
+} // end namespace whack::codegen::types
+
+#endif // WHACK_TYPECACHE_HPP
@@ -26,9 +26,18 @@
 
 namespace whack {
 
+// the context of the module being compiled on this thread (see
+// codegen::Module::codegen), if any; modules compile concurrently in batches
+inline static llvm::LLVMContext*& getTypeContext() {
+  thread_local llvm::LLVMContext* ctx{nullptr};
+  return ctx;
+}
+
 static llvm::Type* const getBasicType(const llvm::StringRef typeName) {
   using namespace llvm;
-  auto& ctx = *reinterpret_cast<LLVMContext*>(LLVMGetGlobalContext());
+  auto& ctx = getTypeContext()
+                  ? *getTypeContext()
+                  : *reinterpret_cast<LLVMContext*>(LLVMGetGlobalContext());
   return StringSwitch<llvm::Type*>(typeName)
       .Case("void", Type::getVoidTy(ctx))
       .Case("bool", Type::getInt1Ty(ctx))
@@ -60,7 +69,7 @@ static struct BasicTypes {
 } BasicTypes;
 
 // @todo References?
-static auto getTypeName(llvm::Type* type) {
+static std::string getTypeName(llvm::Type* type) {
   size_t numPointers = 0;
   while (type->isPointerTy()) {
     ++numPointers;
@@ -68,7 +77,10 @@ static auto getTypeName(llvm::Type* type) {
   }
   std::string typeName;
   llvm::raw_string_ostream os{typeName};
-  if (!type->isPointerTy()) {
+  if (type->isVectorTy()) {
+    os << "vec<" << getTypeName(type->getVectorElementType()) << ", "
+       << type->getVectorNumElements() << '>';
+  } else if (!type->isPointerTy()) {
     // @todo Signed integers, enums, data classes, functions?
     if (type->isIntegerTy()) {
       switch (type->getPrimitiveSizeInBits()) {
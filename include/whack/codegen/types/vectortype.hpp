@@ -0,0 +1,90 @@
+/**
+ * Copyright 2018-present Onchere Bironga
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef WHACK_VECTORTYPE_HPP
+#define WHACK_VECTORTYPE_HPP
+
+#include "../fwd.hpp"
+
+namespace whack::codegen::types {
+
+/// A SIMD vector, e.g. `vec<float, 8>`
+class VectorType final : public AST {
+public:
+  explicit constexpr VectorType(const mpc_ast_t* const ast) noexcept
+      : ast_{ast} {}
+
+  llvm::Expected<llvm::Type*> codegen(llvm::IRBuilder<>& builder) const {
+    auto type = getType(ast_->children[2], builder);
+    if (!type) {
+      return type.takeError();
+    }
+    if (!llvm::VectorType::isValidElementType(*type)) {
+      return error("invalid vector element type at line {}",
+                   ast_->state.row + 1);
+    }
+    const auto lanes = std::stoul(ast_->children[4]->contents);
+    if (!lanes) {
+      return error("expected a non-zero number of vector lanes at line {}",
+                   ast_->state.row + 1);
+    }
+    return reinterpret_cast<llvm::Type*>(
+        llvm::VectorType::get(*type, static_cast<unsigned>(lanes)));
+  }
+
+  // @param value as a lane of a vector with @param elementType, converting
+  // literals (e.g. the double in `v * 2.0`); nullptr if it does not fit
+  static llvm::Value* getLane(llvm::IRBuilder<>& builder,
+                              llvm::Value* const value,
+                              llvm::Type* const elementType) {
+    const auto type = value->getType();
+    if (type == elementType) {
+      return value;
+    }
+    if (llvm::isa<llvm::ConstantInt>(value) && elementType->isIntegerTy()) {
+      return builder.CreateSExtOrTrunc(value, elementType);
+    }
+    if (llvm::isa<llvm::ConstantFP>(value) &&
+        elementType->isFloatingPointTy()) {
+      return builder.CreateFPCast(value, elementType);
+    }
+    return nullptr;
+  }
+
+private:
+  const mpc_ast_t* const ast_;
+};
+
+// broadcasts a scalar operand of an element-wise operation on a vector
+// to every lane, e.g. in `v * 2.0`
+static void splatScalarOperand(llvm::IRBuilder<>& builder, llvm::Value*& lhs,
+                               llvm::Value*& rhs) {
+  const auto splat = [&](llvm::Value* const vector, llvm::Value*& scalar) {
+    const auto type = vector->getType();
+    if (!type->isVectorTy() || scalar->getType()->isVectorTy()) {
+      return;
+    }
+    if (const auto lane = VectorType::getLane(
+            builder, scalar, type->getVectorElementType())) {
+      scalar = builder.CreateVectorSplat(type->getVectorNumElements(), lane);
+    }
+  };
+  splat(lhs, rhs);
+  splat(rhs, lhs);
+}
+
+} // end namespace whack::codegen::types
+
+#endif // WHACK_VECTORTYPE_HPP
@@ -18,6 +18,8 @@
 
 #pragma once
 
+#include <llvm/Support/raw_ostream.h>
+#include <spdlog/sinks/base_sink.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 
 namespace whack {
@@ -32,14 +34,61 @@ inline static constexpr auto format(Args&&... args) {
 
 inline static auto Log = spdlog::stderr_color_mt("whack");
 
+/// Where a thread reports what it compiles: stdout, stderr and Log unless
+/// it was given streams (e.g. by a compile server request, whose output
+/// goes back to its client) and a log writing to them
+struct Diagnostics {
+  llvm::raw_ostream* out{nullptr};
+  llvm::raw_ostream* err{nullptr};
+  std::shared_ptr<spdlog::logger> log{nullptr};
+
+  static Diagnostics& get() {
+    thread_local Diagnostics diagnostics;
+    return diagnostics;
+  }
+};
+
+/// Logs to a stream, e.g. that of Diagnostics::err
+class StreamSink final : public spdlog::sinks::base_sink<std::mutex> {
+public:
+  explicit StreamSink(llvm::raw_ostream& stream) : stream_{stream} {}
+
+protected:
+  void sink_it_(const spdlog::details::log_msg& msg) final {
+    fmt::memory_buffer formatted;
+    this->formatter_->format(msg, formatted);
+    stream_.write(formatted.data(), formatted.size());
+  }
+
+  void flush_() final { stream_.flush(); }
+
+private:
+  llvm::raw_ostream& stream_;
+};
+
+inline static llvm::raw_ostream& outs() {
+  const auto out = Diagnostics::get().out;
+  return out ? *out : llvm::outs();
+}
+
+inline static llvm::raw_ostream& errs() {
+  const auto err = Diagnostics::get().err;
+  return err ? *err : llvm::errs();
+}
+
+inline static spdlog::logger& getLog() {
+  const auto& log = Diagnostics::get().log;
+  return log ? *log : *Log;
+}
+
 FORMAT_TPL
 inline static void fatal(Args&&... args) {
-  Log->critical(std::forward<Args>(args)...);
+  getLog().critical(std::forward<Args>(args)...);
 }
 
 FORMAT_TPL
 inline static void warning(Args&&... args) {
-  Log->warn(std::forward<Args>(args)...);
+  getLog().warn(std::forward<Args>(args)...);
 }
 
 #undef FORMAT_TPL
@@ -0,0 +1,110 @@
+/**
+ * Copyright 2018-present Onchere Bironga
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef WHACK_OPTIONS_HPP
+#define WHACK_OPTIONS_HPP
+
+#include "format.hpp"
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <string>
+#include <vector>
+
+enum OptLevel { d, O1, O2, O3 };
+enum SizeOptLevel { O0, Os, Oz };
+
+// The command line (see lib/whack/main.cpp). Options are per thread so
+// that compile server requests run side by side.
+extern thread_local std::vector<std::string> InputFilenames;
+extern thread_local std::string GrammarFilename;
+extern thread_local std::string OutputObjectFilename;
+extern thread_local std::string OutputExecutableFilename;
+extern thread_local bool EmitLLVM;
+extern thread_local unsigned NumJobs;
+extern thread_local bool BuildProject;
+extern thread_local OptLevel OptimizationLevel;
+extern thread_local SizeOptLevel SizeOptimizationLevel;
+extern thread_local std::vector<std::string> ModuleSearchPaths;
+// -mcpu (or -march) and -mattr
+extern thread_local std::string TargetCPU;
+extern thread_local std::string TargetFeatures;
+// where relative paths are, if not the process's working directory
+extern thread_local std::string WorkingDirectory;
+
+namespace whack {
+
+/// The options (and diagnostics) of the compile on this thread, for the
+/// threads it spreads its work over
+struct Options {
+  std::vector<std::string> inputFilenames;
+  std::string grammarFilename;
+  std::string outputObjectFilename;
+  std::string outputExecutableFilename;
+  bool emitLLVM;
+  unsigned numJobs;
+  bool buildProject;
+  OptLevel optimizationLevel;
+  SizeOptLevel sizeOptimizationLevel;
+  std::vector<std::string> moduleSearchPaths;
+  std::string targetCPU;
+  std::string targetFeatures;
+  std::string workingDirectory;
+  Diagnostics diagnostics;
+
+  static Options get() {
+    return {InputFilenames,        GrammarFilename,
+            OutputObjectFilename,  OutputExecutableFilename,
+            EmitLLVM,              NumJobs,
+            BuildProject,          OptimizationLevel,
+            SizeOptimizationLevel, ModuleSearchPaths,
+            TargetCPU,             TargetFeatures,
+            WorkingDirectory,      Diagnostics::get()};
+  }
+
+  void use() const {
+    InputFilenames = inputFilenames;
+    GrammarFilename = grammarFilename;
+    OutputObjectFilename = outputObjectFilename;
+    OutputExecutableFilename = outputExecutableFilename;
+    EmitLLVM = emitLLVM;
+    NumJobs = numJobs;
+    BuildProject = buildProject;
+    OptimizationLevel = optimizationLevel;
+    SizeOptimizationLevel = sizeOptimizationLevel;
+    ModuleSearchPaths = moduleSearchPaths;
+    TargetCPU = targetCPU;
+    TargetFeatures = targetFeatures;
+    WorkingDirectory = workingDirectory;
+    Diagnostics::get() = diagnostics;
+  }
+};
+
+// @param path (if relative, to WorkingDirectory) as an absolute path
+inline static std::string getAbsolutePath(const llvm::StringRef path) {
+  llvm::SmallString<256> absolute{path};
+  if (absolute.empty()) {
+    return {};
+  }
+  if (WorkingDirectory.empty()) {
+    (void)llvm::sys::fs::make_absolute(absolute);
+  } else {
+    llvm::sys::fs::make_absolute(WorkingDirectory, absolute);
+  }
+  return absolute.str();
+}
+
+} // end namespace whack
+
+#endif // WHACK_OPTIONS_HPP
@@ -0,0 +1,292 @@
+/**
+ * Copyright 2018-present Onchere Bironga
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef WHACK_PASSES_HEAP2STACK_HPP
+#define WHACK_PASSES_HEAP2STACK_HPP
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/MemoryBuiltins.h>
+#include <llvm/Analysis/TargetLibraryInfo.h>
+#include <llvm/IR/CallSite.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/Pass.h>
+#include <llvm/Transforms/Utils/BasicBlockUtils.h>
+
+namespace whack::pass {
+
+/// Promotes heap allocations (e.g. of `new`) whose pointer never escapes
+/// the function making them. Small constant-size allocations become entry
+/// block stack slots (which SROA may then split up). Others are carved out
+/// of the thread's bump region in the runtime, which the function releases
+/// as it returns, when that cannot grow the region without bound: they are
+/// freed last in, first out within the block making them (so within one
+/// iteration of any loop), or never freed outside of loops. Matching frees
+/// are dropped, or (in the region) pop the allocation; the rest stay on
+/// the heap.
+class HeapToStack final : public llvm::FunctionPass {
+public:
+  inline static char ID = 0;
+
+  // larger allocations go to the region to keep frames small
+  constexpr static uint64_t MaxStackAllocSize = 1024;
+
+  HeapToStack() : llvm::FunctionPass(ID) {}
+
+  llvm::StringRef getPassName() const final { return "Whack heap to stack"; }
+
+  void getAnalysisUsage(llvm::AnalysisUsage& usage) const final {
+    usage.addRequired<llvm::TargetLibraryInfoWrapperPass>();
+    usage.addRequired<llvm::LoopInfoWrapperPass>();
+  }
+
+  bool runOnFunction(llvm::Function& func) final {
+    if (skipFunction(func)) {
+      return false;
+    }
+    const auto& tli =
+        getAnalysis<llvm::TargetLibraryInfoWrapperPass>().getTLI();
+    const auto& loops = getAnalysis<llvm::LoopInfoWrapperPass>().getLoopInfo();
+    allocs_t allocs;
+    for (auto& inst : llvm::instructions(func)) {
+      const auto call = llvm::dyn_cast<llvm::CallInst>(&inst);
+      if (!call || !llvm::isMallocLikeFn(call, &tli)) {
+        continue;
+      }
+      frees_t frees;
+      if (!escapes(call, frees, tli)) {
+        allocs.emplace_back(call, std::move(frees));
+      }
+    }
+    // ramps of coroutines return on every suspend
+    llvm::SmallPtrSet<llvm::CallInst*, 8> regionAllocs;
+    if (!func.hasFnAttribute("coroutine.presplit")) {
+      // (decided before we split blocks below)
+      for (const auto& [alloc, frees] : allocs) {
+        if (!isStackable(alloc) && isStackLike(alloc, frees, allocs, loops)) {
+          regionAllocs.insert(alloc);
+        }
+      }
+    }
+    llvm::Value* mark = nullptr;
+    auto changed = false;
+    for (const auto& [alloc, frees] : allocs) {
+      llvm::IRBuilder<> builder{alloc};
+      llvm::Value* mem;
+      if (isStackable(alloc)) {
+        const auto size =
+            llvm::cast<llvm::ConstantInt>(alloc->getArgOperand(0));
+        builder.SetInsertPoint(getEntryInsertPt(func));
+        const auto slot = builder.CreateAlloca(builder.getInt8Ty(), size);
+        slot->setAlignment(MallocAlignment);
+        mem = slot;
+        for (const auto free : frees) {
+          free->eraseFromParent();
+        }
+      } else if (regionAllocs.count(alloc)) {
+        if (!mark) {
+          mark = createRegionMark(func);
+        }
+        const auto module = func.getParent();
+        const auto charPtrTy = builder.getInt8PtrTy();
+        const auto region = builder.CreateCall(
+            module->getOrInsertFunction("__builtin_region_alloc", charPtrTy,
+                                        builder.getInt64Ty()),
+            builder.CreateZExtOrTrunc(alloc->getArgOperand(0),
+                                      builder.getInt64Ty()));
+        // the region may fail to grow; the heap gets its chance then
+        const auto fallback = llvm::SplitBlockAndInsertIfThen(
+            builder.CreateICmpEQ(region,
+                                 llvm::ConstantPointerNull::get(charPtrTy)),
+            alloc, false);
+        builder.SetInsertPoint(fallback);
+        const auto heap = builder.Insert(alloc->clone());
+        const auto heapMem = builder.CreatePointerCast(heap, charPtrTy);
+        builder.SetInsertPoint(alloc);
+        const auto phi = builder.CreatePHI(charPtrTy, 2);
+        phi->addIncoming(region, region->getParent());
+        phi->addIncoming(heapMem, fallback->getParent());
+        mem = phi;
+        // which hands memory from the heap back to free
+        const auto regionFree = module->getOrInsertFunction(
+            "__builtin_region_free", builder.getVoidTy(),
+            builder.getInt8PtrTy());
+        for (const auto free : frees) {
+          builder.SetInsertPoint(free);
+          builder.CreateCall(regionFree,
+                             builder.CreatePointerCast(free->getArgOperand(0),
+                                                       builder.getInt8PtrTy()));
+          free->eraseFromParent();
+        }
+      } else {
+        continue;
+      }
+      mem->takeName(alloc);
+      builder.SetInsertPoint(alloc);
+      alloc->replaceAllUsesWith(
+          builder.CreatePointerCast(mem, alloc->getType()));
+      alloc->eraseFromParent();
+      changed = true;
+    }
+    return changed;
+  }
+
+private:
+  using frees_t = llvm::SmallVector<llvm::CallInst*, 4>;
+  using allocs_t = llvm::SmallVector<std::pair<llvm::CallInst*, frees_t>, 8>;
+
+  constexpr static unsigned MallocAlignment = 16;
+
+  static bool isStackable(const llvm::CallInst* const alloc) {
+    const auto size =
+        llvm::dyn_cast<llvm::ConstantInt>(alloc->getArgOperand(0));
+    return size && size->getZExtValue() <= MaxStackAllocSize;
+  }
+
+  // whether the region can hold the memory of @param alloc without growing
+  // per loop iteration: its single free (of @param frees) follows it in its
+  // block, after those of the other region candidates (of @param allocs)
+  // allocated in between; or, outside of loops, nothing frees it
+  static bool isStackLike(llvm::CallInst* const alloc, const frees_t& frees,
+                          const allocs_t& allocs, const llvm::LoopInfo& loops) {
+    const auto block = alloc->getParent();
+    if (frees.empty()) {
+      return !loops.getLoopFor(block);
+    }
+    if (frees.size() != 1 || frees[0]->getParent() != block) {
+      return false;
+    }
+    llvm::DenseMap<const llvm::CallInst*, const frees_t*> candidates;
+    for (const auto& [other, otherFrees] : allocs) {
+      if (other != alloc && !isStackable(other)) {
+        candidates[other] = &otherFrees;
+      }
+    }
+    llvm::SmallPtrSet<const llvm::Instruction*, 4> pending;
+    for (auto inst = std::next(alloc->getIterator()); &*inst != frees[0];
+         ++inst) {
+      pending.erase(&*inst);
+      const auto call = llvm::dyn_cast<llvm::CallInst>(&*inst);
+      const auto other = call ? candidates.find(call) : candidates.end();
+      if (other == candidates.end()) {
+        continue;
+      }
+      const auto& otherFrees = *other->second;
+      if (otherFrees.size() != 1 || otherFrees[0]->getParent() != block) {
+        return false;
+      }
+      pending.insert(otherFrees[0]);
+    }
+    return pending.empty();
+  }
+
+  // whether the memory @param alloc returns may be reached once it returns,
+  // or be released other than by the calls to free collected in @param frees
+  static bool escapes(llvm::CallInst* const alloc, frees_t& frees,
+                      const llvm::TargetLibraryInfo& tli) {
+    llvm::SmallVector<const llvm::Use*, 16> worklist;
+    llvm::SmallPtrSet<const llvm::Value*, 16> visited;
+    const auto addUses = [&](const llvm::Value* const value) {
+      for (const auto& use : value->uses()) {
+        worklist.push_back(&use);
+      }
+    };
+    addUses(alloc);
+    while (!worklist.empty()) {
+      const auto use = worklist.pop_back_val();
+      const auto user = use->getUser();
+      if (llvm::isa<llvm::LoadInst>(user) || llvm::isa<llvm::ICmpInst>(user)) {
+        continue;
+      }
+      if (const auto store = llvm::dyn_cast<llvm::StoreInst>(user)) {
+        if (use->getOperandNo() != store->getPointerOperandIndex()) {
+          return true; // we store the pointer itself
+        }
+        continue;
+      }
+      if (llvm::isa<llvm::BitCastInst>(user) ||
+          llvm::isa<llvm::GetElementPtrInst>(user)) {
+        if (visited.insert(user).second) {
+          addUses(user);
+        }
+        continue;
+      }
+      const auto call = llvm::dyn_cast<llvm::CallInst>(user);
+      if (!call) {
+        return true; // e.g. returned, or merged in a phi
+      }
+      if (llvm::isFreeCall(call, &tli)) {
+        frees.push_back(call);
+        continue;
+      }
+      if (llvm::isa<llvm::MemIntrinsic>(call) ||
+          llvm::isa<llvm::DbgInfoIntrinsic>(call)) {
+        continue;
+      }
+      if (const auto intrinsic = llvm::dyn_cast<llvm::IntrinsicInst>(call);
+          intrinsic &&
+          (intrinsic->getIntrinsicID() == llvm::Intrinsic::lifetime_start ||
+           intrinsic->getIntrinsicID() == llvm::Intrinsic::lifetime_end)) {
+        continue;
+      }
+      // other callees could keep or release the memory unless they can
+      // only read it
+      const llvm::CallSite site{call};
+      if (!site.isArgOperand(use) || !site.onlyReadsMemory() ||
+          !site.doesNotCapture(site.getArgumentNo(use))) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static llvm::Instruction* getEntryInsertPt(llvm::Function& func) {
+    auto& entry = func.getEntryBlock();
+    auto insertPt = entry.getFirstInsertionPt();
+    while (insertPt != entry.end() && llvm::isa<llvm::AllocaInst>(*insertPt)) {
+      ++insertPt;
+    }
+    return &*insertPt;
+  }
+
+  // notes the top of the region on entry to @param func, and releases
+  // everything allocated above it whenever it returns
+  static llvm::Value* createRegionMark(llvm::Function& func) {
+    const auto module = func.getParent();
+    llvm::IRBuilder<> builder{getEntryInsertPt(func)};
+    const auto mark = builder.CreateCall(
+        module->getOrInsertFunction("__builtin_region_mark",
+                                    builder.getInt8PtrTy()),
+        llvm::None, "region.mark");
+    const auto release = module->getOrInsertFunction(
+        "__builtin_region_release", builder.getVoidTy(),
+        builder.getInt8PtrTy());
+    for (auto& block : func) {
+      if (const auto ret =
+              llvm::dyn_cast<llvm::ReturnInst>(block.getTerminator())) {
+        builder.SetInsertPoint(ret);
+        builder.CreateCall(release, mark);
+      }
+    }
+    return mark;
+  }
+};
+
+} // end namespace whack::pass
+
+#endif // WHACK_PASSES_HEAP2STACK_HPP
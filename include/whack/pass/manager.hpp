@@ -16,29 +16,85 @@
 #ifndef WHACK_PASSES_MANAGER_HPP
 #define WHACK_PASSES_MANAGER_HPP
 
+#include "../format.hpp"
+#include "../options.hpp"
+#include "heap2stack.hpp"
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/IR/DiagnosticHandler.h>
+#include <llvm/IR/DiagnosticInfo.h>
 #include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Target/TargetMachine.h>
 #include <llvm/Transforms/Coroutines.h>
+#include <llvm/Transforms/IPO.h>
 #include <llvm/Transforms/IPO/PassManagerBuilder.h>
+#include <map>
 
-enum OptLevel { d, O1, O2, O3 };
-enum SizeOptLevel { O0, Os, Oz };
+namespace whack::pass {
 
-extern OptLevel OptimizationLevel;
-extern SizeOptLevel SizeOptimizationLevel;
+/// Reports loop optimization hints (e.g. @vectorize, @unroll(4)) which
+/// could not be honored as warnings
+class RemarkHandler final : public llvm::DiagnosticHandler {
+public:
+  bool handleDiagnostics(const llvm::DiagnosticInfo& info) final {
+    using namespace llvm;
+    const auto remark = dyn_cast<DiagnosticInfoOptimizationBase>(&info);
+    if (!remark) {
+      return false;
+    }
+    // forced vectorization, interleaving and distribution fail loudly;
+    // unrolling reports loops too large to unroll "as directed"
+    if (isa<DiagnosticInfoOptimizationFailure>(remark) ||
+        (isa<OptimizationRemarkMissed>(remark) &&
+         remark->getRemarkName().contains("AsDirected"))) {
+      warning("{} (in function `{}`)", remark->getMsg(),
+              remark->getFunction().getName().str());
+      return true;
+    }
+    return false; // the default handling (e.g. errors) applies
+  }
 
-namespace whack::pass {
+  bool isMissedOptRemarkEnabled(llvm::StringRef passName) const final {
+    return passName == "loop-unroll";
+  }
+};
 
 class Manager {
 public:
-  Manager() {
+  // @param wholeProgram is false for the modules of a project build, which
+  // keep what their importers may use
+  explicit Manager(llvm::TargetMachine* const machine,
+                   const bool wholeProgram = true) {
     llvm::PassManagerBuilder passManagerBuilder;
     passManagerBuilder.OptLevel = OptimizationLevel;
     passManagerBuilder.SizeLevel = SizeOptimizationLevel;
-    // llvm::addCoroutinePassesToExtensionPoints(passManagerBuilder);
+    // cost models (e.g. vector widths) are those of the CPU and features
+    // we target, or those of the function (@target)
+    passManager_.add(llvm::createTargetTransformInfoWrapperPass(
+        machine->getTargetIRAnalysis()));
+    machine->adjustPassManager(passManagerBuilder);
+    // generators are split into ramp/resume/destroy functions at every
+    // level (including -d); their frames are elided when inlined
+    llvm::addCoroutinePassesToExtensionPoints(passManagerBuilder);
+    // once inlining has exposed `new`s that stay local (SROA runs next)
+    passManagerBuilder.addExtension(
+        llvm::PassManagerBuilder::EP_CGSCCOptimizerLate,
+        [](const llvm::PassManagerBuilder&,
+           llvm::legacy::PassManagerBase& passManager) {
+          passManager.add(new HeapToStack);
+        });
+    // we compile whole programs: what is neither an entry point nor
+    // exported is internal, so that it can be inlined and deleted freely
+    if (wholeProgram) {
+      passManager_.add(llvm::createInternalizePass(isPreserved));
+      passManager_.add(llvm::createGlobalDCEPass());
+      passManager_.add(llvm::createStripDeadPrototypesPass());
+    }
     passManagerBuilder.populateModulePassManager(passManager_);
   }
 
   inline bool run(llvm::Module& module) {
+    module.getContext().setDiagnosticHandler(
+        std::make_unique<RemarkHandler>());
     return passManager_.run(module);
   }
 
@@ -46,8 +102,46 @@ public:
     return this->run(*module);
   }
 
+  // the pipeline for @param machine (which lives as long as the thread)
+  // at the current optimization levels; pipelines are kept for the
+  // lifetime of the thread (e.g. across compile server requests, or the
+  // jobs of a batch compile)
+  static Manager& get(llvm::TargetMachine* const machine,
+                      const bool wholeProgram = true) {
+    thread_local std::map<
+        std::tuple<llvm::TargetMachine*, OptLevel, SizeOptLevel, bool>,
+        std::unique_ptr<Manager>>
+        managers;
+    auto& manager = managers[{machine, OptimizationLevel,
+                              SizeOptimizationLevel, wholeProgram}];
+    if (!manager) {
+      manager = std::make_unique<Manager>(machine, wholeProgram);
+    }
+    return *manager;
+  }
+
 private:
   llvm::legacy::PassManager passManager_;
+
+  // entry points, and the symbols the program exports (e.g. to C code)
+  static bool isPreserved(const llvm::GlobalValue& value) {
+    const auto name = value.getName();
+    if (name == "main" || name == "wain") {
+      return true;
+    }
+    const auto exports = value.getParent()->getNamedMetadata("exports");
+    if (!exports) {
+      return false;
+    }
+    for (const auto exported : exports->operands()) {
+      const auto symbol =
+          llvm::dyn_cast<llvm::MDString>(exported->getOperand(0).get());
+      if (symbol && symbol->getString() == name) {
+        return true;
+      }
+    }
+    return false;
+  }
 };
 
 } // end namespace whack::pass
@@ -0,0 +1,438 @@
+/**
+ * Copyright 2018-present Onchere Bironga
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef WHACK_SERVER_HPP
+#define WHACK_SERVER_HPP
+
+#include "error.hpp"
+#include "format.hpp"
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <llvm/ADT/Optional.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/ThreadPool.h>
+#include <llvm/Support/raw_ostream.h>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+#include <afunix.h>
+#include <winsock2.h>
+#else
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace whack::server {
+
+#ifdef _WIN32
+using socket_t = SOCKET;
+constexpr static auto InvalidSocket = INVALID_SOCKET;
+constexpr static int SendFlags = 0; // no SIGPIPE on Windows
+inline static int closeSocket(const socket_t s) { return closesocket(s); }
+#else
+using socket_t = int;
+constexpr static auto InvalidSocket = -1;
+// a client hanging up must not kill the server
+#ifdef MSG_NOSIGNAL
+constexpr static int SendFlags = MSG_NOSIGNAL;
+#else
+constexpr static int SendFlags = 0; // see Server::serve
+#endif
+inline static int closeSocket(const socket_t s) { return ::close(s); }
+#endif
+
+// the socket a server listens on unless given one, in a directory of the
+// user's own (see makePrivateDirectory)
+static std::string getDefaultSocketPath() {
+  llvm::SmallString<128> path;
+#ifdef _WIN32
+  // (the temporary directory is the user's)
+  llvm::sys::path::system_temp_directory(true, path);
+  llvm::sys::path::append(path, "whack");
+#else
+  const auto runtime = std::getenv("XDG_RUNTIME_DIR");
+  if (runtime && *runtime) {
+    path = runtime;
+    llvm::sys::path::append(path, "whack");
+  } else {
+    path = format("/tmp/whack-{}", ::getuid());
+  }
+#endif
+  llvm::sys::path::append(path, "whack.sock");
+  return path.str();
+}
+
+// creates the directory of the socket at @param path if need be, and
+// makes sure that it is ours alone: whoever can write to it can replace
+// the socket, and hence see (and answer) the command lines of clients
+static llvm::Error makePrivateDirectory(const llvm::StringRef path) {
+  auto directory = llvm::sys::path::parent_path(path).str();
+  if (directory.empty()) {
+    directory = ".";
+  }
+#ifdef _WIN32
+  if (const auto ec = llvm::sys::fs::create_directories(directory)) {
+    return error("cannot create `{}`: {}", directory, ec.message());
+  }
+#else
+  if (::mkdir(directory.c_str(), 0700) != 0 && errno != EEXIST) {
+    return error("cannot create `{}`: {}", directory, std::strerror(errno));
+  }
+  struct stat status;
+  if (::lstat(directory.c_str(), &status) != 0 ||
+      !S_ISDIR(status.st_mode) || status.st_uid != ::getuid() ||
+      (status.st_mode & 077) != 0) {
+    return error("`{}` must be a directory only you can access (mode 0700)",
+                 directory);
+  }
+#endif
+  return llvm::Error::success();
+}
+
+/// A connection over which a client sends a command line (one frame per
+/// argument, its working directory, then kRun) and the server streams back
+/// what the compiler writes to stdout and stderr, then its exit code
+class Connection {
+public:
+  enum Kind : char { kArg, kCwd, kRun, kStdout, kStderr, kExit };
+
+  explicit Connection(const socket_t socket) : socket_{socket} {}
+
+  ~Connection() {
+    if (socket_ != InvalidSocket) {
+      closeSocket(socket_);
+    }
+  }
+
+  Connection(const Connection&) = delete;
+  Connection& operator=(const Connection&) = delete;
+
+  // receive() gives up on a peer silent for @param seconds
+  void setReadTimeout(const unsigned seconds) {
+#ifdef _WIN32
+    const DWORD timeout = seconds * 1000;
+#else
+    const timeval timeout{static_cast<time_t>(seconds), 0};
+#endif
+    (void)::setsockopt(socket_, SOL_SOCKET, SO_RCVTIMEO,
+                       reinterpret_cast<const char*>(&timeout),
+                       sizeof(timeout));
+  }
+
+  bool send(const Kind kind, const llvm::StringRef payload) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    const auto size = static_cast<uint32_t>(payload.size());
+    char header[5] = {kind};
+    std::memcpy(header + 1, &size, sizeof(size));
+    return write(header, sizeof(header)) && write(payload.data(), size);
+  }
+
+  // whether the peer runs as our user
+  bool isOwnUser() const {
+#if defined(_WIN32)
+    return true; // (only the user can reach their temporary directory)
+#elif defined(SO_PEERCRED)
+    ucred credentials;
+    socklen_t size = sizeof(credentials);
+    return ::getsockopt(socket_, SOL_SOCKET, SO_PEERCRED, &credentials,
+                        &size) == 0 &&
+           credentials.uid == ::getuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    return ::getpeereid(socket_, &uid, &gid) == 0 && uid == ::getuid();
+#endif
+  }
+
+  // the next frame, or None if the peer hung up
+  llvm::Optional<std::pair<Kind, std::string>> receive() {
+    char header[5];
+    if (!read(header, sizeof(header))) {
+      return llvm::None;
+    }
+    uint32_t size;
+    std::memcpy(&size, header + 1, sizeof(size));
+    std::string payload(size, '\0');
+    if (!read(&payload[0], size)) {
+      return llvm::None;
+    }
+    return std::pair{static_cast<Kind>(header[0]), std::move(payload)};
+  }
+
+private:
+  const socket_t socket_;
+  std::mutex mutex_;
+
+  bool write(const char* data, size_t size) {
+    while (size) {
+      const auto sent =
+          ::send(socket_, data, static_cast<int>(size), SendFlags);
+      if (sent <= 0) {
+        return false;
+      }
+      data += sent;
+      size -= static_cast<size_t>(sent);
+    }
+    return true;
+  }
+
+  bool read(char* data, size_t size) {
+    while (size) {
+      const auto received = ::recv(socket_, data, static_cast<int>(size), 0);
+      if (received <= 0) {
+        return false;
+      }
+      data += received;
+      size -= static_cast<size_t>(received);
+    }
+    return true;
+  }
+};
+
+class Socket {
+public:
+  static llvm::Expected<socket_t> create(const llvm::StringRef path,
+                                         sockaddr_un& address) {
+#ifdef _WIN32
+    static const auto started = [] {
+      WSADATA data;
+      return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+    }();
+    if (!started) {
+      return error("could not initialize sockets");
+    }
+#endif
+    if (path.size() >= sizeof(address.sun_path)) {
+      return error("socket path `{}` is too long", path.str());
+    }
+    address = {};
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.data(), path.size());
+    const auto s = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (s == InvalidSocket) {
+      return error("could not create a socket");
+    }
+    return s;
+  }
+};
+
+/// Streams what is written to it to a client, unbuffered (the jobs of a
+/// batch compile write to it at once)
+class FrameStream final : public llvm::raw_ostream {
+public:
+  FrameStream(Connection& connection, const Connection::Kind kind)
+      : llvm::raw_ostream(true), connection_{connection}, kind_{kind} {}
+
+private:
+  Connection& connection_;
+  const Connection::Kind kind_;
+  std::atomic<uint64_t> position_{0};
+
+  void write_impl(const char* data, size_t size) final {
+    (void)connection_.send(kind_, {data, size});
+    position_ += size;
+  }
+
+  uint64_t current_pos() const final { return position_; }
+};
+
+/// Compiles the command lines clients (of our user) send, each on a worker
+/// thread, in a process which keeps the parser, targets, pass pipelines
+/// and imported modules warm across requests
+class Server {
+public:
+  // runs a command line in the given working directory, writing what
+  // it would to stdout and stderr to the given streams; returns the exit
+  // code
+  using handler_t = std::function<int(const std::vector<std::string>&,
+                                      llvm::StringRef, llvm::raw_ostream&,
+                                      llvm::raw_ostream&)>;
+
+  // how long a client may take to send its command line
+  constexpr static unsigned ReadTimeout = 30;
+
+  explicit Server(std::string path) : path_{std::move(path)} {}
+
+  llvm::Error serve(const handler_t& handler) {
+#if !defined(_WIN32) && !defined(MSG_NOSIGNAL)
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+    if (auto err = makePrivateDirectory(path_)) {
+      return err;
+    }
+    sockaddr_un address;
+    auto s = Socket::create(path_, address);
+    if (!s) {
+      return s.takeError();
+    }
+    const auto listener = *s;
+    if (auto err = this->removeStaleSocket()) {
+      closeSocket(listener);
+      return err;
+    }
+    if (::bind(listener, reinterpret_cast<sockaddr*>(&address),
+               sizeof(address)) != 0 ||
+        ::listen(listener, SOMAXCONN) != 0) {
+      closeSocket(listener);
+      return error("could not listen on `{}`", path_);
+    }
+    Log->info("listening on `{}`", path_);
+    // (workers keep what they cache per thread, e.g. target machines)
+    llvm::ThreadPool workers{std::max(1u, std::thread::hardware_concurrency())};
+    while (true) {
+      const auto client = ::accept(listener, nullptr, nullptr);
+      if (client == InvalidSocket) {
+        continue;
+      }
+      auto connection = std::make_shared<Connection>(client);
+      if (!connection->isOwnUser()) {
+        Log->warn("refused a client of another user");
+        continue;
+      }
+      connection->setReadTimeout(ReadTimeout);
+      workers.async([connection, &handler] { handle(*connection, handler); });
+    }
+  }
+
+private:
+  const std::string path_;
+
+  // a socket at our path whose server is gone would keep us from binding;
+  // that of a live server must stay
+  llvm::Error removeStaleSocket() const {
+    namespace fs = llvm::sys::fs;
+    fs::file_status status;
+    if (fs::status(path_, status)) {
+      return llvm::Error::success(); // (there is none)
+    }
+    if (status.type() != fs::file_type::socket_file) {
+      return error("`{}` exists and is not a socket", path_);
+    }
+    sockaddr_un address;
+    auto s = Socket::create(path_, address);
+    if (!s) {
+      return s.takeError();
+    }
+    const auto connected = ::connect(*s, reinterpret_cast<sockaddr*>(&address),
+                                     sizeof(address)) == 0;
+    closeSocket(*s);
+    if (connected) {
+      return error("a server is already listening on `{}`", path_);
+    }
+    (void)fs::remove(path_);
+    return llvm::Error::success();
+  }
+
+  static void handle(Connection& connection, const handler_t& handler) {
+    std::vector<std::string> args;
+    std::string cwd;
+    while (true) {
+      auto frame = connection.receive();
+      if (!frame) {
+        return;
+      }
+      auto& [kind, payload] = *frame;
+      if (kind == Connection::kArg) {
+        args.push_back(std::move(payload));
+      } else if (kind == Connection::kCwd) {
+        cwd = std::move(payload);
+      } else if (kind == Connection::kRun) {
+        break;
+      }
+    }
+    FrameStream out{connection, Connection::kStdout};
+    FrameStream err{connection, Connection::kStderr};
+    const auto code = handler(args, cwd, out, err);
+    connection.send(Connection::kExit, std::to_string(code));
+  }
+};
+
+/// Forwards a command line to the server listening on a socket and relays
+/// its output; fails (so that we compile in-process) if none is listening
+class Client {
+public:
+  explicit Client(std::string path) : path_{std::move(path)} {}
+
+  // whether @param arg prints and exits (e.g. -help, --version), which
+  // must not happen in the server
+  static bool exits(const llvm::StringRef arg) {
+    const auto option = arg.ltrim('-');
+    return arg.startswith("-") &&
+           (option.startswith("help") || option == "version" ||
+            option.startswith("print-options") ||
+            option.startswith("print-all-options"));
+  }
+
+  llvm::Expected<int> run(const int argc, const char* const argv[]) {
+    for (auto i = 1; i < argc; ++i) {
+      if (exits(argv[i])) {
+        return error("`{}` runs in-process", argv[i]);
+      }
+    }
+    sockaddr_un address;
+    auto s = Socket::create(path_, address);
+    if (!s) {
+      return s.takeError();
+    }
+    if (::connect(*s, reinterpret_cast<sockaddr*>(&address),
+                  sizeof(address)) != 0) {
+      closeSocket(*s);
+      return error("no server is listening on `{}`", path_);
+    }
+    Connection connection{*s};
+    if (!connection.isOwnUser()) {
+      return error("the server on `{}` runs as another user", path_);
+    }
+    llvm::SmallString<256> cwd;
+    (void)llvm::sys::fs::current_path(cwd);
+    auto sent = connection.send(Connection::kCwd, cwd);
+    for (auto i = 1; sent && i < argc; ++i) {
+      sent = connection.send(Connection::kArg, argv[i]);
+    }
+    if (!sent || !connection.send(Connection::kRun, "")) {
+      return error("could not send the command line to `{}`", path_);
+    }
+    while (auto frame = connection.receive()) {
+      const auto& [kind, payload] = *frame;
+      if (kind == Connection::kStdout) {
+        std::fwrite(payload.data(), 1, payload.size(), stdout);
+      } else if (kind == Connection::kStderr) {
+        std::fwrite(payload.data(), 1, payload.size(), stderr);
+      } else if (kind == Connection::kExit) {
+        std::fflush(stdout);
+        return std::stoi(payload);
+      }
+    }
+    return error("lost the connection to `{}`", path_);
+  }
+
+private:
+  const std::string path_;
+};
+
+} // end namespace whack::server
+
+#endif // WHACK_SERVER_HPP
@@ -18,46 +18,95 @@
 
 #pragma once
 
+#include "options.hpp"
 #include <folly/ScopeGuard.h>
 #include <llvm-c/Core.h>
 #include <llvm-c/ExecutionEngine.h>
 #include <llvm-c/Initialization.h>
 #include <llvm-c/Target.h>
 #include <llvm-c/TargetMachine.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Support/Host.h>
 #include <llvm/Support/raw_ostream.h>
+#include <map>
+#include <string>
 
 namespace whack {
 
+/// The (initialized) native target. Target machines are not shared
+/// between threads (modules compile concurrently in batches), so each
+/// thread gets its own machine, for the CPU and features the command line
+/// asks for (by default, a generic CPU of the target).
 class Target {
 public:
   explicit Target(const bool shouldLinkInMCJIT = false) {
     init(shouldLinkInMCJIT);
     auto targetTriple = LLVMGetDefaultTargetTriple();
     SCOPE_EXIT { LLVMDisposeMessage(targetTriple); };
-    LLVMTargetRef target;
+    triple_ = targetTriple;
     char* error;
-    if (LLVMGetTargetFromTriple(targetTriple, &target, &error)) {
+    if (LLVMGetTargetFromTriple(targetTriple, &target_, &error)) {
       llvm::errs() << error;
       LLVMDisposeMessage(error);
+      target_ = nullptr;
     } else {
-      assert(LLVMTargetHasJIT(target));
-      targetMachine_ = LLVMCreateTargetMachine(
-          target, targetTriple, "", "", LLVMCodeGenLevelDefault,
-          LLVMRelocDefault, LLVMCodeModelJITDefault);
-      assert(targetMachine_);
+      assert(LLVMTargetHasJIT(target_));
     }
   }
 
-  inline const auto getMachine() const { return targetMachine_; }
+  LLVMTargetMachineRef getMachine() const {
+    struct Machine {
+      LLVMTargetMachineRef ref{nullptr};
+      ~Machine() {
+        if (ref) {
+          LLVMDisposeTargetMachine(ref);
+        }
+      }
+    };
+    // compile server requests may ask for other CPUs
+    thread_local std::map<std::pair<std::string, std::string>, Machine>
+        machines;
+    const auto cpu = getCPU();
+    const auto features = getFeatures();
+    auto& machine = machines[{cpu, features}];
+    if (!machine.ref && target_) {
+      machine.ref = LLVMCreateTargetMachine(
+          target_, triple_.c_str(), cpu.c_str(), features.c_str(),
+          LLVMCodeGenLevelDefault, LLVMRelocDefault, LLVMCodeModelJITDefault);
+      assert(machine.ref);
+    }
+    return machine.ref;
+  }
+
+  // the CPU we generate code for; `native` is the host CPU
+  static std::string getCPU() {
+    if (TargetCPU == "native") {
+      return llvm::sys::getHostCPUName();
+    }
+    return TargetCPU;
+  }
 
-  ~Target() {
-    if (targetMachine_) {
-      LLVMDisposeTargetMachine(targetMachine_);
+  // the features of the CPU we generate code for (those of the host for
+  // `native`), as amended by -mattr (e.g. `+avx2,-avx512f`)
+  static std::string getFeatures() {
+    std::string features;
+    llvm::StringMap<bool> hostFeatures;
+    if (TargetCPU == "native" && llvm::sys::getHostCPUFeatures(hostFeatures)) {
+      for (const auto& feature : hostFeatures) {
+        features += (features.empty() ? "" : ",") +
+                    std::string{feature.getValue() ? "+" : "-"} +
+                    feature.getKey().str();
+      }
+    }
+    if (!TargetFeatures.empty()) { // later features override earlier ones
+      features += (features.empty() ? "" : ",") + TargetFeatures;
     }
+    return features;
   }
 
 private:
-  LLVMTargetMachineRef targetMachine_;
+  std::string triple_;
+  LLVMTargetRef target_{nullptr};
 
   static void init(const bool shouldLinkInMCJIT) {
     LLVMInitializeAllTargetInfos();
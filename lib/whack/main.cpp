@@ -13,69 +13,306 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <cstdlib>
 #include <llvm/Support/CommandLine.h>
+#include <atomic>
 #include <llvm/Support/ManagedStatic.h>
-#include <whack/codegen/module.hpp>
-
-// Some command-line args
-std::string InputFilename;
-std::string GrammarFilename;
-std::string OutputObjectFilename;
-std::string OutputExecutableFilename;
-bool EmitLLVM;
-OptLevel OptimizationLevel;
-SizeOptLevel SizeOptimizationLevel;
-std::vector<std::string> ModuleSearchPaths; // @todo -I
+#include <llvm/Support/ThreadPool.h>
+#include <whack/codegen/build.hpp>
+#include <whack/server.hpp>
+
+// Some command-line args (see whack/options.hpp)
+thread_local std::vector<std::string> InputFilenames;
+thread_local std::string GrammarFilename;
+thread_local std::string OutputObjectFilename;
+thread_local std::string OutputExecutableFilename;
+thread_local bool EmitLLVM;
+thread_local unsigned NumJobs;
+thread_local bool BuildProject;
+thread_local OptLevel OptimizationLevel;
+thread_local SizeOptLevel SizeOptimizationLevel;
+thread_local std::vector<std::string> ModuleSearchPaths;
+thread_local std::string TargetCPU;
+thread_local std::string TargetFeatures;
+thread_local std::string WorkingDirectory;
 
 using namespace llvm;
 
 // @todo LLVM adds its opt CL options.
 
-static cl::opt<std::string, true> inputFile(cl::Positional,
-                                            cl::desc("<input file>"),
-                                            cl::Required,
-                                            cl::location(InputFilename));
+// several inputs (also given in @response files) compile as a batch
+static cl::list<std::string> inputFiles(cl::Positional,
+                                        cl::desc("<input files>"),
+                                        cl::OneOrMore);
 
-static cl::opt<std::string, true>
+static cl::opt<std::string>
     grammarFile("g", cl::desc("Specify the grammar filename"),
-                cl::value_desc("filename"), cl::Required,
-                cl::location(GrammarFilename));
+                cl::value_desc("filename"), cl::Required);
 
-static cl::opt<std::string, true>
+static cl::opt<std::string>
     outputFile("o", cl::desc("Specify the output object filename"),
-               cl::value_desc("filename"), cl::location(OutputObjectFilename),
-               cl::init(""));
+               cl::value_desc("filename"), cl::init(""));
 
-static cl::opt<std::string, true>
+static cl::opt<std::string>
     exeFile("e", cl::desc("Specify the output executable filename"),
-            cl::value_desc("filename"), cl::location(OutputExecutableFilename),
-            cl::init(""));
+            cl::value_desc("filename"), cl::init(""));
+
+static cl::list<std::string>
+    searchPaths("I", cl::desc("Add a directory to search for modules in"),
+                cl::value_desc("directory"), cl::Prefix, cl::ZeroOrMore);
+
+static cl::opt<unsigned>
+    jobs("j", cl::desc("Compile up to N inputs at once (default: one per "
+                       "hardware thread)"),
+         cl::value_desc("N"), cl::init(0));
+
+static cl::opt<std::string>
+    cpu("mcpu",
+        cl::desc("Generate code for a CPU (`native`: the host CPU, with its "
+                 "features)"),
+        cl::value_desc("cpu-name"), cl::init(""));
+
+static cl::alias march("march", cl::desc("Alias for -mcpu"),
+                       cl::aliasopt(cpu));
+
+static cl::opt<std::string>
+    attrs("mattr",
+          cl::desc("Enable (+) or disable (-) target features, e.g. "
+                   "+avx2,-avx512f"),
+          cl::value_desc("+a1,-a2,..."), cl::init(""));
 
-static cl::opt<bool, true> emitLLVM("emit-llvm",
-                                    cl::desc("Whether to emit LLVM IR"),
-                                    cl::location(EmitLLVM), cl::init(false));
+static cl::opt<bool> emitLLVM("emit-llvm",
+                              cl::desc("Whether to emit LLVM IR"),
+                              cl::init(false));
 
-static cl::opt<OptLevel, true>
-    optLevel(cl::desc("Choose an optimization level:"),
-             cl::location(OptimizationLevel), cl::init(d),
+static cl::opt<OptLevel>
+    optLevel(cl::desc("Choose an optimization level:"), cl::init(d),
              cl::values(clEnumVal(d, "No optimizations, enable debugging"),
                         clEnumVal(O1, "Enable trivial optimizations"),
                         clEnumVal(O2, "Enable default optimizations"),
                         clEnumVal(O3, "Enable aggresive optimizations")));
 
-static cl::opt<SizeOptLevel, true>
-    sizeOptLevel(cl::desc("Choose a size optimization level:"),
-                 cl::location(SizeOptimizationLevel), cl::init(O0),
+static cl::opt<SizeOptLevel>
+    sizeOptLevel(cl::desc("Choose a size optimization level:"), cl::init(O0),
                  cl::values(clEnumVal(O0, "No size optimizations"),
                             clEnumVal(Os, "Optimize for size"),
                             clEnumVal(Oz, "Optimize for minimum size")));
 
-int main(int argc, char** argv) {
-  constexpr static auto Banner = "The Whack Compiler (pre-alpha)";
-  cl::ParseCommandLineOptions(argc, argv, Banner);
-  llvm::llvm_shutdown_obj{};
-  if (auto err = whack::codegen::Module{}.compile()) {
-    report_fatal_error(std::move(err));
+constexpr static auto Banner = "The Whack Compiler (pre-alpha)";
+
+// Parsed options are shared by the process, so compile server requests
+// parse their command lines one at a time, each taking its options (and
+// starting from the defaults)
+static std::mutex& getCommandLineMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+// compile server requests start from the defaults
+static void resetOptions() {
+  cl::ResetAllOptionOccurrences();
+  inputFiles.clear();
+  searchPaths.clear();
+  BuildProject = false;
+}
+
+// this thread compiles with the parsed options
+static void takeOptions() {
+  InputFilenames.assign(inputFiles.begin(), inputFiles.end());
+  GrammarFilename = grammarFile;
+  OutputObjectFilename = outputFile;
+  OutputExecutableFilename = exeFile;
+  EmitLLVM = emitLLVM;
+  NumJobs = jobs;
+  OptimizationLevel = optLevel;
+  SizeOptimizationLevel = sizeOptLevel;
+  ModuleSearchPaths.assign(searchPaths.begin(), searchPaths.end());
+  TargetCPU = cpu;
+  TargetFeatures = attrs;
+}
+
+/// Compiles the inputs: a single input is linked into an executable, while
+/// a batch is compiled on a thread pool into an object file per input, the
+/// jobs sharing the parser, the target and the imported modules
+static int compile() {
+  using whack::codegen::Module;
+  if (InputFilenames.size() == 1) {
+    if (auto err = Module{InputFilenames[0]}.compile()) {
+      logAllUnhandledErrors(std::move(err), whack::errs(), "whack: ");
+      return 1;
+    }
+    return 0;
+  }
+  if (!OutputObjectFilename.empty() || !OutputExecutableFilename.empty()) {
+    whack::errs() << "whack: cannot use -o or -e with several inputs\n";
+    return 1;
+  }
+  (void)whack::codegen::MainParser->get();
+  (void)whack::codegen::MainTarget->getMachine();
+  whack::codegen::ModuleCache::enabled() = true;
+  std::atomic<bool> failed{false};
+  ThreadPool pool{
+      std::max(1u, NumJobs ? NumJobs : std::thread::hardware_concurrency())};
+  // the jobs compile with our options, and report where we do
+  const auto options = whack::Options::get();
+  for (const auto& input : InputFilenames) {
+    pool.async([&input, &failed, &options] {
+      options.use();
+      if (auto err = Module{input}.compile(false)) {
+        logAllUnhandledErrors(std::move(err), whack::errs(),
+                              whack::format("whack: {}: ", input));
+        failed = true;
+      }
+    });
+  }
+  pool.wait();
+  return failed ? 1 : 0;
+}
+
+/// `whack build <root>` builds the root source file and the modules it
+/// uses, each once, in parallel in dependency order
+static int build() {
+  if (InputFilenames.size() != 1 || !OutputObjectFilename.empty()) {
+    whack::errs() << "usage: whack build -g <grammar> [-I dir]... [-j N] "
+                     "[-e executable] <root>\n";
+    return 1;
+  }
+  (void)whack::codegen::MainParser->get();
+  whack::codegen::Build build{InputFilenames[0]};
+  if (auto err = build.run(NumJobs, OutputExecutableFilename)) {
+    logAllUnhandledErrors(std::move(err), whack::errs(), "whack: ");
+    return 1;
   }
   return 0;
 }
+
+// the command line, past `build` if it starts a project build
+static std::vector<const char*> getCommandLine(const int argc,
+                                               const char* const argv[]) {
+  std::vector<const char*> args{argv[0]};
+  for (auto i = 1; i < argc; ++i) {
+    if (i == 1 && StringRef{argv[i]} == "build") {
+      BuildProject = true;
+      continue;
+    }
+    args.push_back(argv[i]);
+  }
+  return args;
+}
+
+// makes the paths of a request relative to its working directory absolute,
+// as the server's working directory is not the client's
+static void makePathsAbsolute() {
+  for (auto& input : InputFilenames) {
+    input = whack::getAbsolutePath(input);
+  }
+  GrammarFilename = whack::getAbsolutePath(GrammarFilename);
+  OutputObjectFilename = whack::getAbsolutePath(OutputObjectFilename);
+  OutputExecutableFilename = whack::getAbsolutePath(OutputExecutableFilename);
+  for (auto& directory : ModuleSearchPaths) {
+    directory = whack::getAbsolutePath(directory);
+  }
+}
+
+// runs the command line @param args of a compile server client, in its
+// working directory @param cwd, on this worker thread
+static int runRequest(const std::vector<std::string>& args,
+                      const StringRef cwd, const std::string& grammar,
+                      raw_ostream& out, raw_ostream& err) {
+  WorkingDirectory = cwd;
+  whack::Diagnostics::get() = {
+      &out, &err,
+      std::make_shared<spdlog::logger>(
+          "whack", std::make_shared<whack::StreamSink>(err))};
+  SCOPE_EXIT {
+    WorkingDirectory.clear();
+    whack::Diagnostics::get() = {};
+  };
+  std::vector<std::string> expanded;
+  for (const auto& arg : args) {
+    if (whack::server::Client::exits(arg)) { // LLVM would exit()
+      err << whack::format("whack: `{}` is not available through the "
+                           "compile server\n",
+                           arg);
+      return 1;
+    }
+    // (@response files are read from our working directory)
+    expanded.push_back(StringRef{arg}.startswith("@")
+                           ? "@" + whack::getAbsolutePath(arg.substr(1))
+                           : arg);
+  }
+  std::vector<const char*> line{"whack"};
+  for (const auto& arg : expanded) {
+    line.push_back(arg.c_str());
+  }
+  {
+    std::lock_guard<std::mutex> lock{getCommandLineMutex()};
+    resetOptions();
+    const auto argv =
+        getCommandLine(static_cast<int>(line.size()), line.data());
+    if (!cl::ParseCommandLineOptions(static_cast<int>(argv.size()),
+                                     argv.data(), Banner, &err)) {
+      return 1;
+    }
+    takeOptions();
+  }
+  makePathsAbsolute();
+  if (!sys::fs::equivalent(GrammarFilename, grammar)) {
+    err << whack::format("the server uses the grammar in `{}`\n", grammar);
+    return 1;
+  }
+  GrammarFilename = grammar;
+  return BuildProject ? build() : compile();
+}
+
+/// `whack --server -g <grammar> [socket]` compiles the command lines of
+/// clients (any `whack` run with WHACK_SERVER set to the socket) without
+/// rebuilding the parser, targets, pass pipelines and imported modules
+static int serve(const int argc, const char* const argv[]) {
+  auto socket = whack::server::getDefaultSocketPath();
+  for (auto i = 2; i < argc; ++i) {
+    if (StringRef{argv[i]} == "-g" && i + 1 < argc) {
+      SmallString<256> grammar{argv[++i]};
+      (void)sys::fs::make_absolute(grammar);
+      GrammarFilename = grammar.str();
+    } else {
+      socket = argv[i];
+    }
+  }
+  if (GrammarFilename.empty()) {
+    errs() << "usage: whack --server -g <grammar> [socket]\n";
+    return 1;
+  }
+  // the parser is built once, from the grammar we start with
+  const auto grammar = GrammarFilename;
+  (void)whack::codegen::MainParser->get();
+  (void)whack::codegen::MainTarget->getMachine();
+  whack::codegen::ModuleCache::enabled() = true;
+  auto served = whack::server::Server{socket}.serve(
+      [&grammar](const std::vector<std::string>& args, const StringRef cwd,
+                 raw_ostream& out, raw_ostream& err) {
+        return runRequest(args, cwd, grammar, out, err);
+      });
+  logAllUnhandledErrors(std::move(served), errs(), "whack: ");
+  return 1;
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1 && StringRef{argv[1]} == "--server") {
+    return serve(argc, argv);
+  }
+  if (const auto socket = std::getenv("WHACK_SERVER")) {
+    auto code = whack::server::Client{socket}.run(argc, argv);
+    if (code) {
+      return *code;
+    }
+    // we compile in-process if no server is listening
+    consumeError(code.takeError());
+  }
+  const auto args = getCommandLine(argc, argv);
+  cl::ParseCommandLineOptions(static_cast<int>(args.size()), args.data(),
+                              Banner);
+  takeOptions();
+  llvm::llvm_shutdown_obj{};
+  return BuildProject ? build() : compile();
+}
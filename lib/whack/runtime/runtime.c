@@ -14,7 +14,10 @@
  * limitations under the License.
  */
 // gcc runtime.c -o ../build/runtime.o -c
+#include <stdint.h>
+#include <stdlib.h>
 #ifdef _WIN32
+#include <malloc.h>
 #include <windows.h>
 #endif
 
@@ -60,6 +63,211 @@ void __builtin_virtual_free(void* const buf) {
 
 #endif
 
+/// Hashes a string for matches dispatching on string options
+/// (64-bit FNV-1a, kept in sync with DecisionTree::hashString)
+uint64_t __builtin_strhash(const char* str) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (; *str; ++str) {
+    hash ^= (unsigned char)*str;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/// Allocates @param size bytes for `new` of a type aligned beyond what
+/// malloc guarantees (e.g. an @align(64) struct); @param align is a power
+/// of two. Such memory is freed with __builtin_aligned_free.
+void* __builtin_aligned_alloc(const uint64_t size, const uint64_t align) {
+#ifdef _WIN32
+  return _aligned_malloc(size ? size : 1, align);
+#else
+  void* mem = NULL;
+  return posix_memalign(&mem, align, size ? size : 1) ? NULL : mem;
+#endif
+}
+
+void __builtin_aligned_free(void* const ptr) {
+#ifdef _WIN32
+  _aligned_free(ptr);
+#else
+  free(ptr);
+#endif
+}
+
+/// A chunk of the bump region of a thread, which holds the heap
+/// allocations the HeapToStack pass promotes; functions release what they
+/// allocated in it as they return
+typedef struct RegionChunk {
+  struct RegionChunk* prev;
+  char* top;
+  char* end;
+} RegionChunk;
+
+// chunk headers and allocation headers (sizes) keep 16-byte alignment
+#define REGION_CHUNK_HEADER 32
+#define REGION_ALLOC_HEADER 16
+#define REGION_CHUNK_SIZE 65536
+
+static _Thread_local RegionChunk* Region = NULL;
+
+/// The current top of the region, to be passed to __builtin_region_release
+void* __builtin_region_mark() { return Region ? Region->top : NULL; }
+
+void* __builtin_region_alloc(const uint64_t size) {
+  const uint64_t bytes = REGION_ALLOC_HEADER + ((size + 15) & ~15ULL);
+  if (!Region || (uint64_t)(Region->end - Region->top) < bytes) {
+    const uint64_t capacity =
+        bytes > REGION_CHUNK_SIZE ? bytes : REGION_CHUNK_SIZE;
+    RegionChunk* const chunk = malloc(REGION_CHUNK_HEADER + capacity);
+    if (!chunk) {
+      return NULL;
+    }
+    chunk->prev = Region;
+    chunk->top = (char*)chunk + REGION_CHUNK_HEADER;
+    chunk->end = chunk->top + capacity;
+    Region = chunk;
+  }
+  char* const mem = Region->top;
+  *(uint64_t*)mem = bytes;
+  Region->top += bytes;
+  return mem + REGION_ALLOC_HEADER;
+}
+
+/// Pops @param ptr off the region if it was the last allocation made.
+/// Memory the region could not provide (and came from malloc) is freed.
+void __builtin_region_free(void* const ptr) {
+  if (!ptr) {
+    return;
+  }
+  RegionChunk* chunk = Region;
+  while (chunk && ((char*)ptr < (char*)chunk + REGION_CHUNK_HEADER ||
+                   (char*)ptr >= chunk->end)) {
+    chunk = chunk->prev;
+  }
+  if (!chunk) {
+    free(ptr);
+    return;
+  }
+  if (chunk != Region) {
+    return; // released with its function
+  }
+  char* const mem = (char*)ptr - REGION_ALLOC_HEADER;
+  if (mem + *(uint64_t*)mem == Region->top) {
+    Region->top = mem;
+  }
+  // we drop chunks as they empty, e.g. those of large allocations
+  if (Region->top == (char*)Region + REGION_CHUNK_HEADER && Region->prev) {
+    RegionChunk* const prev = Region->prev;
+    free(Region);
+    Region = prev;
+  }
+}
+
+/// Releases everything allocated in the region since @param mark was taken
+void __builtin_region_release(void* const mark) {
+  while (Region) {
+    char* const data = (char*)Region + REGION_CHUNK_HEADER;
+    if (mark && (char*)mark >= data && (char*)mark <= Region->end) {
+      Region->top = mark;
+      return;
+    }
+    RegionChunk* const prev = Region->prev;
+    free(Region);
+    Region = prev;
+  }
+}
+
+/// The builtin `arena` type (kept in sync with codegen/arena.hpp); code
+/// bumps `top` inline and calls __builtin_arena_alloc once it passes `end`
+typedef struct ArenaChunk {
+  struct ArenaChunk* next;
+  char* end;
+} ArenaChunk;
+
+typedef struct Arena {
+  char* top;
+  char* end;
+  ArenaChunk* chunk;
+  ArenaChunk* first;
+} Arena;
+
+#define ARENA_CHUNK_HEADER 16
+#define ARENA_CHUNK_SIZE 65536
+
+static char* __arena_bump(Arena* const arena, const uint64_t size,
+                          const uint64_t align) {
+  const uintptr_t top =
+      ((uintptr_t)arena->top + (align - 1)) & ~(uintptr_t)(align - 1);
+  if (top > (uintptr_t)arena->end || size > (uintptr_t)arena->end - top) {
+    return NULL;
+  }
+  arena->top = (char*)(top + size);
+  return (char*)top;
+}
+
+static void __arena_enter(Arena* const arena, ArenaChunk* const chunk) {
+  arena->chunk = chunk;
+  arena->top = (char*)chunk + ARENA_CHUNK_HEADER;
+  arena->end = chunk->end;
+}
+
+/// Moves @param arena on to its next chunk (reusing those kept across
+/// resets) and allocates there
+void* __builtin_arena_alloc(Arena* const arena, uint64_t size,
+                            uint64_t align) {
+  if (align < 1) {
+    align = 1;
+  }
+  if (size < 1) {
+    size = 1; // distinct allocations get distinct addresses
+  }
+  if (size > UINT64_MAX - ARENA_CHUNK_HEADER - align) {
+    return NULL; // e.g. an element count which overflowed
+  }
+  while (arena->chunk ? arena->chunk->next : arena->first) {
+    __arena_enter(arena, arena->chunk ? arena->chunk->next : arena->first);
+    char* const mem = __arena_bump(arena, size, align);
+    if (mem) {
+      return mem;
+    }
+  }
+  const uint64_t needed = size + align;
+  const uint64_t capacity =
+      needed > ARENA_CHUNK_SIZE ? needed : ARENA_CHUNK_SIZE;
+  ArenaChunk* const chunk = malloc(ARENA_CHUNK_HEADER + capacity);
+  if (!chunk) {
+    return NULL;
+  }
+  chunk->next = NULL;
+  chunk->end = (char*)chunk + ARENA_CHUNK_HEADER + capacity;
+  if (arena->chunk) {
+    arena->chunk->next = chunk;
+  } else {
+    arena->first = chunk;
+  }
+  __arena_enter(arena, chunk);
+  return __arena_bump(arena, size, align);
+}
+
+/// Recycles every chunk of @param arena
+void __builtin_arena_reset(Arena* const arena) {
+  if (arena->first) {
+    __arena_enter(arena, arena->first);
+  }
+}
+
+/// Frees every chunk of @param arena, leaving it empty
+void __builtin_arena_release(Arena* const arena) {
+  ArenaChunk* chunk = arena->first;
+  while (chunk) {
+    ArenaChunk* const next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  arena->top = arena->end = NULL;
+  arena->chunk = arena->first = NULL;
+}
+
 #ifdef __cplusplus
 }
 #endif
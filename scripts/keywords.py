@@ -21,7 +21,7 @@ from utils import read, write
 INTERNAL_DATA_TYPES = [
 	"bool", "int8", "uint8", "int", "uint", "int64", "uint64", "short",
 	"char", "int16", "uint16", "void", "half", "float", "double", "auto",
-	"int32", "uint32", "int128", "uint128"
+	"int32", "uint32", "int128", "uint128", "arena"
 ]
 
 INTERNAL_CONSTANTS = [